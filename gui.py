@@ -4,22 +4,115 @@ import serial
 import serial.tools.list_ports
 import threading
 import time
+from collections import deque
 from dataclasses import dataclass
 import math
 
 SOF1 = 0xAA
 SOF2 = 0x55
 
+# Wire format, mirrors include/hobd_proto.hpp
 # Message types from Arduino
 MSG_LIVE = 0x81
 MSG_DTC  = 0x82
 MSG_ACK  = 0x83
 MSG_ERR  = 0x84
+MSG_CAPS = 0x85
+MSG_TIME = 0x86
+MSG_GROUPS = 0x87
+MSG_AGG = 0x88
+MSG_ALARM = 0x89  # id, active, value(i16 x10)
+MSG_STATS = 0x8A  # per TX class: sent(u16) dropped(u16) peak(u8)
+MSG_KTRACE = 0x8B  # K-line bytes, hobd_logd -k records them
+MSG_GROUP = 0x90  # + group index, telemetry
+MSG_PGROUP = 0xA0  # + group index, telemetry, bit-packed
 
 # Commands to Arduino (single byte)
 CMD_GET_LIVE = 0x01
 CMD_GET_DTC  = 0x02
-CMD_RESET    = 0x03
+CMD_RESET    = 0x03  # + RESET_MAGIC
+CMD_SET_FRAMING = 0x04  # + mode byte
+CMD_HELLO    = 0x05  # -> MSG_CAPS
+CMD_SET_BAUD = 0x06  # + baud code, acked at the old rate
+CMD_BAUD_TEST = 0x07  # + BAUD_TEST_PATTERN, echoed at the new rate
+CMD_TIME_SYNC = 0x08  # + token(u32) -> MSG_TIME
+CMD_STREAM   = 0x09  # + on/off
+CMD_GET_GROUPS = 0x0A  # -> MSG_GROUPS
+CMD_SET_GROUP = 0x0B  # + group, period(u16 ms), chans(u32) -> MSG_GROUPS
+CMD_GET_AGG  = 0x0C  # -> MSG_AGG
+CMD_SET_AGG  = 0x0D  # + channel, AGG_ mode -> MSG_AGG
+CMD_SET_PACKED = 0x0E  # + on/off, MSG_PGROUP instead of MSG_GROUP
+CMD_GET_STATS = 0x0F  # -> MSG_STATS
+CMD_KTRACE   = 0x10  # + on/off, MSG_KTRACE frames
+
+# CMD_SET_BAUD codes, index = code (baudRates in include/hobd_proto.hpp)
+BAUD_RATES = [115200, 230400, 250000, 500000, 1000000]
+BAUD_TEST_PATTERN = bytes([0x55, 0xAA, 0x00, 0xFF])
+RESET_MAGIC = bytes([0x5A, 0xC3])
+BAUD_CONFIRM_S = 1.0  # device falls back after BAUD_CONFIRM_MS
+
+# Host link framings (CMD_SET_FRAMING argument)
+FRAMING_SOF  = 0  # AA 55 type len payload crc8
+FRAMING_COBS = 1  # cobs(type payload crc16) 00
+
+# Feature bits in MSG_CAPS
+FEAT_DTC   = 1 << 0
+FEAT_RESET = 1 << 1
+FEAT_BAUD  = 1 << 2
+FEAT_SEQ   = 1 << 3  # telemetry frames start with seq(u16) + t_us(u32)
+FEAT_TIME  = 1 << 4
+FEAT_GROUPS = 1 << 5
+FEAT_AGG   = 1 << 6
+FEAT_PACKED = 1 << 7
+FEAT_BATCHED = 1 << 8  # Bluetooth build, frames arrive in bursts
+FEAT_QOS   = 1 << 9  # prioritised TX, MSG_ALARM and CMD_GET_STATS
+FEAT_KTRACE = 1 << 10  # CMD_KTRACE (uno_ktrace build)
+
+# MSG_ALARM ids
+ALARMS = {1: ("ECT", "°C"), 2: ("VSS", "km/h")}
+# TX classes in priority order (TxClass in include/hobd_txq.hpp)
+TX_CLASSES = ("alarm", "reply", "telem", "bulk")
+
+# Per channel summaries over a group period (MSG_AGG, one byte per channel)
+AGG_LAST   = 0
+AGG_MEAN   = 1
+AGG_MINMAX = 2
+AGG_MMM    = 3  # min, max, mean
+
+TELEM_HDR_LEN = 6
+
+# Must match LIVE_SCHEMA in include/hobd_proto.hpp, compared by hash in MSG_CAPS
+LIVE_SCHEMA = ("rpm:u16,vss:u8,ect:i16/10,iat:i16/10,map:i16/10,tps:i16/10,"
+               "batt:u16/100,o2:u16/100,flags:u8,maf:u16")
+LIVE_LEN = 18
+
+
+def fnv1a(text: str) -> int:
+    h = 2166136261
+    for b in text.encode():
+        h = ((h ^ b) * 16777619) & 0xFFFFFFFF
+    return h
+
+
+# the hash covers the telemetry header in front of the body
+TELEM_SCHEMA = "seq:u16,us:u32,"
+LIVE_SCHEMA_HASH = fnv1a(TELEM_SCHEMA + LIVE_SCHEMA)
+
+# Channel ids and wire formats (chanDesc in src/hobd_telem.cpp), id = index
+# (name, type, scale, packed bits, packed min)
+CHANNELS = [
+    ("rpm", "u16", 1, 14, 0), ("vss", "u8", 1, 8, 0), ("flags", "u8", 1, 4, 0),
+    ("ect", "i16", 10, 11, -400), ("iat", "i16", 10, 11, -400),
+    ("map", "i16", 10, 11, -50), ("baro", "i16", 10, 11, -50),
+    ("tps", "i8", 1, 7, -12), ("o2", "u16", 100, 9, 0), ("volt", "u16", 100, 12, 0),
+    ("altf", "u16", 10, 10, 0), ("eld", "i16", 10, 10, -240),
+    ("sft", "i8", 1, 8, -128), ("lft", "i8", 1, 8, -128), ("inj", "u16", 1, 9, 0),
+    ("ign", "i8", 1, 7, -16), ("lmt", "i8", 1, 7, -16), ("iacv", "u8", 1, 7, 0),
+    ("knoc", "u8", 1, 3, 0), ("maf", "u16", 1, 16, 0),
+]
+CHAN_SCHEMA = ",".join(f"{n}:{t}" + (f"/{sc}" if sc != 1 else "") + f"@{bits}" + (f"{lo}" if lo else "")
+                       for n, t, sc, bits, lo in CHANNELS)
+CHAN_SCHEMA_HASH = fnv1a(CHAN_SCHEMA)
 
 
 @dataclass
@@ -34,6 +127,104 @@ class LiveData:
     o2_v: float = 0.0
     flags: int = 0
     maf: int = 0
+    t_host: float = 0.0  # sample time on the host clock, 0 if unknown
+
+
+@dataclass
+class Caps:
+    version: int = 1
+    framings: int = 1 << FRAMING_SOF
+    max_baud: int = 115200
+    schema_hash: int = LIVE_SCHEMA_HASH
+    rx_buf: int = 64
+    tx_buf: int = 64
+    max_payload: int = 255
+    live_len: int = LIVE_LEN
+    features: int = FEAT_DTC | FEAT_RESET
+    chan_hash: int = 0
+    batch: int = 0  # link batch size, 0 = unbatched
+    batch_ms: int = 0
+
+
+def decode_caps(payload: bytes) -> Caps:
+    if len(payload) < 16:
+        raise ValueError(f"Short caps payload: {len(payload)} bytes")
+    p = payload
+    return Caps(
+        version=p[0], framings=p[1],
+        max_baud=int.from_bytes(p[2:6], "big"),
+        schema_hash=int.from_bytes(p[6:10], "big"),
+        rx_buf=p[10], tx_buf=p[11], max_payload=p[12], live_len=p[13],
+        features=u16(p[14], p[15]),
+        chan_hash=int.from_bytes(p[16:20], "big") if len(p) >= 20 else 0,
+        batch=p[20] if len(p) >= 22 else 0,
+        batch_ms=p[21] if len(p) >= 22 else 0,
+    )
+
+
+def decode_alarm(payload: bytes):
+    """MSG_ALARM -> (name, active, value, unit)"""
+    if len(payload) < 4:
+        raise ValueError(f"Short alarm payload: {len(payload)} bytes")
+    name, unit = ALARMS.get(payload[0], (f"#{payload[0]}", ""))
+    return name, bool(payload[1]), s16(payload[2], payload[3]) / 10.0, unit
+
+
+def decode_stats(payload: bytes):
+    """MSG_STATS -> {class: (sent, dropped, peak)}"""
+    out = {}
+    for i, name in enumerate(TX_CLASSES):
+        p = payload[i * 5:i * 5 + 5]
+        if len(p) < 5:
+            break
+        out[name] = (u16(p[0], p[1]), u16(p[2], p[3]), p[4])
+    return out
+
+
+def decode_groups(payload: bytes):
+    """MSG_GROUPS -> [(period_ms, chan_mask), ...], index = group"""
+    count = payload[0] if payload else 0
+    out = []
+    for g in range(count):
+        p = payload[1 + g * 6: 7 + g * 6]
+        if len(p) < 6:
+            break
+        out.append((u16(p[0], p[1]), int.from_bytes(p[2:6], "big")))
+    return out
+
+
+def decode_group(payload: bytes, mask: int, modes=None, packed: bool = False) -> dict:
+    """
+    Group frame body -> {channel name: value}, channels in id order.
+    Summarised channels also get name_min / name_max; the plain name is
+    the mean, or the max for AGG_MINMAX. Packed frames hold value - min in
+    exactly the channel's bits, MSB first.
+    """
+    values = {}
+    bits_total = len(payload) * 8
+    acc = int.from_bytes(payload, "big")
+    pos = 0  # in bits
+    for ch, (name, fmt, scale, bits, lo) in enumerate(CHANNELS):
+        if not mask & (1 << ch):
+            continue
+        mode = modes[ch] if modes else AGG_LAST
+        width = bits if packed else (16 if fmt.endswith("16") else 8)
+        count = (1, 1, 2, 3)[mode]
+        if pos + width * count > bits_total:
+            raise ValueError(f"Short group payload: {len(payload)} bytes")
+        vals = []
+        for _ in range(count):
+            raw = (acc >> (bits_total - pos - width)) & ((1 << width) - 1)
+            pos += width
+            if packed:
+                raw += lo
+            elif fmt[0] == "i" and raw & (1 << (width - 1)):
+                raw -= 1 << width
+            vals.append(raw / scale)
+        if mode in (AGG_MINMAX, AGG_MMM):
+            values[name + "_min"], values[name + "_max"] = vals[0], vals[1]
+        values[name] = vals[-1]
+    return values
 
 
 def u16(hi, lo) -> int:
@@ -45,21 +236,60 @@ def s16(hi, lo) -> int:
         v -= 0x10000
     return v
 
-def calc_crc8_sum(header_bytes: bytes, payload: bytes) -> int:
-    # Arduino code: crc = mkcrc(header,4) + mkcrc(payload,len) ; then crc & 0xFF
-    # We don't know mkcrc internals, BUT your sketch is summing bytes via mkcrc.
-    # For GUI robustness, we can validate using simple sum-of-bytes (common approach).
-    # If mkcrc is different, set validate_crc=False in parser call.
-    return (sum(header_bytes) + sum(payload)) & 0xFF
+# Host link checksums, same polynomials as include/hobd_crc.hpp
+CRC8_POLY = 0x07
+CRC8_INIT = 0x00
+CRC16_POLY = 0x1021
+CRC16_INIT = 0xFFFF
+
+
+def _crc8_table():
+    table = []
+    for i in range(256):
+        c = i
+        for _ in range(8):
+            c = ((c << 1) ^ CRC8_POLY) if c & 0x80 else (c << 1)
+        table.append(c & 0xFF)
+    return table
+
+
+def _crc16_table():
+    table = []
+    for i in range(256):
+        c = i << 8
+        for _ in range(8):
+            c = ((c << 1) ^ CRC16_POLY) if c & 0x8000 else (c << 1)
+        table.append(c & 0xFFFF)
+    return table
+
+
+CRC8_TABLE = _crc8_table()
+CRC16_TABLE = _crc16_table()
+
+
+def crc8(data: bytes, crc: int = CRC8_INIT) -> int:
+    for b in data:
+        crc = CRC8_TABLE[crc ^ b]
+    return crc
+
+
+def crc16(data: bytes, crc: int = CRC16_INIT) -> int:
+    for b in data:
+        crc = ((crc << 8) & 0xFFFF) ^ CRC16_TABLE[(crc >> 8) ^ b]
+    return crc
+
+
+def calc_frame_crc(header_bytes: bytes, payload: bytes) -> int:
+    # sendFrame: CRC-8 over type, len and payload (SOF bytes skipped)
+    return crc8(payload, crc8(header_bytes[2:4]))
 
 
 class FrameParser:
     """
     Parses frames:
       AA 55 type len payload... crc
-    CRC validation is OFF by default.
     """
-    def __init__(self, validate_crc: bool = False):
+    def __init__(self, validate_crc: bool = True):
         self.buf = bytearray()
         self.validate_crc = validate_crc
 
@@ -67,10 +297,7 @@ class FrameParser:
         self.buf.extend(data)
 
     def _find_sof(self):
-        for i in range(max(0, len(self.buf) - 1)):
-            if self.buf[i] == SOF1 and self.buf[i+1] == SOF2:
-                return i
-        return -1
+        return self.buf.find(bytes((SOF1, SOF2)))
 
     def next_frame(self):
         while True:
@@ -103,7 +330,7 @@ class FrameParser:
 
             if self.validate_crc:
                 header = bytes(self.buf[0:4])
-                exp = calc_crc8_sum(header, payload)
+                exp = calc_frame_crc(header, payload)
                 if (crc & 0xFF) != exp:
                     # bad frame; drop SOF and resync
                     del self.buf[0:2]
@@ -114,10 +341,63 @@ class FrameParser:
             return mtype, payload
 
 
+def cobs_decode(data: bytes) -> bytes:
+    out = bytearray()
+    i = 0
+    n = len(data)
+    while i < n:
+        code = data[i]
+        if code == 0 or i + code > n + 1:
+            raise ValueError("bad COBS code")
+        out += data[i+1:i+code]
+        i += code
+        if code < 0xFF and i < n:
+            out.append(0)
+    return bytes(out)
+
+
+class CobsFrameParser:
+    """
+    Parses frames:
+      cobs(type payload... crc16) 00
+    A corrupted frame only costs itself, the next 00 is always a boundary.
+    """
+    def __init__(self):
+        self.buf = bytearray()
+        self.dropped = 0
+
+    def feed(self, data: bytes):
+        self.buf.extend(data)
+
+    def next_frame(self):
+        while True:
+            end = self.buf.find(b"\x00")
+            if end < 0:
+                return None
+            raw = bytes(self.buf[:end])
+            del self.buf[:end + 1]
+            if not raw:
+                continue
+            try:
+                body = cobs_decode(raw)
+            except ValueError:
+                self.dropped += 1
+                continue
+            if len(body) < 3 or crc16(body[:-2]) != (body[-2] << 8 | body[-1]):
+                self.dropped += 1
+                continue
+            return body[0], body[1:-2]
+
+
+def make_parser(framing: int):
+    return CobsFrameParser() if framing == FRAMING_COBS else FrameParser()
+
+
 def decode_live(payload: bytes) -> LiveData:
     print(payload.hex())
-    if len(payload) != 18:
-        raise ValueError(f"Expected 17 bytes live payload, got {len(payload)}")
+    # newer firmware may append fields, only the known prefix is decoded
+    if len(payload) < LIVE_LEN:
+        raise ValueError(f"Expected {LIVE_LEN} bytes live payload, got {len(payload)}")
 
     rpm = u16(payload[0], payload[1])
     vss = payload[2]
@@ -143,6 +423,153 @@ def decode_live(payload: bytes) -> LiveData:
     )
 
 
+def split_telemetry(payload: bytes):
+    """-> (seq, device micros, body) of a FEAT_SEQ telemetry frame"""
+    if len(payload) < TELEM_HDR_LEN:
+        raise ValueError(f"Short telemetry frame: {len(payload)} bytes")
+    seq = u16(payload[0], payload[1])
+    t_us = int.from_bytes(payload[2:6], "big")
+    return seq, t_us, payload[TELEM_HDR_LEN:]
+
+
+class SeqTracker:
+    """
+    Per-stream loss accounting from the 16 bit frame sequence number.
+    lost counts missing numbers, dup repeats of the last one, and
+    reordered frames that arrive after a later one. A step back of more
+    than REORDER_WINDOW is no late frame but a device that rebooted and
+    counts from 0 again: the tracker follows it and counts a reset.
+    """
+    REORDER_WINDOW = 32
+
+    def __init__(self):
+        self.last = None
+        self.received = 0
+        self.lost = 0
+        self.dup = 0
+        self.reordered = 0
+        self.resets = 0
+
+    def update(self, seq: int) -> bool:
+        """False for frames that should not be used (dup / late)."""
+        self.received += 1
+        if self.last is None:
+            self.last = seq
+            return True
+        delta = (seq - self.last) & 0xFFFF
+        if delta == 0:
+            self.dup += 1
+            return False
+        if delta >= 0x10000 - self.REORDER_WINDOW:
+            # just behind the newest one: it was counted as lost when we jumped
+            self.reordered += 1
+            self.lost = max(0, self.lost - 1)
+            return False
+        if delta >= 0x8000:
+            self.resets += 1
+            self.last = seq
+            return True
+        self.lost += delta - 1
+        self.last = seq
+        return True
+
+    def summary(self) -> str:
+        return (f"rx {self.received} lost {self.lost} dup {self.dup} reord {self.reordered}"
+                f" resets {self.resets}")
+
+
+class MicrosUnwrapper:
+    """Extends the device's 32 bit micros() (wraps every ~71 min)."""
+    def __init__(self):
+        self.last_raw = None
+        self.last = 0
+
+    def __call__(self, raw: int) -> int:
+        if self.last_raw is None:
+            self.last_raw, self.last = raw, raw
+            return raw
+        delta = (raw - self.last_raw) & 0xFFFFFFFF
+        if delta >= 0x80000000:
+            # slightly older than the newest value seen, not a wrap
+            return self.last - (0x100000000 - delta)
+        self.last_raw = raw
+        self.last += delta
+        return self.last
+
+
+class ClockSync:
+    """
+    Maps device micros() onto host time.time() from CMD_TIME_SYNC
+    exchanges. Only the fastest quarter of the recent round trips is used
+    (USB-serial buffering only ever adds delay), and a least squares line
+    through their midpoints gives offset and drift.
+    """
+    WINDOW = 64
+
+    def __init__(self):
+        self.unwrap = MicrosUnwrapper()
+        self.samples = deque(maxlen=self.WINDOW)  # (dev_us, host_s, rtt_s)
+        self.pending = {}
+        self.token = 0
+        self.lock = threading.Lock()
+        self.a = None  # host_s = a + b * dev_us
+        self.b = 1e-6
+        self.rtt = 0.0
+
+    def request(self) -> bytes:
+        self.token = (self.token + 1) & 0xFFFFFFFF
+        with self.lock:
+            self.pending[self.token] = time.time()
+            # an answer more than a few requests late is useless anyway
+            for tok in [t for t in self.pending if (self.token - t) & 0xFFFFFFFF > 8]:
+                del self.pending[tok]
+        return bytes([CMD_TIME_SYNC]) + self.token.to_bytes(4, "big")
+
+    def on_reply(self, payload: bytes, t_rx: float):
+        if len(payload) < 12:
+            return
+        token = int.from_bytes(payload[0:4], "big")
+        with self.lock:
+            t_tx = self.pending.pop(token, None)
+            if t_tx is None:
+                return
+            # the unwrapper is shared with to_host() on the UI thread
+            d_rx = self.unwrap(int.from_bytes(payload[4:8], "big"))
+            d_tx = self.unwrap(int.from_bytes(payload[8:12], "big"))
+            rtt = (t_rx - t_tx) - (d_tx - d_rx) * 1e-6
+            self.samples.append(((d_rx + d_tx) / 2, (t_tx + t_rx) / 2, rtt))
+            self._fit()
+
+    def _fit(self):
+        best = sorted(self.samples, key=lambda s: s[2])
+        best = best[:max(4, len(best) // 4)]
+        self.rtt = best[0][2]
+        n = len(best)
+        mx = sum(s[0] for s in best) / n
+        my = sum(s[1] for s in best) / n
+        sxx = sum((s[0] - mx) ** 2 for s in best)
+        # needs a couple of seconds of spread before drift is trustworthy
+        if n >= 4 and sxx > (2e6) ** 2:
+            self.b = sum((s[0] - mx) * (s[1] - my) for s in best) / sxx
+        self.a = my - self.b * mx
+
+    @property
+    def synced(self) -> bool:
+        return self.a is not None
+
+    def to_host(self, dev_us_raw: int) -> float:
+        with self.lock:
+            if self.a is None:
+                return 0.0
+            return self.a + self.b * self.unwrap(dev_us_raw)
+
+    def summary(self) -> str:
+        if not self.synced:
+            return "unsynced"
+        # positive drift: the device clock runs fast
+        return f"sync \u00b1{self.rtt * 500:.2f} ms, drift {(1 / (self.b * 1e6) - 1) * 1e6:+.0f} ppm"
+
+
 class Gauge(ttk.Frame):
     """
     Simple round gauge drawn on a Canvas.
@@ -277,7 +704,20 @@ class App(tk.Tk):
         self.ser = None
         self.rx_thread = None
         self.running = False
-        self.parser = FrameParser(validate_crc=False)
+        self.parser = FrameParser()
+        self.framing = FRAMING_SOF
+        self.caps = Caps()
+        self.live_ok = True
+        self.live_seq = SeqTracker()
+        self.clock = ClockSync()
+        self.next_sync = 0.0
+        self.next_stats = 0.0
+        self.alarms = {}
+        self.groups = []
+        self.agg_modes = None
+        self.packed = False
+        self.group_seq = {}
+        self.streaming = False
 
         self.polling = False
         self.poll_ms = tk.IntVar(value=200)
@@ -348,6 +788,10 @@ class App(tk.Tk):
             "batt": tk.StringVar(value="—"),
             "o2": tk.StringVar(value="—"),
             "maf": tk.StringVar(value="—"),
+            "link": tk.StringVar(value="—"),
+            "rpm_max": tk.StringVar(value="—"),
+            "alarm": tk.StringVar(value="—"),
+            "txq": tk.StringVar(value="—"),
             "status": tk.StringVar(value="Disconnected"),
         }
 
@@ -356,6 +800,8 @@ class App(tk.Tk):
             ("MAP", "map", "TPS (%)", "tps"),
             ("Batt (V)", "batt", "O2 (V)", "o2"),
             ("Status", "status", "Maf", "maf"),
+            ("Link", "link", "RPM peak", "rpm_max"),
+            ("Alarm", "alarm", "TX drops", "txq"),
         ]
 
         for r, (l1, k1, l2, k2) in enumerate(rows):
@@ -435,16 +881,130 @@ class App(tk.Tk):
             self.ser = None
             return
 
+        self._handshake()
+        self.live_seq = SeqTracker()
+        self.group_seq = {}
+        self.clock = ClockSync()
+        self.next_sync = 0.0
+        self.alarms = {}
+
         self.running = True
         self.rx_thread = threading.Thread(target=self._rx_loop, daemon=True)
         self.rx_thread.start()
 
         self.btn_connect.config(text="Disconnect")
         self._set_controls_enabled(True)
-        self.vars["status"].set(f"Connected to {port}")
+        mode = "COBS" if self.framing == FRAMING_COBS else "SOF"
+        if self.caps.features & FEAT_BATCHED:
+            mode += f", BT {self.caps.batch} B/{self.caps.batch_ms} ms"
+        self.vars["status"].set(f"Connected to {port} (v{self.caps.version}, {mode}, {self.ser.baudrate})"
+                                if self.live_ok else "Live schema mismatch, update gui.py")
+
+    def _request(self, cmd: bytes, want_types, timeout: float = 3.0, retry: float = 0.5):
+        """
+        Synchronous command/reply before the RX thread runs. Retries because
+        the board may still be booting (opening the port resets an Uno).
+        Returns (type, payload) of the first frame in want_types or None.
+        """
+        deadline = time.time() + timeout
+        next_tx = 0.0
+        while time.time() < deadline:
+            if time.time() >= next_tx:
+                self.ser.write(cmd)
+                next_tx = time.time() + retry
+            data = self.ser.read(self.ser.in_waiting or 1)
+            if data:
+                self.parser.feed(data)
+            while True:
+                fr = self.parser.next_frame()
+                if fr is None:
+                    break
+                if fr[0] in want_types:
+                    return fr
+        return None
+
+    def _handshake(self):
+        # Start from SOF framing whatever the device was left in. The ACK
+        # comes in the new framing; old firmware answers MSG_ERR.
+        self.framing = FRAMING_SOF
+        self.parser = make_parser(FRAMING_SOF)
+        self._request(bytes([CMD_SET_FRAMING, FRAMING_SOF]), (MSG_ACK, MSG_ERR))
+
+        fr = self._request(bytes([CMD_HELLO]), (MSG_CAPS, MSG_ERR), timeout=1.0)
+        if fr is not None and fr[0] == MSG_CAPS:
+            self.caps = decode_caps(fr[1])
+        else:
+            # pre-HELLO firmware: fixed 18 byte live frame, SOF only
+            self.caps = Caps()
+
+        self.live_ok = self.caps.schema_hash == LIVE_SCHEMA_HASH
+
+        # then the best framing both ends support
+        if self.caps.framings & (1 << FRAMING_COBS):
+            self.parser = make_parser(FRAMING_COBS)
+            fr = self._request(bytes([CMD_SET_FRAMING, FRAMING_COBS]), (MSG_ACK,), timeout=1.0)
+            if fr is not None and fr[1][:2] == bytes([CMD_SET_FRAMING, FRAMING_COBS]):
+                self.framing = FRAMING_COBS
+            else:
+                self.parser = make_parser(FRAMING_SOF)
+
+        if self.caps.features & FEAT_BAUD:
+            self._negotiate_baud()
+
+        self.groups = []
+        if self.caps.features & FEAT_GROUPS and self.caps.chan_hash == CHAN_SCHEMA_HASH:
+            fr = self._request(bytes([CMD_GET_GROUPS]), (MSG_GROUPS,), timeout=1.0)
+            if fr is not None:
+                self.groups = decode_groups(fr[1])
+
+        self.agg_modes = None
+        if self.groups and self.caps.features & FEAT_AGG:
+            fr = self._request(bytes([CMD_GET_AGG]), (MSG_AGG,), timeout=1.0)
+            if fr is None:
+                self.groups = []  # can't size the group frames without it
+            else:
+                self.agg_modes = list(fr[1])
+
+        self.packed = False
+        if self.groups and self.caps.features & FEAT_PACKED:
+            fr = self._request(bytes([CMD_SET_PACKED, 1]), (MSG_ACK,), timeout=1.0)
+            self.packed = fr is not None and fr[1][:2] == bytes([CMD_SET_PACKED, 1])
+
+    def _negotiate_baud(self):
+        """
+        Step down from the fastest rate both ends allow until one passes
+        the test pattern. A failed try costs BAUD_CONFIRM_S, after which
+        the device is back at the old rate.
+        """
+        start = self.ser.baudrate
+        for code in reversed(range(len(BAUD_RATES))):
+            rate = BAUD_RATES[code]
+            if rate <= start or rate > self.caps.max_baud:
+                continue
+
+            fr = self._request(bytes([CMD_SET_BAUD, code]), (MSG_ACK, MSG_ERR), timeout=1.0)
+            if fr is None or fr[0] != MSG_ACK:
+                return
+
+            self.ser.baudrate = rate
+            self.parser = make_parser(self.framing)
+            time.sleep(0.02)
+            fr = self._request(bytes([CMD_BAUD_TEST]) + BAUD_TEST_PATTERN, (MSG_ACK,),
+                               timeout=0.5, retry=0.1)
+            if fr is not None and fr[1] == bytes([CMD_BAUD_TEST]) + BAUD_TEST_PATTERN:
+                return
+
+            # wait out the device's fallback, then try the next rate down
+            self.ser.baudrate = start
+            time.sleep(BAUD_CONFIRM_S)
+            self.ser.reset_input_buffer()
+            self.parser = make_parser(self.framing)
 
     def _disconnect(self):
+        if self.ser and self.streaming:
+            self._write_cmd(bytes([CMD_STREAM, 0]))
         self.polling = False
+        self.streaming = False
         self.running = False
         try:
             if self.ser:
@@ -457,11 +1017,11 @@ class App(tk.Tk):
         self.btn_poll.config(text="Start Live")
         self.vars["status"].set("Disconnected")
 
-    def _write_cmd(self, cmd: int):
+    def _write_cmd(self, cmd):
         if not self.ser:
             return
         try:
-            self.ser.write(bytes([cmd]))
+            self.ser.write(bytes([cmd]) if isinstance(cmd, int) else cmd)
         except Exception as e:
             self.vars["status"].set(f"TX error: {e}")
 
@@ -470,23 +1030,28 @@ class App(tk.Tk):
             return
         self.polling = not self.polling
         self.btn_poll.config(text=("Stop Live" if self.polling else "Start Live"))
+        # firmware with output groups pushes them, no need to poll
+        self.streaming = self.polling and bool(self.groups)
+        if self.groups:
+            self._write_cmd(bytes([CMD_STREAM, 1 if self.polling else 0]))
         if self.polling:
-            self.vars["status"].set("Live polling…")
+            self.vars["status"].set("Live streaming…" if self.streaming else "Live polling…")
 
     def _get_dtc(self):
         self._write_cmd(CMD_GET_DTC)
 
     def _reset_ecu(self):
         if messagebox.askyesno("Confirm", "Send ECU RESET?"):
-            self._write_cmd(CMD_RESET)
+            self._write_cmd(bytes([CMD_RESET]) + RESET_MAGIC)
 
     def _rx_loop(self):
         while self.running:
             try:
-                if self.ser and self.ser.in_waiting:
-                    data = self.ser.read(self.ser.in_waiting)
-                    if data:
-                        self.parser.feed(data)
+                # blocks up to the port timeout, so t_rx is close to arrival
+                data = self.ser.read(self.ser.in_waiting or 1) if self.ser else b""
+                t_rx = time.time()
+                if data:
+                    self.parser.feed(data)
                 else:
                     time.sleep(0.01)
 
@@ -495,6 +1060,10 @@ class App(tk.Tk):
                     if fr is None:
                         break
                     mtype, payload = fr
+                    if mtype == MSG_TIME:
+                        # timed here, not after the hop to the UI thread
+                        self.clock.on_reply(payload, t_rx)
+                        continue
                     self.after(0, lambda mt=mtype, pl=payload: self._handle_frame_ui(mt, pl))
 
             except Exception as e:
@@ -503,34 +1072,49 @@ class App(tk.Tk):
 
     def _handle_frame_ui(self, mtype: int, payload: bytes):
         if mtype == MSG_LIVE:
+            if not self.live_ok:
+                return
+            if self.caps.features & FEAT_SEQ:
+                try:
+                    seq, t_us, payload = split_telemetry(payload)
+                except ValueError as e:
+                    self.vars["status"].set(f"Decode live error: {e}")
+                    return
+                fresh = self.live_seq.update(seq)
+                self.vars["link"].set(self.live_seq.summary() + ", " + self.clock.summary())
+                if not fresh:
+                    return
             try:
                 live = decode_live(payload)
             except Exception as e:
                 self.vars["status"].set(f"Decode live error: {e}")
                 return
 
-            # Gauges
-            self.g_rpm.set_value(live.rpm)
-            self.g_vss.set_value(live.vss)
-
-            # Other text fields
-            self.vars["ect"].set(f"{live.ect_c:.1f}")
-            self.vars["iat"].set(f"{live.iat_c:.1f}")
-            self.vars["map"].set(f"{live.map_kpa:.1f}")
-            self.vars["tps"].set(f"{live.tps_pct:.1f}")
-            self.vars["batt"].set(f"{live.batt_v:.2f}")
-            self.vars["o2"].set(f"{live.o2_v:.3f}")
-            self.vars["maf"].set(f"{live.maf:.1f}")
+            if self.caps.features & FEAT_SEQ:
+                live.t_host = self.clock.to_host(t_us)
 
-            flags = live.flags
-            self._set_lamp(self.lamps["ac"],    bool(flags & (1 << 0)))
-            self._set_lamp(self.lamps["brake"], bool(flags & (1 << 1)))
-            self._set_lamp(self.lamps["vtec"],  bool(flags & (1 << 2)))
-            self._set_lamp(self.lamps["cel"],   bool(flags & (1 << 3)))
-            self.vtec_big.set("VTEC ON" if (flags & (1 << 2)) else "VTEC OFF")
+            self._show_values({
+                "rpm": live.rpm, "vss": live.vss, "ect": live.ect_c, "iat": live.iat_c,
+                "map": live.map_kpa, "tps": live.tps_pct, "volt": live.batt_v,
+                "o2": live.o2_v, "maf": live.maf, "flags": live.flags,
+            })
 
-            if self.polling:
-                self.vars["status"].set("Live OK")
+        elif (MSG_GROUP <= mtype < MSG_GROUP + len(self.groups) or
+              MSG_PGROUP <= mtype < MSG_PGROUP + len(self.groups)):
+            packed = mtype >= MSG_PGROUP
+            g = mtype - (MSG_PGROUP if packed else MSG_GROUP)
+            try:
+                seq, t_us, body = split_telemetry(payload)
+                values = decode_group(body, self.groups[g][1], self.agg_modes, packed)
+            except ValueError as e:
+                self.vars["status"].set(f"Decode group error: {e}")
+                return
+            tracker = self.group_seq.setdefault(g, SeqTracker())
+            if not tracker.update(seq):
+                return
+            values["t_host"] = self.clock.to_host(t_us)
+            self.vars["link"].set(tracker.summary() + ", " + self.clock.summary())
+            self._show_values(values)
 
         elif mtype == MSG_DTC:
             if not payload:
@@ -542,9 +1126,28 @@ class App(tk.Tk):
             self.vars["status"].set("DTC received")
 
         elif mtype == MSG_ACK:
+            if len(payload) >= 2:
+                # [cmd, result] acks of the newer commands
+                return
             ok = payload[0] if payload else 0
             self.vars["status"].set("RESET OK" if ok else "RESET FAIL")
 
+        elif mtype == MSG_ALARM:
+            try:
+                name, active, value, unit = decode_alarm(payload)
+            except ValueError as e:
+                self.vars["status"].set(f"Decode alarm error: {e}")
+                return
+            if active:
+                self.alarms[name] = f"{name} {value:.0f} {unit}"
+            else:
+                self.alarms.pop(name, None)
+            self.vars["alarm"].set(", ".join(self.alarms.values()) or "—")
+
+        elif mtype == MSG_STATS:
+            stats = decode_stats(payload)
+            self.vars["txq"].set(" ".join(f"{k} {d}/{s}" for k, (s, d, _) in stats.items()))
+
         elif mtype == MSG_ERR:
             code = payload[0] if payload else 0xFF
             self.vars["status"].set(f"ECU ERR: {code}")
@@ -552,6 +1155,30 @@ class App(tk.Tk):
         else:
             self.vars["status"].set(f"Unknown msg: 0x{mtype:02X}")
 
+    def _show_values(self, values: dict):
+        """Update whatever widgets the given channels feed"""
+        if "rpm" in values:
+            self.g_rpm.set_value(values["rpm"])
+        if "vss" in values:
+            self.g_vss.set_value(values["vss"])
+
+        fields = [("ect", "ect", 1), ("iat", "iat", 1), ("map", "map", 1), ("tps", "tps", 1),
+                  ("volt", "batt", 2), ("o2", "o2", 3), ("maf", "maf", 1), ("rpm_max", "rpm_max", 0)]
+        for name, var, digits in fields:
+            if name in values:
+                self.vars[var].set(f"{values[name]:.{digits}f}")
+
+        if "flags" in values:
+            flags = int(values["flags"])
+            self._set_lamp(self.lamps["ac"],    bool(flags & (1 << 0)))
+            self._set_lamp(self.lamps["brake"], bool(flags & (1 << 1)))
+            self._set_lamp(self.lamps["vtec"],  bool(flags & (1 << 2)))
+            self._set_lamp(self.lamps["cel"],   bool(flags & (1 << 3)))
+            self.vtec_big.set("VTEC ON" if (flags & (1 << 2)) else "VTEC OFF")
+
+        if self.polling:
+            self.vars["status"].set("Live OK")
+
     def _set_dtc_text(self, count, dtcs):
         self.dtc_text.config(state="normal")
         self.dtc_text.delete("1.0", "end")
@@ -565,8 +1192,15 @@ class App(tk.Tk):
         self.dtc_text.config(state="disabled")
 
     def _ui_tick(self):
-        if self.ser and self.polling:
+        if self.ser and self.polling and not self.streaming:
             self._write_cmd(CMD_GET_LIVE)
+        if self.ser and self.caps.features & FEAT_TIME and time.time() >= self.next_sync:
+            # fast at first to get an offset, then just enough to track drift
+            self.next_sync = time.time() + (0.2 if len(self.clock.samples) < 16 else 1.0)
+            self._write_cmd(self.clock.request())
+        if self.ser and self.caps.features & FEAT_QOS and time.time() >= self.next_stats:
+            self.next_stats = time.time() + 2.0
+            self._write_cmd(CMD_GET_STATS)
         ms = max(50, int(self.poll_ms.get() or 200))
         self.after(ms, self._ui_tick)
 
@@ -0,0 +1,207 @@
+// hobd_colbench: speed of the column kernels on every ISA the CPU has.
+//
+//   hobd_colbench [-n samples] [file.hbl]
+//
+// Without a file, n samples of a synthetic rpm channel at ~10 Hz; with
+// one, every channel of that log end to end. The columns are cut into
+// LOG_MAX_BLOCK_SAMPLES runs, the shape a decoded block has, and each
+// kernel of hobd_column.hpp runs over all of them. Prints M samples/s
+// per kernel and ISA, and checks each ISA against the plain version:
+// exact, except sums, which may differ in the last bits.
+
+#include "hobd_column.hpp"
+#include "hobd_log.hpp"
+#include "hobd_time.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+struct Column
+{
+    std::vector<int64_t> t;
+    std::vector<float> v;
+};
+
+static void synthetic(size_t n, Column &c)
+{
+    srand(1);
+    int64_t t = 1700000000LL * 1000000;
+    double rpm = 800, tps = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        t += 100000 + rand() % 600 - 300 + (rand() % 1000 == 0 ? 5000000 : 0);
+        tps += (rand() % 21 - 10) * 0.5;
+        tps = tps < 0 ? 0 : tps > 100 ? 100 : tps;
+        rpm += (tps * 60 - (rpm - 800)) * 0.05 + rand() % 41 - 20;
+        c.t.push_back(t);
+        c.v.push_back((float)floor(rpm));
+    }
+}
+
+static bool fromLog(const char *path, Column &c)
+{
+    LogReader rd;
+    if (!rd.open(path))
+        return false;
+    static int64_t t[LOG_MAX_BLOCK_SAMPLES];
+    static float v[LOG_MAX_BLOCK_SAMPLES];
+    for (uint16_t ch = 0; ch < rd.channels(); ++ch)
+    {
+        for (size_t b = 0; b < rd.blocks(ch).size(); ++b)
+        {
+            const uint32_t n = rd.read(ch, b, t, v);
+            c.t.insert(c.t.end(), t, t + n);
+            c.v.insert(c.v.end(), v, v + n);
+        }
+    }
+    return !c.t.empty();
+}
+
+enum Kernel
+{
+    K_MINMAX, K_SUM, K_FIND, K_FIND_LE, K_TIME, K_WEIGHTS, K_HIST, K_ABOVE, KERNELS
+};
+static const char *const kernelNames[KERNELS] = {
+    "minmax", "sum", "find_ge", "find_le", "time", "weights", "hist", "above",
+};
+
+// what one pass over the column comes to, to compare ISAs by
+struct Result
+{
+    double sum = 0, hist = 0, above = 0, time = 0, weights = 0;
+    float lo = 0, hi = 0;
+    uint64_t found = 0, crossings = 0;
+};
+
+static void pass(const Column &c, Kernel k, Result &r, std::vector<float> &w)
+{
+    const size_t n = c.t.size();
+    double bins[16] = {};
+    for (size_t i = 0; i < n; i += LOG_MAX_BLOCK_SAMPLES)
+    {
+        const size_t m = n - i < LOG_MAX_BLOCK_SAMPLES ? n - i : LOG_MAX_BLOCK_SAMPLES;
+        const int64_t *t = &c.t[i];
+        const float *v = &c.v[i];
+        float *out = &w[i];
+        switch (k)
+        {
+        case K_MINMAX:
+        {
+            float lo, hi;
+            col_minmax(v, m, &lo, &hi);
+            r.lo = !i || lo < r.lo ? lo : r.lo;
+            r.hi = !i || hi > r.hi ? hi : r.hi;
+            break;
+        }
+        case K_SUM: r.sum += col_sum(v, m); break;
+        // up to the first largest / smallest of each run
+        case K_FIND: r.found += col_find_ge(v, m, r.hi); break;
+        case K_FIND_LE: r.found += col_find_le(v, m, r.lo); break;
+        case K_TIME:
+            col_time_to_float(t, m, t[0], 1e-6f, out);
+            r.time += out[m - 1];
+            break;
+        case K_WEIGHTS:
+            col_weights(t, m, 2000000, out);
+            r.weights += out[m / 2];
+            break;
+        case K_HIST: col_hist(v, out, m, 0, 500, 16, bins); break;
+        case K_ABOVE: r.crossings += col_above(v, out, m, 3000, &r.above); break;
+        default: break;
+        }
+    }
+    for (int b = 0; b < 16; ++b)
+        r.hist += bins[b] * (b + 1);
+}
+
+static bool same(const Result &a, const Result &b, Kernel k)
+{
+    switch (k)
+    {
+    case K_MINMAX: return a.lo == b.lo && a.hi == b.hi;
+    case K_SUM: return fabs(a.sum - b.sum) <= 1e-9 * fabs(b.sum);
+    case K_FIND:
+    case K_FIND_LE: return a.found == b.found;
+    case K_TIME: return a.time == b.time;
+    case K_WEIGHTS: return a.weights == b.weights;
+    case K_HIST: return a.hist == b.hist;
+    case K_ABOVE:
+        return a.crossings == b.crossings && fabs(a.above - b.above) <= 1e-9 * fabs(b.above);
+    default: return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = 4000000;
+    int c;
+    while ((c = getopt(argc, argv, "n:h")) != -1)
+    {
+        if (c != 'n')
+        {
+            fprintf(stderr, "usage: %s [-n samples] [file.hbl]\n", argv[0]);
+            return 2;
+        }
+        n = strtoul(optarg, nullptr, 0);
+    }
+
+    Column col;
+    if (optind < argc)
+    {
+        if (!fromLog(argv[optind], col))
+        {
+            fprintf(stderr, "%s: not a hobd log, or an empty one\n", argv[optind]);
+            return 1;
+        }
+    }
+    else
+        synthetic(n, col);
+    n = col.t.size();
+
+    // weights first: hist and above read them
+    std::vector<float> w(n);
+    const ColumnIsa top = column_isa();
+    Result ref[KERNELS];
+    bool ok = true;
+    printf("%zu samples, M samples/s\n%-8s", n, "kernel");
+    for (int isa = COL_SCALAR; isa <= top; ++isa)
+        printf(" %8s", column_isa_name((ColumnIsa)isa));
+    putchar('\n');
+    for (int k = 0; k < KERNELS; ++k)
+    {
+        printf("%-8s", kernelNames[k]);
+        for (int isa = COL_SCALAR; isa <= top; ++isa)
+        {
+            column_use((ColumnIsa)isa);
+            col_weights(col.t.data(), n, 2000000, w.data());
+            Result r;
+            r.lo = ref[K_MINMAX].lo;
+            r.hi = ref[K_MINMAX].hi;
+            int rounds = 0;
+            const uint64_t start = monoUs();
+            do
+            {
+                Result once = r;
+                pass(col, (Kernel)k, once, w);
+                if (!rounds)
+                    r = once;
+                ++rounds;
+            } while (monoUs() - start < 200000);
+            const double sec = (monoUs() - start) / 1e6;
+            if (isa == COL_SCALAR)
+                ref[k] = r;
+            const bool match = same(r, ref[k], (Kernel)k);
+            ok = ok && match;
+            printf(" %8.0f%s", n * rounds / sec / 1e6, match ? "" : "!");
+        }
+        putchar('\n');
+    }
+    column_use(top);
+    if (!ok)
+        printf("! differs from the plain version\n");
+    return ok ? 0 : 1;
+}
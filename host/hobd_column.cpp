@@ -0,0 +1,570 @@
+#include "hobd_column.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COL_X86 1
+#include <immintrin.h>
+#endif
+
+struct ColumnKernels
+{
+    void (*minmax)(const float *, size_t, float *, float *);
+    double (*sum)(const float *, size_t);
+    size_t (*findGe)(const float *, size_t, float);
+    size_t (*findLe)(const float *, size_t, float);
+    void (*timeToFloat)(const int64_t *, size_t, int64_t, float, float *);
+    void (*weights)(const int64_t *, size_t, int64_t, float *);
+    void (*hist)(const float *, const float *, size_t, float, float, int, double *);
+    uint32_t (*above)(const float *, const float *, size_t, float, double *);
+};
+
+// ==========================
+// Plain
+// ==========================
+// Also the tails of the vector versions: every one takes a start index.
+
+static void minmaxScalar(const float *v, size_t i, size_t n, float *lo, float *hi)
+{
+    float a = *lo, b = *hi;
+    for (; i < n; ++i)
+    {
+        a = v[i] < a ? v[i] : a;
+        b = v[i] > b ? v[i] : b;
+    }
+    *lo = a;
+    *hi = b;
+}
+
+static void minmaxPlain(const float *v, size_t n, float *lo, float *hi)
+{
+    *lo = *hi = v[0];
+    minmaxScalar(v, 1, n, lo, hi);
+}
+
+static double sumPlain(const float *v, size_t n)
+{
+    double s = 0;
+    for (size_t i = 0; i < n; ++i)
+        s += v[i];
+    return s;
+}
+
+static size_t findGeScalar(const float *v, size_t i, size_t n, float x)
+{
+    while (i < n && !(v[i] >= x))
+        ++i;
+    return i;
+}
+
+static size_t findGePlain(const float *v, size_t n, float x)
+{
+    return findGeScalar(v, 0, n, x);
+}
+
+static size_t findLeScalar(const float *v, size_t i, size_t n, float x)
+{
+    while (i < n && !(v[i] <= x))
+        ++i;
+    return i;
+}
+
+static size_t findLePlain(const float *v, size_t n, float x)
+{
+    return findLeScalar(v, 0, n, x);
+}
+
+static void timeToFloatScalar(const int64_t *t, size_t i, size_t n, int64_t origin, float scale,
+                              float *out)
+{
+    for (; i < n; ++i)
+        out[i] = (float)(int32_t)(t[i] - origin) * scale;
+}
+
+static void timeToFloatPlain(const int64_t *t, size_t n, int64_t origin, float scale, float *out)
+{
+    timeToFloatScalar(t, 0, n, origin, scale, out);
+}
+
+// i up to n - 1, then the last one
+static void weightsScalar(const int64_t *t, size_t i, size_t n, int64_t gapUs, float *w)
+{
+    for (; i + 1 < n; ++i)
+    {
+        const int64_t d = t[i + 1] - t[i];
+        w[i] = d > 0 && d <= gapUs ? (float)(int32_t)d * 1e-6f : 0;
+    }
+    if (n)
+        w[n - 1] = 0;
+}
+
+static void weightsPlain(const int64_t *t, size_t n, int64_t gapUs, float *w)
+{
+    weightsScalar(t, 0, n, gapUs, w);
+}
+
+static void histPlain(const float *v, const float *w, size_t n, float lo, float width, int bins,
+                      double *out)
+{
+    const float inv = 1 / width;
+    for (size_t i = 0; i < n; ++i)
+        out[col_bin(v[i], lo, inv, bins)] += w[i];
+}
+
+static uint32_t aboveScalar(const float *v, const float *w, size_t i, size_t n, float th,
+                            double *above)
+{
+    uint32_t x = 0;
+    double s = 0;
+    for (; i < n; ++i)
+    {
+        if (v[i] > th)
+            s += w[i];
+        if (i + 1 < n)
+            x += (v[i] > th) != (v[i + 1] > th);
+    }
+    *above += s;
+    return x;
+}
+
+static uint32_t abovePlain(const float *v, const float *w, size_t n, float th, double *above)
+{
+    return aboveScalar(v, w, 0, n, th, above);
+}
+
+static const ColumnKernels plainKernels = {
+    minmaxPlain, sumPlain, findGePlain, findLePlain,
+    timeToFloatPlain, weightsPlain, histPlain, abovePlain,
+};
+
+#ifdef COL_X86
+
+// ==========================
+// SSE2, 4 floats at a time
+// ==========================
+
+static void minmaxSse2(const float *v, size_t n, float *lo, float *hi)
+{
+    size_t i = 0;
+    *lo = *hi = v[0];
+    if (n >= 4)
+    {
+        __m128 a = _mm_loadu_ps(v), b = a;
+        // (x, acc): on a tie, or a NaN x, the accumulator stays, as in
+        // the scalar v[i] < a ? v[i] : a
+        for (i = 4; i + 4 <= n; i += 4)
+        {
+            const __m128 x = _mm_loadu_ps(v + i);
+            a = _mm_min_ps(x, a);
+            b = _mm_max_ps(x, b);
+        }
+        a = _mm_min_ps(a, _mm_movehl_ps(a, a));
+        a = _mm_min_ss(a, _mm_shuffle_ps(a, a, 1));
+        b = _mm_max_ps(b, _mm_movehl_ps(b, b));
+        b = _mm_max_ss(b, _mm_shuffle_ps(b, b, 1));
+        *lo = _mm_cvtss_f32(a);
+        *hi = _mm_cvtss_f32(b);
+    }
+    minmaxScalar(v, i, n, lo, hi);
+}
+
+static double sumSse2(const float *v, size_t n)
+{
+    __m128d a = _mm_setzero_pd(), b = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(v + i);
+        a = _mm_add_pd(a, _mm_cvtps_pd(x));
+        b = _mm_add_pd(b, _mm_cvtps_pd(_mm_movehl_ps(x, x)));
+    }
+    a = _mm_add_pd(a, b);
+    double s = _mm_cvtsd_f64(a) + _mm_cvtsd_f64(_mm_unpackhi_pd(a, a));
+    for (; i < n; ++i)
+        s += v[i];
+    return s;
+}
+
+static size_t findGeSse2(const float *v, size_t n, float x)
+{
+    const __m128 k = _mm_set1_ps(x);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const int m = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(v + i), k));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return findGeScalar(v, i, n, x);
+}
+
+static size_t findLeSse2(const float *v, size_t n, float x)
+{
+    const __m128 k = _mm_set1_ps(x);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const int m = _mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(v + i), k));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return findLeScalar(v, i, n, x);
+}
+
+// four int64 -> their low halves as int32
+static inline __m128i low32(__m128i a, __m128i b)
+{
+    return _mm_castps_si128(
+        _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+static inline __m128i high32(__m128i a, __m128i b)
+{
+    return _mm_castps_si128(
+        _mm_shuffle_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b), _MM_SHUFFLE(3, 1, 3, 1)));
+}
+
+static void timeToFloatSse2(const int64_t *t, size_t n, int64_t origin, float scale, float *out)
+{
+    const __m128i o = _mm_set1_epi64x(origin);
+    const __m128 s = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        const __m128i a = _mm_sub_epi64(_mm_loadu_si128((const __m128i *)(t + i)), o);
+        const __m128i b = _mm_sub_epi64(_mm_loadu_si128((const __m128i *)(t + i + 2)), o);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(low32(a, b)), s));
+    }
+    timeToFloatScalar(t, i, n, origin, scale, out);
+}
+
+static void weightsSse2(const int64_t *t, size_t n, int64_t gapUs, float *w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i limit = _mm_set1_epi32((int32_t)gapUs + 1);
+    const __m128 us = _mm_set1_ps(1e-6f);
+    size_t i = 0;
+    for (; i + 5 <= n; i += 4)
+    {
+        const __m128i a = _mm_sub_epi64(_mm_loadu_si128((const __m128i *)(t + i + 1)),
+                                        _mm_loadu_si128((const __m128i *)(t + i)));
+        const __m128i b = _mm_sub_epi64(_mm_loadu_si128((const __m128i *)(t + i + 3)),
+                                        _mm_loadu_si128((const __m128i *)(t + i + 2)));
+        const __m128i lo = low32(a, b);
+        // no 64 bit compare before SSE4.2: in (0, gap] iff the high half is 0
+        // and the low one is
+        const __m128i ok = _mm_and_si128(
+            _mm_cmpeq_epi32(high32(a, b), zero),
+            _mm_and_si128(_mm_cmpgt_epi32(lo, zero), _mm_cmpgt_epi32(limit, lo)));
+        const __m128 x = _mm_mul_ps(_mm_cvtepi32_ps(lo), us);
+        _mm_storeu_ps(w + i, _mm_and_ps(x, _mm_castsi128_ps(ok)));
+    }
+    weightsScalar(t, i, n, gapUs, w);
+}
+
+static void histSse2(const float *v, const float *w, size_t n, float lo, float width, int bins,
+                     double *out)
+{
+    const float inv = 1 / width;
+    const __m128 l = _mm_set1_ps(lo), k = _mm_set1_ps(inv), top = _mm_set1_ps(bins - 1);
+    const __m128 zero = _mm_setzero_ps();
+    alignas(16) int32_t idx[4];
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(v + i), l), k);
+        x = _mm_min_ps(_mm_max_ps(x, zero), top); // max_ps(NAN, 0) is 0
+        _mm_store_si128((__m128i *)idx, _mm_cvttps_epi32(x));
+        // no scatter: the indices were the work, the adds stay in order
+        out[idx[0]] += w[i];
+        out[idx[1]] += w[i + 1];
+        out[idx[2]] += w[i + 2];
+        out[idx[3]] += w[i + 3];
+    }
+    for (; i < n; ++i)
+        out[col_bin(v[i], lo, inv, bins)] += w[i];
+}
+
+static uint32_t aboveSse2(const float *v, const float *w, size_t n, float th, double *above)
+{
+    const __m128 k = _mm_set1_ps(th);
+    __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+    uint32_t x = 0;
+    size_t i = 0;
+    // v[i + 4] is read for the crossing out of the last lane
+    for (; i + 5 <= n; i += 4)
+    {
+        const __m128 m = _mm_cmpgt_ps(_mm_loadu_ps(v + i), k);
+        const int next = _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(v + i + 1), k));
+        x += __builtin_popcount(_mm_movemask_ps(m) ^ next);
+        const __m128 a = _mm_and_ps(_mm_loadu_ps(w + i), m);
+        s0 = _mm_add_pd(s0, _mm_cvtps_pd(a));
+        s1 = _mm_add_pd(s1, _mm_cvtps_pd(_mm_movehl_ps(a, a)));
+    }
+    s0 = _mm_add_pd(s0, s1);
+    *above += _mm_cvtsd_f64(s0) + _mm_cvtsd_f64(_mm_unpackhi_pd(s0, s0));
+    return x + aboveScalar(v, w, i, n, th, above);
+}
+
+static const ColumnKernels sse2Kernels = {
+    minmaxSse2, sumSse2, findGeSse2, findLeSse2,
+    timeToFloatSse2, weightsSse2, histSse2, aboveSse2,
+};
+
+// ==========================
+// AVX2, 8 floats at a time
+// ==========================
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void minmaxAvx2(const float *v, size_t n, float *lo, float *hi)
+{
+    if (n < 8)
+        return minmaxSse2(v, n, lo, hi);
+    __m256 a = _mm256_loadu_ps(v), b = a;
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(v + i);
+        a = _mm256_min_ps(x, a);
+        b = _mm256_max_ps(x, b);
+    }
+    __m128 a4 = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    __m128 b4 = _mm_max_ps(_mm256_castps256_ps128(b), _mm256_extractf128_ps(b, 1));
+    a4 = _mm_min_ps(a4, _mm_movehl_ps(a4, a4));
+    a4 = _mm_min_ss(a4, _mm_shuffle_ps(a4, a4, 1));
+    b4 = _mm_max_ps(b4, _mm_movehl_ps(b4, b4));
+    b4 = _mm_max_ss(b4, _mm_shuffle_ps(b4, b4, 1));
+    *lo = _mm_cvtss_f32(a4);
+    *hi = _mm_cvtss_f32(b4);
+    minmaxScalar(v, i, n, lo, hi);
+}
+
+AVX2 static double sumAvx2(const float *v, size_t n)
+{
+    __m256d a = _mm256_setzero_pd(), b = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(v + i);
+        a = _mm256_add_pd(a, _mm256_cvtps_pd(_mm256_castps256_ps128(x)));
+        b = _mm256_add_pd(b, _mm256_cvtps_pd(_mm256_extractf128_ps(x, 1)));
+    }
+    a = _mm256_add_pd(a, b);
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+    double r = _mm_cvtsd_f64(s) + _mm_cvtsd_f64(_mm_unpackhi_pd(s, s));
+    for (; i < n; ++i)
+        r += v[i];
+    return r;
+}
+
+AVX2 static size_t findGeAvx2(const float *v, size_t n, float x)
+{
+    const __m256 k = _mm256_set1_ps(x);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const int m = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v + i), k, _CMP_GE_OQ));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return findGeScalar(v, i, n, x);
+}
+
+AVX2 static size_t findLeAvx2(const float *v, size_t n, float x)
+{
+    const __m256 k = _mm256_set1_ps(x);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const int m = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v + i), k, _CMP_LE_OQ));
+        if (m)
+            return i + __builtin_ctz(m);
+    }
+    return findLeScalar(v, i, n, x);
+}
+
+// four int64 -> their low halves as int32
+AVX2 static inline __m128i low32x4(__m256i a)
+{
+    const __m256i pick = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    return _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(a, pick));
+}
+
+AVX2 static void timeToFloatAvx2(const int64_t *t, size_t n, int64_t origin, float scale,
+                                 float *out)
+{
+    const __m256i o = _mm256_set1_epi64x(origin);
+    const __m256 s = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        const __m256i a = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(t + i)), o);
+        const __m256i b = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(t + i + 4)), o);
+        const __m256i ab = _mm256_setr_m128i(low32x4(a), low32x4(b));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(ab), s));
+    }
+    timeToFloatScalar(t, i, n, origin, scale, out);
+}
+
+AVX2 static void weightsAvx2(const int64_t *t, size_t n, int64_t gapUs, float *w)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i limit = _mm256_set1_epi64x(gapUs + 1);
+    const __m256 us = _mm256_set1_ps(1e-6f);
+    size_t i = 0;
+    for (; i + 9 <= n; i += 8)
+    {
+        const __m256i a = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(t + i + 1)),
+                                           _mm256_loadu_si256((const __m256i *)(t + i)));
+        const __m256i b = _mm256_sub_epi64(_mm256_loadu_si256((const __m256i *)(t + i + 5)),
+                                           _mm256_loadu_si256((const __m256i *)(t + i + 4)));
+        const __m256i okA = _mm256_and_si256(_mm256_cmpgt_epi64(a, zero), _mm256_cmpgt_epi64(limit, a));
+        const __m256i okB = _mm256_and_si256(_mm256_cmpgt_epi64(b, zero), _mm256_cmpgt_epi64(limit, b));
+        const __m256i d = _mm256_setr_m128i(low32x4(a), low32x4(b));
+        const __m256i ok = _mm256_setr_m128i(low32x4(okA), low32x4(okB));
+        const __m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(d), us);
+        _mm256_storeu_ps(w + i, _mm256_and_ps(x, _mm256_castsi256_ps(ok)));
+    }
+    weightsScalar(t, i, n, gapUs, w);
+}
+
+AVX2 static void histAvx2(const float *v, const float *w, size_t n, float lo, float width, int bins,
+                          double *out)
+{
+    const float inv = 1 / width;
+    const __m256 l = _mm256_set1_ps(lo), k = _mm256_set1_ps(inv), top = _mm256_set1_ps(bins - 1);
+    const __m256 zero = _mm256_setzero_ps();
+    alignas(32) int32_t idx[8];
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 x = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(v + i), l), k);
+        x = _mm256_min_ps(_mm256_max_ps(x, zero), top);
+        _mm256_store_si256((__m256i *)idx, _mm256_cvttps_epi32(x));
+        for (int j = 0; j < 8; ++j)
+            out[idx[j]] += w[i + j];
+    }
+    for (; i < n; ++i)
+        out[col_bin(v[i], lo, inv, bins)] += w[i];
+}
+
+AVX2 static uint32_t aboveAvx2(const float *v, const float *w, size_t n, float th, double *above)
+{
+    const __m256 k = _mm256_set1_ps(th);
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    uint32_t x = 0;
+    size_t i = 0;
+    for (; i + 9 <= n; i += 8)
+    {
+        const __m256 m = _mm256_cmp_ps(_mm256_loadu_ps(v + i), k, _CMP_GT_OQ);
+        const int next = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(v + i + 1), k, _CMP_GT_OQ));
+        x += __builtin_popcount(_mm256_movemask_ps(m) ^ next);
+        const __m256 a = _mm256_and_ps(_mm256_loadu_ps(w + i), m);
+        s0 = _mm256_add_pd(s0, _mm256_cvtps_pd(_mm256_castps256_ps128(a)));
+        s1 = _mm256_add_pd(s1, _mm256_cvtps_pd(_mm256_extractf128_ps(a, 1)));
+    }
+    s0 = _mm256_add_pd(s0, s1);
+    const __m128d s = _mm_add_pd(_mm256_castpd256_pd128(s0), _mm256_extractf128_pd(s0, 1));
+    *above += _mm_cvtsd_f64(s) + _mm_cvtsd_f64(_mm_unpackhi_pd(s, s));
+    return x + aboveScalar(v, w, i, n, th, above);
+}
+
+static const ColumnKernels avx2Kernels = {
+    minmaxAvx2, sumAvx2, findGeAvx2, findLeAvx2,
+    timeToFloatAvx2, weightsAvx2, histAvx2, aboveAvx2,
+};
+
+#endif // COL_X86
+
+// ==========================
+// Dispatch
+// ==========================
+
+static ColumnIsa best()
+{
+#ifdef COL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return COL_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return COL_SSE2;
+#endif
+    return COL_SCALAR;
+}
+
+static const ColumnKernels *table(ColumnIsa isa)
+{
+#ifdef COL_X86
+    if (isa == COL_AVX2)
+        return &avx2Kernels;
+    if (isa == COL_SSE2)
+        return &sse2Kernels;
+#endif
+    (void)isa;
+    return &plainKernels;
+}
+
+static ColumnIsa isaNow = best();
+static const ColumnKernels *k = table(isaNow);
+
+ColumnIsa column_isa()
+{
+    return isaNow;
+}
+
+const char *column_isa_name(ColumnIsa isa)
+{
+    static const char *const names[] = {"scalar", "sse2", "avx2"};
+    return names[isa];
+}
+
+ColumnIsa column_use(ColumnIsa isa)
+{
+    const ColumnIsa top = best();
+    isaNow = isa < top ? isa : top;
+    k = table(isaNow);
+    return isaNow;
+}
+
+void col_minmax(const float *v, size_t n, float *lo, float *hi)
+{
+    k->minmax(v, n, lo, hi);
+    // which of -0 and +0 comes out depends on the lanes: always +0
+    *lo = *lo == 0 ? 0.0f : *lo;
+    *hi = *hi == 0 ? 0.0f : *hi;
+}
+
+double col_sum(const float *v, size_t n)
+{
+    return k->sum(v, n);
+}
+
+size_t col_find_ge(const float *v, size_t n, float x)
+{
+    return k->findGe(v, n, x);
+}
+
+size_t col_find_le(const float *v, size_t n, float x)
+{
+    return k->findLe(v, n, x);
+}
+
+void col_time_to_float(const int64_t *t, size_t n, int64_t origin, float scale, float *out)
+{
+    k->timeToFloat(t, n, origin, scale, out);
+}
+
+void col_weights(const int64_t *t, size_t n, int64_t gapUs, float *w)
+{
+    k->weights(t, n, gapUs, w);
+}
+
+void col_hist(const float *v, const float *w, size_t n, float lo, float width, int bins,
+              double *out)
+{
+    k->hist(v, w, n, lo, width, bins, out);
+}
+
+uint32_t col_above(const float *v, const float *w, size_t n, float th, double *above)
+{
+    return k->above(v, w, n, th, above);
+}
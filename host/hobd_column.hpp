@@ -0,0 +1,61 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ==========================
+// Column kernels
+// ==========================
+// The inner loops of every query over decoded log columns: a block of
+// LogReader::read() output, a csv chunk. Each has an AVX2, an SSE2 and a
+// plain C++ version; the first call picks the best one the CPU runs (off
+// x86 there is only the plain one). Except for the float sums, whose
+// order differs, all of them return the same bits on every ISA, given
+// columns without NaN: callers keep those out (a NaN may or may not take
+// part in a min / max, depending on where it falls in a vector).
+//
+// Times are µs integers, the one fixed-point column a block has; the
+// conversions turn them into float seconds for weights and plotting.
+
+enum ColumnIsa
+{
+    COL_SCALAR,
+    COL_SSE2,
+    COL_AVX2,
+};
+
+ColumnIsa column_isa();
+const char *column_isa_name(ColumnIsa isa);
+// Run on isa, or the best below it the CPU has; returns what it got. For
+// benchmarks and cross checks, call it before any threads start.
+ColumnIsa column_use(ColumnIsa isa);
+
+// Smallest and largest of v[0..n), n > 0; a zero is always +0
+void col_minmax(const float *v, size_t n, float *lo, float *hi);
+// Sum, in double
+double col_sum(const float *v, size_t n);
+// First i with v[i] >= x, n if none
+size_t col_find_ge(const float *v, size_t n, float x);
+// First i with v[i] <= x, n if none
+size_t col_find_le(const float *v, size_t n, float x);
+
+// out[i] = (t[i] - origin) * scale, |t[i] - origin| < 2^31
+void col_time_to_float(const int64_t *t, size_t n, int64_t origin, float scale, float *out);
+// w[i] = t[i+1] - t[i] in seconds when that is in (0, gapUs], else 0;
+// w[n-1] = 0. gapUs < 2^31 - 1.
+void col_weights(const int64_t *t, size_t n, int64_t gapUs, float *w);
+
+// Histogram bin of v: floor((v - lo) * inv), clamped to [0, bins); NAN
+// goes to bin 0
+static inline int col_bin(float v, float lo, float inv, int bins)
+{
+    float x = (v - lo) * inv;
+    x = x > 0 ? x : 0;
+    x = x < bins - 1 ? x : bins - 1;
+    return (int)x;
+}
+// out[col_bin(v[i], lo, 1 / width, bins)] += w[i]
+void col_hist(const float *v, const float *w, size_t n, float lo, float width, int bins,
+              double *out);
+// *above += the w[i] of every v[i] > th; returns how often consecutive
+// samples are on different sides of th
+uint32_t col_above(const float *v, const float *w, size_t n, float th, double *above);
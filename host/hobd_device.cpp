@@ -0,0 +1,425 @@
+#include "hobd_device.hpp"
+#include "hobd_fanout.hpp"
+#include "hobd_serial.hpp"
+#include "hobd_time.hpp"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+const char *const pipeStageNames[PIPE_STAGES] = {"parse", "decode", "sample", "csv",
+                                                  "shm", "log", "sink", "other"};
+
+void LatencyStats::add(uint32_t us)
+{
+    n++;
+    sumUs += us;
+    minUs = us < minUs ? us : minUs;
+    maxUs = us > maxUs ? us : maxUs;
+    uint8_t b = 0;
+    while (b < 31 && (1u << (b + 1)) <= us)
+        ++b;
+    hist[b]++;
+}
+
+uint32_t LatencyStats::quantileUs(double q) const
+{
+    const uint64_t want = (uint64_t)(q * n);
+    uint64_t seen = 0;
+    for (uint8_t b = 0; b < 32; ++b)
+    {
+        seen += hist[b];
+        if (seen > want)
+            return b == 31 ? UINT32_MAX : (1u << (b + 1)) - 1;
+    }
+    return 0;
+}
+
+// MSG_LIVE, with or without the FEAT_SEQ telemetry header
+struct LiveSample
+{
+    bool hasHdr;
+    TelemHdr hdr;
+    LiveRecord r;
+};
+
+static bool decodeLive(const RxFrame &f, LiveSample &s)
+{
+    s.hasHdr = f.len == TELEM_HDR_LEN + LIVE_LEN;
+    if (!s.hasHdr && f.len != LIVE_LEN)
+        return false;
+    s.hdr = TelemHdr{0, 0};
+    if (s.hasHdr)
+        telem_decode(f.payload, s.hdr);
+    const uint8_t off = s.hasHdr ? TELEM_HDR_LEN : 0;
+    return live_decode(f.payload + off, f.len - off, s.r);
+}
+
+Device::Device(const DeviceConfig &c) : cfg(c)
+{
+    out = cfg.out ? fopen(cfg.out, "a") : stdout;
+    if (out)
+        fprintf(out, "t_host,t_dev_us,seq,rpm,vss,ect,iat,map,tps,batt,o2,flags,maf\n");
+    if (cfg.shm)
+    {
+        char name[80];
+        hobd_shm_name(name, sizeof(name), cfg.path);
+        if (!shm.create(name, cfg.path))
+            perror(name);
+    }
+    if (cfg.log && !log.open(cfg.log, cfg.path, logSampleChannels, LOG_SAMPLE_CHANNELS))
+        fprintf(stderr, "%s: %s\n", cfg.log,
+                errno == EEXIST ? "exists and is not a log with these channels" : strerror(errno));
+    if (cfg.ktrace)
+    {
+        kt = fopen(cfg.ktrace, "w");
+        if (kt)
+            fprintf(kt, "# hobd K-line trace, %s\nt_us,dir,byte\n", cfg.path);
+        else
+            perror(cfg.ktrace);
+    }
+}
+
+Device::~Device()
+{
+    close();
+    if (out && out != stdout)
+        fclose(out);
+    else if (out)
+        fflush(out);
+    if (kt)
+        fclose(kt);
+}
+
+bool Device::open()
+{
+    port = hobd_open_serial(cfg.path, cfg.baud);
+    if (port < 0)
+    {
+        nextOpen = monoMs() + REOPEN_MS;
+        return false;
+    }
+    rx.clear();
+    rx.setFraming(RxRing::SOF);
+    haveSeq = false;
+    for (Pending &p : pending)
+        p.busy = false;
+    fprintf(out, "#open,%.6f,%s\n", wallTime(), cfg.path);
+
+    // the firmware may have been left in COBS by the GUI; an older
+    // firmware answers MSG_ERR, which is harmless
+    const uint8_t framing[2] = {CMD_SET_FRAMING, FRAMING_SOF};
+    sendCmd(framing, sizeof(framing));
+    if (kt)
+    {
+        const uint8_t on[2] = {CMD_KTRACE, 1};
+        sendCmd(on, sizeof(on));
+        ktRebase = true;
+    }
+    if (cfg.reset)
+    {
+        uint8_t reset[1 + sizeof(RESET_MAGIC)] = {CMD_RESET};
+        memcpy(reset + 1, RESET_MAGIC, sizeof(RESET_MAGIC));
+        request(SLOT_RESET, reset, sizeof(reset));
+    }
+
+    nextLive = nextDtc = monoMs();
+    return true;
+}
+
+void Device::close()
+{
+    if (port < 0)
+        return;
+    ::close(port);
+    port = -1;
+    stats.reopens++;
+    nextOpen = monoMs() + REOPEN_MS;
+    fprintf(out, "#close,%.6f\n", wallTime());
+}
+
+bool Device::sendCmd(const uint8_t *cmd, size_t n)
+{
+    // commands are a few bytes, a short write means the port is gone
+    return port >= 0 && write(port, cmd, n) == (ssize_t)n;
+}
+
+bool Device::request(Slot s, uint8_t cmd)
+{
+    return request(s, &cmd, 1);
+}
+
+bool Device::request(Slot s, const uint8_t *cmd, size_t n)
+{
+    if (!sendCmd(cmd, n))
+        return false;
+    pending[s].busy = true;
+    pending[s].sentUs = monoUs();
+    return true;
+}
+
+uint32_t Device::complete(Slot s)
+{
+    if (!pending[s].busy)
+        return 0;
+    pending[s].busy = false;
+    return (uint32_t)(monoUs() - pending[s].sentUs);
+}
+
+bool Device::onReadable()
+{
+    bool alive = true;
+    for (;;)
+    {
+        size_t room;
+        uint8_t *p = rx.writePtr(room);
+        if (!room)
+        {
+            // drain the parser, then keep reading
+            drain();
+            continue;
+        }
+        const ssize_t n = read(port, p, room);
+        if (n > 0)
+        {
+            rx.commit((size_t)n);
+            continue;
+        }
+        // a raw tty with VMIN = 0 reads 0 when drained, a pulled USB
+        // adapter shows up as EIO / EPOLLHUP instead
+        if (n < 0 && errno != EAGAIN && errno != EINTR)
+            alive = false;
+        break;
+    }
+    drain();
+    return alive;
+}
+
+void Device::feed(const uint8_t *p, size_t n)
+{
+    while (n)
+    {
+        // never more than the ring takes, so nothing is overrun
+        const size_t k = n < RX_RING_SIZE / 2 ? n : RX_RING_SIZE / 2;
+        rx.feed(p, k);
+        drain();
+        p += k;
+        n -= k;
+    }
+}
+
+void Device::drain()
+{
+    if (cfg.prof)
+        cfg.prof->start();
+    for (;;)
+    {
+        const bool more = rx.next(frame);
+        mark(PIPE_PARSE);
+        if (!more)
+            break;
+        handle(frame);
+    }
+}
+
+void Device::onKtrace(const RxFrame &f)
+{
+    KtraceEntry e[KTRACE_ENTRIES];
+    uint32_t tUs;
+    const uint8_t n = ktrace_decode(f.payload, f.len, tUs, e);
+    if (!kt || !n)
+        return;
+    if (ktRebase)
+        ktOff = ktLast + 1000000 - tUs;
+    else if (tUs < ktPrev)
+        ktOff += 1LL << 32;
+    ktRebase = false;
+    ktPrev = tUs;
+
+    int64_t t = ktOff + tUs;
+    for (uint8_t i = 0; i < n; ++i)
+    {
+        if (i)
+            t += ktrace_dt_us(e[i].dt);
+        const char dir = e[i].dir == KT_TX ? 'T' : e[i].dir == KT_RX ? 'R' : 'L';
+        fprintf(kt, "%lld,%c,%02X\n", (long long)t, dir, e[i].byte);
+    }
+    ktLast = t;
+}
+
+void Device::handle(const RxFrame &f)
+{
+    const double t = wallTime();
+    switch (f.type)
+    {
+    case MSG_LIVE:
+    {
+        const uint32_t us = complete(SLOT_LIVE);
+        if (us)
+            stats.live.add(us);
+        LiveSample s;
+        if (!decodeLive(f, s))
+        {
+            fprintf(out, "#badlive,%.6f,%u\n", t, f.len);
+            mark(PIPE_DECODE);
+            return;
+        }
+        if (s.hasHdr)
+        {
+            if (haveSeq && s.hdr.seq != (uint16_t)(lastSeq + 1))
+                stats.seqGaps++;
+            lastSeq = s.hdr.seq;
+            haveSeq = true;
+        }
+        mark(PIPE_DECODE);
+        const LiveRecord &r = s.r;
+        fprintf(out, "%.6f,%lu,%u,%u,%u,%.1f,%.1f,%.1f,%.1f,%.2f,%.2f,%u,%u\n",
+                t, (unsigned long)s.hdr.sampleUs, s.hdr.seq,
+                r.rpm, r.vss, r.ect / 10.0, r.iat / 10.0, r.map / 10.0, r.tps / 10.0,
+                r.batt / 100.0, r.o2 / 100.0, r.flags, r.maf);
+        stats.samples++;
+        mark(PIPE_CSV);
+        if (shm.isOpen() || log.isOpen() || cfg.sink)
+        {
+            const HobdSample hs = {t, s.hdr.sampleUs, s.hdr.seq, r.flags,
+                                   (float)r.rpm, (float)r.vss, r.ect / 10.0f, r.iat / 10.0f,
+                                   r.map / 10.0f, r.tps / 10.0f, r.batt / 100.0f,
+                                   r.o2 / 100.0f, (float)r.maf};
+            mark(PIPE_SAMPLE);
+            if (shm.isOpen())
+            {
+                shm.publish(hs);
+                mark(PIPE_SHM);
+            }
+            if (log.isOpen())
+            {
+                log.append(hs);
+                mark(PIPE_LOG);
+            }
+            if (cfg.sink)
+            {
+                cfg.sink->onSample(cfg.index, hs);
+                mark(PIPE_SINK);
+            }
+        }
+        return;
+    }
+    case MSG_DTC:
+        complete(SLOT_DTC);
+        fprintf(out, "#dtc,%.6f,%u", t, f.len ? f.payload[0] : 0);
+        for (uint8_t i = 1; i < f.len; ++i)
+            fprintf(out, ",%02X", f.payload[i]);
+        fputc('\n', out);
+        break;
+    case MSG_ACK:
+        // one byte acks are CMD_RESET, the rest echo [cmd, value]
+        if (f.len == 1)
+        {
+            complete(SLOT_RESET);
+            fprintf(out, "#reset,%.6f,%u\n", t, f.payload[0]);
+        }
+        break;
+    case MSG_ERR:
+    {
+        const uint8_t code = f.len ? f.payload[0] : (uint8_t)ERR_UNKNOWN;
+        if (code == ERR_LIVE)
+            complete(SLOT_LIVE);
+        else if (code == ERR_DTC)
+            complete(SLOT_DTC);
+        stats.errors++;
+        fprintf(out, "#err,%.6f,%u\n", t, code);
+        break;
+    }
+    case MSG_KTRACE:
+        onKtrace(f);
+        break;
+    case MSG_ALARM:
+    {
+        AlarmRecord a;
+        if (alarm_decode(f.payload, f.len, a))
+            fprintf(out, "#alarm,%.6f,%u,%u,%.1f\n", t, a.id, a.active, a.value / 10.0);
+        break;
+    }
+    default:
+        break;
+    }
+    mark(PIPE_OTHER);
+}
+
+void Device::onTimer(uint64_t now)
+{
+    if (now >= nextFlush)
+    {
+        fflush(out);
+        if (kt)
+            fflush(kt);
+        log.flush(now);
+        nextFlush = now + FLUSH_MS;
+    }
+    if (port < 0)
+    {
+        if (now >= nextOpen && !open() && errno != ENOENT)
+            fprintf(stderr, "%s: %s\n", cfg.path, strerror(errno));
+        return;
+    }
+
+    const uint64_t us = monoUs();
+    for (Pending &p : pending)
+    {
+        if (p.busy && us - p.sentUs > REPLY_TMO_MS * 1000ULL)
+        {
+            p.busy = false;
+            stats.timeouts++;
+        }
+    }
+    // one live request in flight at a time, the K-line is the bottleneck
+    if (!pending[SLOT_LIVE].busy && now >= nextLive)
+    {
+        request(SLOT_LIVE, CMD_GET_LIVE);
+        nextLive = now + cfg.pollMs;
+    }
+    if (!pending[SLOT_DTC].busy && now >= nextDtc)
+    {
+        request(SLOT_DTC, CMD_GET_DTC);
+        nextDtc = cfg.dtcS ? now + cfg.dtcS * 1000ULL : UINT64_MAX;
+    }
+}
+
+uint64_t Device::deadline() const
+{
+    uint64_t next = nextFlush;
+    if (port < 0)
+        return next < nextOpen ? next : nextOpen;
+
+    for (const Pending &p : pending)
+    {
+        const uint64_t tmo = p.sentUs / 1000 + REPLY_TMO_MS + 1;
+        if (p.busy && tmo < next)
+            next = tmo;
+    }
+    if (!pending[SLOT_LIVE].busy && nextLive < next)
+        next = nextLive;
+    if (!pending[SLOT_DTC].busy && nextDtc < next)
+        next = nextDtc;
+    return next;
+}
+
+void Device::report(FILE *f, double dt)
+{
+    const RxStats &r = rx.stats;
+    const LatencyStats &l = stats.live;
+    fprintf(f, "%s: %s %.0f B/s %.1f frames/s %.1f samples/s | live rtt ",
+            cfg.path, port < 0 ? "down" : "up", (r.bytes - repBytes) / dt,
+            (r.frames - repFrames) / dt, (stats.samples - repSamples) / dt);
+    if (l.n)
+        fprintf(f, "min %.1f avg %.1f p99 < %.1f max %.1f ms", l.minUs / 1e3,
+                l.sumUs / 1e3 / l.n, l.quantileUs(0.99) / 1e3, l.maxUs / 1e3);
+    else
+        fputs("-", f);
+    fprintf(f, " | timeouts %llu seq gaps %llu crc %llu err %llu\n",
+            (unsigned long long)stats.timeouts, (unsigned long long)stats.seqGaps,
+            (unsigned long long)r.crcErrors, (unsigned long long)stats.errors);
+    repBytes = r.bytes;
+    repFrames = r.frames;
+    repSamples = stats.samples;
+}
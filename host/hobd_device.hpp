@@ -0,0 +1,179 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+
+#include "hobd_log.hpp"
+#include "hobd_proto.hpp"
+#include "hobd_rx.hpp"
+#include "hobd_shm.hpp"
+#include "hobd_time.hpp"
+
+class SampleSink; // hobd_fanout.hpp
+
+// ==========================
+// One logged device
+// ==========================
+// Owns the port, the parser, the request pipeline and the output file of
+// a single firmware link. Nothing blocks: the event loop calls
+// onReadable() when the fd has data and onTimer() when deadline() passes.
+
+// a request with no answer after this is given up on
+#define REPLY_TMO_MS 1000
+// how often the log file is flushed to the OS
+#define FLUSH_MS 1000
+#define REOPEN_MS 1000
+
+// What handle() spends its time on, per stage, when DeviceConfig::prof
+// is set (hobd_replay)
+enum PipeStage
+{
+    PIPE_PARSE,  // framing and checksum, RxRing::next()
+    PIPE_DECODE, // MSG_LIVE payload and sequence check
+    PIPE_SAMPLE, // scaled into a HobdSample
+    PIPE_CSV,
+    PIPE_SHM,
+    PIPE_LOG,
+    PIPE_SINK,
+    PIPE_OTHER, // every frame that isn't MSG_LIVE
+    PIPE_STAGES
+};
+
+struct PipeProfile
+{
+    uint64_t ns[PIPE_STAGES] = {};
+    uint64_t last = 0;
+
+    void start() { last = monoNs(); }
+    // the time since the last mark goes to stage s
+    void mark(uint8_t s)
+    {
+        const uint64_t now = monoNs();
+        ns[s] += now - last;
+        last = now;
+    }
+};
+
+extern const char *const pipeStageNames[PIPE_STAGES];
+
+struct DeviceConfig
+{
+    const char *path = nullptr;
+    const char *out = nullptr; // nullptr = stdout
+    uint32_t baud = 115200;
+    uint32_t pollMs = 200;
+    uint32_t dtcS = 60;
+    bool reset = false;
+    const char *log = nullptr; // columnar log, see hobd_log.hpp
+    const char *ktrace = nullptr; // K-line trace, see hobd_ktreplay.cpp
+    bool shm = false; // publish samples in /dev/shm, see hobd_shm.hpp
+    SampleSink *sink = nullptr; // also handed every sample, may be null
+    uint8_t index = 0;          // passed to the sink with each sample
+    PipeProfile *prof = nullptr;
+};
+
+// Request to reply latency, log2 buckets for the percentiles
+struct LatencyStats
+{
+    uint64_t n = 0;
+    uint64_t sumUs = 0;
+    uint32_t minUs = UINT32_MAX;
+    uint32_t maxUs = 0;
+    uint32_t hist[32] = {};
+
+    void add(uint32_t us);
+    // upper bound of the bucket holding the q quantile
+    uint32_t quantileUs(double q) const;
+};
+
+struct DeviceStats
+{
+    uint64_t samples = 0;
+    uint64_t timeouts = 0;
+    uint64_t seqGaps = 0;
+    uint64_t errors = 0; // MSG_ERR frames
+    uint64_t reopens = 0;
+    LatencyStats live;
+};
+
+class Device
+{
+public:
+    explicit Device(const DeviceConfig &cfg);
+    ~Device();
+
+    // false if the output file could not be opened
+    bool ok() const { return out != nullptr; }
+    const char *path() const { return cfg.path; }
+
+    int fd() const { return port; }
+    bool open();
+    void close();
+
+    // read what is waiting and handle every complete frame;
+    // false once the port is gone
+    bool onReadable();
+    // bytes that did not come from the port, handled the same way
+    void feed(const uint8_t *p, size_t n);
+    void onTimer(uint64_t nowMs);
+    // monotonic ms of the next onTimer() this device needs
+    uint64_t deadline() const;
+
+    // one line of throughput / latency since the last call
+    void report(FILE *f, double dt);
+
+    RxStats &rxStats() { return rx.stats; }
+    DeviceStats stats;
+
+private:
+    // one outstanding request per command, replies may come back in a
+    // different order (telemetry and replies are separate TX classes)
+    struct Pending
+    {
+        bool busy = false;
+        uint64_t sentUs = 0;
+    };
+    enum Slot { SLOT_LIVE, SLOT_DTC, SLOT_RESET, SLOT_COUNT };
+
+    bool sendCmd(const uint8_t *cmd, size_t n);
+    bool request(Slot s, uint8_t cmd);
+    bool request(Slot s, const uint8_t *cmd, size_t n);
+    uint32_t complete(Slot s);
+    void drain();
+    void handle(const RxFrame &f);
+    void mark(uint8_t stage)
+    {
+        if (cfg.prof)
+            cfg.prof->mark(stage);
+    }
+    void onKtrace(const RxFrame &f);
+
+    DeviceConfig cfg;
+    FILE *out = nullptr;
+    int port = -1;
+    RxRing rx;
+    RxFrame frame;
+    Pending pending[SLOT_COUNT];
+    ShmWriter shm;
+    LogWriter log;
+    FILE *kt = nullptr;
+
+    uint64_t nextLive = 0;
+    uint64_t nextDtc = 0;
+    uint64_t nextFlush = 0;
+    uint64_t nextOpen = 0;
+
+    uint16_t lastSeq = 0;
+    bool haveSeq = false;
+
+    // trace times: device micros() unwrapped, each connection continuing
+    // a second after the last one
+    bool ktRebase = true;
+    uint32_t ktPrev = 0;
+    int64_t ktOff = 0;
+    int64_t ktLast = -1000000;
+
+    // counters at the last report()
+    uint64_t repBytes = 0;
+    uint64_t repFrames = 0;
+    uint64_t repSamples = 0;
+};
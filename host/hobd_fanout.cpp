@@ -0,0 +1,357 @@
+#include "hobd_fanout.hpp"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static const char USAGE[] = "err usage: sub [json|bin] [hz=<rate>] [dev=<name>]\n";
+
+FanoutServer::FanoutServer() {}
+
+FanoutServer::~FanoutServer()
+{
+    for (auto &c : clients)
+    {
+        if (c->fd >= 0)
+            ::close(c->fd);
+    }
+    if (lfd >= 0)
+        ::close(lfd);
+    if (ep >= 0)
+        ::close(ep);
+}
+
+bool FanoutServer::listen(uint16_t port)
+{
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (ep < 0 || lfd < 0)
+        return false;
+    const int one = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    // loopback only, there is no authentication
+    sockaddr_in sa = {};
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(lfd, (sockaddr *)&sa, sizeof(sa)) < 0 || ::listen(lfd, 8) < 0)
+        return false;
+
+    epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr; // the listener, clients carry their Client *
+    return epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev) == 0;
+}
+
+size_t FanoutServer::clientCount() const
+{
+    size_t n = 0;
+    for (auto &c : clients)
+        n += c->fd >= 0;
+    return n;
+}
+
+void FanoutServer::poll()
+{
+    epoll_event evs[16];
+    const int n = epoll_wait(ep, evs, 16, 0);
+    for (int i = 0; i < n; ++i)
+    {
+        if (!evs[i].data.ptr)
+        {
+            accept();
+            continue;
+        }
+        Client &c = *static_cast<Client *>(evs[i].data.ptr);
+        if (c.fd >= 0)
+            onClient(c, evs[i].events);
+    }
+    // dropped clients are only freed here, events of this round may
+    // still point at them
+    clients.erase(std::remove_if(clients.begin(), clients.end(),
+                                 [](const std::unique_ptr<Client> &c) { return c->fd < 0; }),
+                  clients.end());
+}
+
+void FanoutServer::accept()
+{
+    for (;;)
+    {
+        const int fd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        if (clientCount() >= FANOUT_MAX_CLIENTS)
+        {
+            ::close(fd);
+            continue;
+        }
+        const int sndbuf = FANOUT_SNDBUF;
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+        clients.emplace_back(new Client);
+        Client &c = *clients.back();
+        c.fd = fd;
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = &c;
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0)
+            drop(c);
+    }
+}
+
+void FanoutServer::drop(Client &c)
+{
+    if (c.fd < 0)
+        return;
+    epoll_ctl(ep, EPOLL_CTL_DEL, c.fd, nullptr);
+    ::close(c.fd);
+    c.fd = -1;
+}
+
+void FanoutServer::rearm(Client &c)
+{
+    epoll_event ev = {};
+    ev.events = (c.eof ? 0 : (uint32_t)EPOLLIN) | (c.wantOut ? (uint32_t)EPOLLOUT : 0u);
+    ev.data.ptr = &c;
+    epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev);
+}
+
+void FanoutServer::setWantOut(Client &c, bool on)
+{
+    if (c.wantOut == on)
+        return;
+    c.wantOut = on;
+    rearm(c);
+}
+
+void FanoutServer::onClient(Client &c, uint32_t events)
+{
+    if (events & EPOLLIN)
+    {
+        char buf[256];
+        const ssize_t n = read(c.fd, buf, sizeof(buf));
+        if (n < 0 && errno != EAGAIN && errno != EINTR)
+        {
+            drop(c);
+            return;
+        }
+        if (n == 0)
+        {
+            // half closed (echo sub json | nc ...): keep sending to a
+            // subscriber, stop listening to it
+            if (!c.subscribed)
+            {
+                drop(c);
+                return;
+            }
+            c.eof = true;
+            rearm(c);
+        }
+        for (ssize_t i = 0; i < n; ++i)
+        {
+            if (buf[i] == '\r')
+                continue;
+            if (buf[i] != '\n')
+            {
+                // overlong lines are cut, parseSub rejects them
+                if (c.lineLen < sizeof(c.line) - 1)
+                    c.line[c.lineLen++] = buf[i];
+                continue;
+            }
+            c.line[c.lineLen] = 0;
+            c.lineLen = 0;
+            if (!parseSub(c, c.line))
+                push(c, USAGE, sizeof(USAGE) - 1);
+        }
+    }
+    if ((events & EPOLLOUT) && !flush(c))
+        return;
+    if (events & (EPOLLERR | EPOLLHUP))
+        drop(c);
+}
+
+bool FanoutServer::parseSub(Client &c, const char *line)
+{
+    char tmp[sizeof(c.line)];
+    snprintf(tmp, sizeof(tmp), "%s", line);
+    char *save = nullptr;
+    const char *tok = strtok_r(tmp, " \t", &save);
+    if (!tok || strcmp(tok, "sub"))
+        return false;
+
+    bool binary = false;
+    int dev = -1;
+    double hz = 0;
+    while ((tok = strtok_r(nullptr, " \t", &save)))
+    {
+        if (!strcmp(tok, "json"))
+            binary = false;
+        else if (!strcmp(tok, "bin"))
+            binary = true;
+        else if (!strncmp(tok, "hz=", 3))
+        {
+            char *end;
+            hz = strtod(tok + 3, &end);
+            if (*end || hz < 0)
+                return false;
+        }
+        else if (!strncmp(tok, "dev=", 4))
+        {
+            auto it = std::find(devices.begin(), devices.end(), tok + 4);
+            if (it == devices.end())
+                return false;
+            dev = (int)(it - devices.begin());
+        }
+        else
+            return false;
+    }
+
+    c.binary = binary;
+    c.dev = dev;
+    c.minGap = hz > 0 ? 1.0 / hz : 0;
+    c.lastT.assign(devices.size(), 0);
+    c.subscribed = true;
+
+    // json clients get one line saying what they will see, binary
+    // streams start with the first sample
+    if (!binary)
+    {
+        char msg[FANOUT_MSG_MAX];
+        int n = snprintf(msg, sizeof(msg), "{\"sub\":\"json\",\"hz\":%g,\"devices\":[", hz);
+        for (size_t i = 0; i < devices.size() && n < (int)sizeof(msg); ++i)
+        {
+            if (dev < 0 || (int)i == dev)
+                n += snprintf(msg + n, sizeof(msg) - n, "%s\"%s\"",
+                              msg[n - 1] == '[' ? "" : ",", devices[i].c_str());
+        }
+        if (n < (int)sizeof(msg))
+            n += snprintf(msg + n, sizeof(msg) - n, "]}\n");
+        if (n < (int)sizeof(msg))
+            push(c, msg, n);
+    }
+    return true;
+}
+
+void FanoutServer::push(Client &c, const char *p, size_t n)
+{
+    if (c.fd < 0 || n > FANOUT_MSG_MAX)
+        return;
+    if (c.count == FANOUT_QUEUE)
+    {
+        // full: lose the oldest message. A half sent head can't be
+        // dropped without corrupting the stream, so its unsent tail takes
+        // over the next slot and that message goes instead.
+        const uint16_t next = (c.head + 1) % FANOUT_QUEUE;
+        if (c.headOff)
+        {
+            Msg &h = c.q[c.head];
+            Msg &x = c.q[next];
+            x.len = h.len - c.headOff;
+            memcpy(x.data, h.data + c.headOff, x.len);
+            c.headOff = 0;
+        }
+        c.head = next;
+        c.count--;
+        c.dropped++;
+        dropped++;
+    }
+    Msg &m = c.q[(c.head + c.count) % FANOUT_QUEUE];
+    memcpy(m.data, p, n);
+    m.len = (uint16_t)n;
+    c.count++;
+    flush(c);
+}
+
+bool FanoutServer::flush(Client &c)
+{
+    while (c.count)
+    {
+        const Msg &m = c.q[c.head];
+        const ssize_t n = send(c.fd, m.data + c.headOff, m.len - c.headOff, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                setWantOut(c, true);
+                return true;
+            }
+            if (errno == EINTR)
+                continue;
+            drop(c);
+            return false;
+        }
+        c.headOff += n;
+        if (c.headOff == m.len)
+        {
+            c.head = (c.head + 1) % FANOUT_QUEUE;
+            c.count--;
+            c.headOff = 0;
+        }
+    }
+    setWantOut(c, false);
+    return true;
+}
+
+void FanoutServer::onSample(uint8_t dev, const HobdSample &s)
+{
+    // each format is built at most once per sample, whoever wants it
+    char json[FANOUT_MSG_MAX];
+    int jsonLen = -1;
+    char bin[4 + sizeof(HobdSample)];
+    static_assert(sizeof(bin) <= FANOUT_MSG_MAX, "HobdSample outgrew FANOUT_MSG_MAX");
+    bool haveBin = false;
+
+    for (auto &cp : clients)
+    {
+        Client &c = *cp;
+        if (c.fd < 0 || !c.subscribed || (c.dev >= 0 && c.dev != dev) || dev >= c.lastT.size())
+            continue;
+        if (c.minGap > 0)
+        {
+            // a quarter period of slack, so a stream at exactly the
+            // requested rate isn't halved by jitter
+            double &due = c.lastT[dev];
+            if (s.tHost + c.minGap / 4 < due)
+                continue;
+            due += c.minGap;
+            if (due <= s.tHost)
+                due = s.tHost + c.minGap;
+        }
+
+        if (c.binary)
+        {
+            if (!haveBin)
+            {
+                const uint16_t len = 2 + sizeof(HobdSample);
+                memcpy(bin, &len, 2);
+                bin[2] = FANOUT_SAMPLE;
+                bin[3] = (char)dev;
+                memcpy(bin + 4, &s, sizeof(s));
+                haveBin = true;
+            }
+            push(c, bin, sizeof(bin));
+            continue;
+        }
+        if (jsonLen < 0)
+        {
+            jsonLen = snprintf(json, sizeof(json),
+                               "{\"dev\":\"%s\",\"t\":%.6f,\"dev_us\":%lu,\"seq\":%u,\"rpm\":%.0f,"
+                               "\"vss\":%.0f,\"ect\":%.1f,\"iat\":%.1f,\"map\":%.1f,\"tps\":%.1f,"
+                               "\"batt\":%.2f,\"o2\":%.2f,\"flags\":%u,\"maf\":%.0f}\n",
+                               devices[dev].c_str(), s.tHost, (unsigned long)s.devUs, s.seq, s.rpm,
+                               s.vss, s.ect, s.iat, s.map, s.tps, s.batt, s.o2, s.flags, s.maf);
+            if (jsonLen >= (int)sizeof(json))
+                jsonLen = 0;
+        }
+        if (jsonLen > 0)
+            push(c, json, jsonLen);
+    }
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hobd_shm.hpp" // HobdSample
+
+// ==========================
+// Local telemetry fan-out
+// ==========================
+// A TCP listener on localhost that hands live samples to any number of
+// dashboards. A client connects and sends one line:
+//
+//   sub [json|bin] [hz=<max rate>] [dev=<device name>]
+//
+// json: one object per line, {"dev":"ttyUSB0","t":...,"rpm":...}
+// bin:  [u16 len][u8 FANOUT_SAMPLE][u8 device index][HobdSample], host
+//       byte order (the socket never leaves the machine), len counts what
+//       follows it
+//
+// hz decimates per client and device (0 = every sample). Every client has
+// its own bounded queue; when a client is slower than the samples come,
+// its oldest queued messages are dropped, and nobody else waits for it.
+#define FANOUT_DEFAULT_PORT 5555
+#define FANOUT_QUEUE 128  // messages per client
+#define FANOUT_MSG_MAX 256
+#define FANOUT_MAX_CLIENTS 32
+// kernel send buffer per client; kept small so a stalled client backs
+// up into its queue (and drops) instead of megabytes of stale samples
+#define FANOUT_SNDBUF 16384
+#define FANOUT_SAMPLE 1
+
+// Where devices hand their decoded samples
+class SampleSink
+{
+public:
+    virtual ~SampleSink() {}
+    virtual void onSample(uint8_t dev, const HobdSample &s) = 0;
+};
+
+class FanoutServer : public SampleSink
+{
+public:
+    FanoutServer();
+    ~FanoutServer();
+
+    // Listen on 127.0.0.1:port
+    bool listen(uint16_t port);
+    // Names clients filter on with dev=, index = device index
+    void setDevices(const std::vector<std::string> &names) { devices = names; }
+
+    // An epoll fd covering the listener and all clients; hand it to the
+    // outer event loop and call poll() when it is readable
+    int fd() const { return ep; }
+    void poll();
+
+    void onSample(uint8_t dev, const HobdSample &s) override;
+
+    size_t clientCount() const;
+    uint64_t dropped = 0; // messages dropped over all clients
+
+private:
+    struct Msg
+    {
+        uint16_t len;
+        char data[FANOUT_MSG_MAX];
+    };
+
+    struct Client
+    {
+        int fd = -1;
+        bool subscribed = false;
+        bool binary = false;
+        int dev = -1;        // -1 = all devices
+        double minGap = 0;   // seconds between samples, 1 / hz
+        std::vector<double> lastT; // per device
+        char line[128];
+        size_t lineLen = 0;
+        // drop oldest ring of whole messages; head may be half sent
+        Msg q[FANOUT_QUEUE];
+        uint16_t head = 0;
+        uint16_t count = 0;
+        uint16_t headOff = 0;
+        bool wantOut = false;
+        bool eof = false; // client closed its side, nothing more to read
+        uint64_t dropped = 0;
+    };
+
+    void accept();
+    void onClient(Client &c, uint32_t events);
+    bool parseSub(Client &c, const char *line);
+    void push(Client &c, const char *p, size_t n);
+    bool flush(Client &c);
+    void setWantOut(Client &c, bool on);
+    void rearm(Client &c);
+    void drop(Client &c);
+
+    int ep = -1;
+    int lfd = -1;
+    std::vector<std::string> devices;
+    std::vector<std::unique_ptr<Client>> clients;
+};
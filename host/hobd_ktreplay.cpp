@@ -0,0 +1,539 @@
+// hobd_ktreplay: run the firmware's ECU code against a recorded K-line trace.
+//
+//   hobd_ktreplay [-x speed] [-n rounds] [-v] trace.csv
+//     -x  1 = original timing, 10 = ten times faster, 0 = as fast as
+//         possible (0)
+//     -n  replay this many times and check every round ends the same (1)
+//     -v  one line per call: trace time, call, result, decoded values
+//
+// The trace is what hobd_logd -k records from an env:uno_ktrace firmware.
+// ../src/hobd_uni2.cpp is built in unchanged and driven through the calls
+// the trace shows: init(), readLiveData() with the rows that were read,
+// scanDtc(), resetEcu(), anything else through sendcmd(). It runs on a
+// virtual clock: each byte the ECU sent becomes available as long after
+// the write before it as it did on the car, and time only moves while the
+// code waits. Timeouts, short replies and checksum errors so fail the
+// same way on every run and at every speed. Bytes the code writes are
+// compared with the trace; a difference is a divergence (exit status 1).
+
+#include "hobd_proto.hpp"
+#include "hobd_time.hpp"
+#include "hobd_uni2.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+// row reads closer than this are one readLiveData() (it delay(1)s)
+#define LIVE_ROW_GAP_US 20000
+// how far millis() moves per poll once the trace has nothing left to read
+#define IDLE_STEP_US 1000
+
+// CHAN_SCHEMA order
+static const char *const chanNames[CH_COUNT] = {
+    "rpm", "vss", "flags", "ect", "iat", "map", "baro", "tps", "o2", "volt",
+    "altf", "eld", "sft", "lft", "inj", "ign", "lmt", "iacv", "knoc", "maf"};
+
+static const ChanMask rowChans[HOBD_ROWS] = {
+    HOBD_ROW0_CHANS, HOBD_ROW1_CHANS, HOBD_ROW2_CHANS, HOBD_ROW3_CHANS};
+
+struct TraceByte
+{
+    int64_t t; // µs
+    uint8_t dir; // KtraceDir
+    uint8_t b;
+};
+
+static bool loadTrace(const char *path, std::vector<TraceByte> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[128];
+    while (fgets(line, sizeof(line), f))
+    {
+        long long t;
+        char dir;
+        unsigned b;
+        if (line[0] == '#' || sscanf(line, "%lld,%c,%x", &t, &dir, &b) != 3)
+            continue;
+        const uint8_t d = dir == 'T' ? KT_TX : dir == 'R' ? KT_RX : KT_LOST;
+        out.push_back(TraceByte{t, d, (uint8_t)b});
+    }
+    fclose(f);
+    return true;
+}
+
+// ==========================
+// Virtual clock
+// ==========================
+// What millis() / micros() / delay() run on. With a speed it also keeps
+// pace with the wall clock, speed times faster.
+
+class VClock
+{
+public:
+    void start(double speed)
+    {
+        now = 0;
+        rate = speed;
+        wall0 = monoUs();
+    }
+    void advanceTo(int64_t t)
+    {
+        if (t <= now)
+            return;
+        now = t;
+        if (rate > 0)
+        {
+            const uint64_t due = wall0 + (uint64_t)(now / rate);
+            const uint64_t w = monoUs();
+            if (due > w)
+            {
+                const timespec ts = {(time_t)((due - w) / 1000000), (long)((due - w) % 1000000) * 1000};
+                nanosleep(&ts, nullptr);
+            }
+        }
+    }
+
+    int64_t now = 0;
+
+private:
+    double rate = 0;
+    uint64_t wall0 = 0;
+};
+
+static VClock vclock;
+
+unsigned long millis() { return (unsigned long)(vclock.now / 1000); }
+unsigned long micros() { return (unsigned long)vclock.now; }
+void delay(unsigned long ms) { vclock.advanceTo(vclock.now + (int64_t)ms * 1000); }
+
+// ==========================
+// TracePort
+// ==========================
+// The K-line as recorded. seek() hands it the bytes of one call; offset
+// maps trace time to virtual time and is pinned at every byte written.
+
+class TracePort : public SoftwareSerialWithHalfDuplex
+{
+public:
+    explicit TracePort(const std::vector<TraceByte> &tr)
+        : SoftwareSerialWithHalfDuplex(0, 0), tr(tr), offset(tr.empty() ? 0 : tr[0].t)
+    {
+    }
+
+    void seek(size_t first, size_t last)
+    {
+        pos = first;
+        end = last;
+        lastTx = SIZE_MAX;
+        lost = false;
+    }
+    // virtual time the trace reaches t
+    int64_t at(int64_t t) const { return t - offset; }
+    // what the code left unread of the call, counted
+    void finish()
+    {
+        for (; pos < end; ++pos)
+            rxUnread += tr[pos].dir == KT_RX;
+    }
+
+    size_t write(uint8_t b) override
+    {
+        skipRx();
+        if (pos >= end || tr[pos].dir != KT_TX)
+        {
+            txDiff++;
+            return 1;
+        }
+        txDiff += tr[pos].b != b;
+        // the firmware's write blocks for as long as the byte takes
+        if (lastTx != SIZE_MAX && lastTx + 1 == pos)
+            vclock.advanceTo(vclock.now + tr[pos].t - tr[lastTx].t);
+        offset = tr[pos].t - vclock.now;
+        lastTx = pos++;
+        return 1;
+    }
+
+    int available() override
+    {
+        skipLost();
+        if (pos < end && tr[pos].dir == KT_RX)
+        {
+            const int64_t due = at(tr[pos].t);
+            if (due <= vclock.now)
+                return 1;
+            // nothing to do until then; the caller looks at its timeout
+            // before it asks again
+            vclock.advanceTo(due);
+            return 0;
+        }
+        // the ECU said nothing more, let the timeout run out
+        vclock.advanceTo(vclock.now + IDLE_STEP_US);
+        return 0;
+    }
+
+    int read() override
+    {
+        skipLost();
+        if (pos >= end || tr[pos].dir != KT_RX || at(tr[pos].t) > vclock.now)
+            return -1;
+        return tr[pos++].b;
+    }
+
+    bool lost = false; // the call crossed a KT_LOST gap
+    uint64_t txDiff = 0;
+    uint64_t rxUnread = 0;
+
+private:
+    void skipLost()
+    {
+        for (; pos < end && tr[pos].dir == KT_LOST; ++pos)
+            lost = true;
+    }
+    // RX bytes still queued when the code writes again were never read
+    void skipRx()
+    {
+        for (; pos < end && tr[pos].dir != KT_TX; ++pos)
+        {
+            rxUnread += tr[pos].dir == KT_RX;
+            lost = lost || tr[pos].dir == KT_LOST;
+        }
+    }
+
+    const std::vector<TraceByte> &tr;
+    size_t pos = 0, end = 0;
+    size_t lastTx = SIZE_MAX;
+    int64_t offset; // the trace starts at virtual 0
+};
+
+// ==========================
+// Calls
+// ==========================
+// The trace cut into the ECUData calls that made it. A call starts at its
+// first written byte and runs up to the next call's.
+
+enum CallKind
+{
+    CALL_INIT,
+    CALL_LIVE,
+    CALL_DTC,
+    CALL_RESET,
+    CALL_CMD,
+    CALL_KINDS
+};
+
+static const char *const callNames[CALL_KINDS] = {"init", "live", "dtc", "reset", "sendcmd"};
+
+struct Call
+{
+    CallKind kind;
+    size_t first, end;
+    ChanMask mask; // CALL_LIVE
+    uint8_t lastRow;
+    EcuCmd cmd; // CALL_CMD
+};
+
+static bool isStartup(const std::vector<TraceByte> &tr, size_t i)
+{
+    if (i + STARTUP_LEN > tr.size())
+        return false;
+    for (uint8_t k = 0; k < STARTUP_LEN; ++k)
+    {
+        if (tr[i + k].dir != KT_TX || tr[i + k].b != startup[k])
+            return false;
+    }
+    return true;
+}
+
+static bool isCmd(const std::vector<TraceByte> &tr, size_t i, EcuCmd &c)
+{
+    uint8_t tx[5];
+    for (uint8_t k = 0; k < 5; ++k)
+    {
+        if (i + k >= tr.size() || tr[i + k].dir != KT_TX)
+            return false;
+        tx[k] = tr[i + k].b;
+    }
+    if (ECUData::mkcrc(tx, 4) != tx[4])
+        return false;
+    c = EcuCmd{tx[0], tx[1], tx[2], tx[3], tx[4]};
+    return true;
+}
+
+// calls, and the written bytes that fitted none
+static std::vector<Call> splitCalls(const std::vector<TraceByte> &tr, uint64_t &junk)
+{
+    std::vector<Call> calls;
+    size_t i = 0;
+    while (i < tr.size())
+    {
+        if (tr[i].dir != KT_TX)
+        {
+            ++i;
+            continue;
+        }
+        Call c = {};
+        c.first = i;
+        if (isStartup(tr, i))
+        {
+            c.kind = CALL_INIT;
+            i += STARTUP_LEN;
+        }
+        else if (isCmd(tr, i, c.cmd))
+        {
+            const EcuCmd &e = c.cmd;
+            const uint8_t row = e.reg / HOBD_ROW_LEN;
+            if (e.cmd == HOBD_RST)
+                c.kind = CALL_RESET;
+            else if (e.cmd == HOBD_CMD && e.reg == HOBD_OFF_ERRORS1 && e.rxlen == 0x10)
+                c.kind = CALL_DTC;
+            else if (e.cmd == HOBD_CMD && e.rxlen == HOBD_ROW_LEN && e.reg % HOBD_ROW_LEN == 0 &&
+                     row < HOBD_ROWS)
+            {
+                c.kind = CALL_LIVE;
+                c.mask = rowChans[row];
+                c.lastRow = row;
+            }
+            else
+                c.kind = CALL_CMD;
+            i += 5;
+        }
+        else
+        {
+            junk++;
+            ++i;
+            continue;
+        }
+        while (i < tr.size() && tr[i].dir != KT_TX)
+            ++i;
+        c.end = i;
+
+        // the rows of one readLiveData() follow each other closely
+        Call *prev = calls.empty() ? nullptr : &calls.back();
+        if (c.kind == CALL_LIVE && prev && prev->kind == CALL_LIVE && c.lastRow > prev->lastRow &&
+            tr[c.first].t - tr[prev->end - 1].t < LIVE_ROW_GAP_US)
+        {
+            prev->mask |= c.mask;
+            prev->lastRow = c.lastRow;
+            prev->end = c.end;
+            continue;
+        }
+        calls.push_back(c);
+    }
+    // MAF comes free with the rows it is derived from
+    for (Call &c : calls)
+    {
+        if (c.kind == CALL_LIVE && (c.mask & HOBD_MAF_DEPS) == HOBD_MAF_DEPS)
+            c.mask |= CH_BIT(CH_MAF);
+    }
+    return calls;
+}
+
+// ==========================
+// Replay
+// ==========================
+
+enum Result
+{
+    RES_OK,
+    RES_TIMEOUT,
+    RES_CHECKSUM,
+    RES_COUNT
+};
+
+static const char *const resultNames[RES_COUNT] = {"ok", "timeout", "checksum"};
+
+struct Round
+{
+    uint64_t calls[CALL_KINDS][RES_COUNT] = {};
+    uint64_t lostCalls = 0;
+    uint64_t txDiff = 0, rxUnread = 0;
+    uint64_t decodes = 0, decodeNs = 0;
+    uint64_t wallUs = 0;
+    uint32_t hash = 2166136261UL; // FNV-1a of every result and value
+};
+
+static void mix(uint32_t &h, const void *p, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+        h = (h ^ ((const uint8_t *)p)[i]) * 16777619UL;
+}
+
+static Round replay(const std::vector<TraceByte> &tr, const std::vector<Call> &calls,
+                    double speed, bool verbose)
+{
+    Round r;
+    TracePort port(tr);
+    ECUData ecu(1, port);
+    ecu.subMask = 0;
+
+    const uint64_t w0 = monoUs();
+    vclock.start(speed);
+    for (const Call &c : calls)
+    {
+        port.seek(c.first, c.end);
+        // idle until the call started on the car
+        vclock.advanceTo(port.at(tr[c.first].t));
+
+        const uint16_t tmo = ecu.dlctmo;
+        bool ok = false;
+        switch (c.kind)
+        {
+        case CALL_INIT: ok = ecu.init(); break;
+        case CALL_LIVE:
+            ecu.subMask = c.mask;
+            ok = ecu.readLiveData();
+            break;
+        case CALL_DTC: ok = ecu.scanDtc(); break;
+        case CALL_RESET: ok = ecu.resetEcu(); break;
+        case CALL_CMD:
+        {
+            EcuCmd cmd = c.cmd;
+            ok = ecu.sendcmd(cmd);
+            break;
+        }
+        default: break;
+        }
+        port.finish();
+        const Result res = ok ? RES_OK : ecu.dlctmo != tmo ? RES_TIMEOUT : RES_CHECKSUM;
+        r.calls[c.kind][res]++;
+        r.lostCalls += port.lost;
+        mix(r.hash, &res, sizeof(res));
+
+        if (ok && c.kind == CALL_LIVE)
+        {
+            // the conversions alone, again, for timing
+            const uint64_t t0 = monoNs();
+            ecu.decoded = 0;
+            ecu.decode(c.mask);
+            r.decodeNs += monoNs() - t0;
+            r.decodes++;
+        }
+
+        if (verbose)
+            printf("%.6f,%s,%s%s", tr[c.first].t / 1e6, callNames[c.kind], resultNames[res],
+                   port.lost ? ",lost" : "");
+        if (ok && c.kind == CALL_LIVE)
+        {
+            for (uint8_t ch = 0; ch < CH_COUNT; ++ch)
+            {
+                if (!(c.mask & CH_BIT(ch)))
+                    continue;
+                const float v = ecu.value(ch);
+                mix(r.hash, &v, sizeof(v));
+                if (verbose)
+                    printf(",%s=%g", chanNames[ch], v);
+            }
+        }
+        else if (ok && c.kind == CALL_DTC)
+        {
+            mix(r.hash, ecu.dtcErrs, ecu.dtcLen);
+            if (verbose)
+            {
+                printf(",codes=");
+                for (size_t i = 0; i < ecu.dtcLen; ++i)
+                    printf("%s%u", i ? " " : "", ecu.dtcErrs[i]);
+            }
+        }
+        if (verbose)
+            putchar('\n');
+    }
+    r.txDiff = port.txDiff;
+    r.rxUnread = port.rxUnread;
+    r.wallUs = monoUs() - w0;
+    return r;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-x speed] [-n rounds] [-v] trace.csv\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+    double speed = 0;
+    unsigned rounds = 1;
+    bool verbose = false;
+    int c;
+    while ((c = getopt(argc, argv, "x:n:vh")) != -1)
+    {
+        switch (c)
+        {
+        case 'x': speed = strtod(optarg, nullptr); break;
+        case 'n': rounds = strtoul(optarg, nullptr, 0); break;
+        case 'v': verbose = true; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1 || !rounds)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    std::vector<TraceByte> tr;
+    if (!loadTrace(argv[optind], tr))
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (tr.empty())
+    {
+        fprintf(stderr, "%s: no trace lines\n", argv[optind]);
+        return 1;
+    }
+    uint64_t junk = 0;
+    const std::vector<Call> calls = splitCalls(tr, junk);
+    uint64_t dirs[3] = {};
+    for (const TraceByte &b : tr)
+        dirs[b.dir]++;
+    const double span = (tr.back().t - tr.front().t) / 1e6;
+
+    Round first;
+    uint64_t wallUs = 0, decodes = 0, decodeNs = 0;
+    bool same = true;
+    for (unsigned i = 0; i < rounds; ++i)
+    {
+        const Round r = replay(tr, calls, speed, verbose && i == 0);
+        if (!i)
+            first = r;
+        same = same && r.hash == first.hash;
+        wallUs += r.wallUs;
+        decodes += r.decodes;
+        decodeNs += r.decodeNs;
+    }
+
+    FILE *f = verbose ? stderr : stdout;
+    fprintf(f, "trace: %zu bytes (%llu tx, %llu rx, %llu lost markers), %.3f s, %zu calls",
+            tr.size(), (unsigned long long)dirs[KT_TX], (unsigned long long)dirs[KT_RX],
+            (unsigned long long)dirs[KT_LOST], span, calls.size());
+    if (junk)
+        fprintf(f, ", %llu tx bytes outside any call", (unsigned long long)junk);
+    fputc('\n', f);
+    for (int k = 0; k < CALL_KINDS; ++k)
+    {
+        const uint64_t *n = first.calls[k];
+        if (n[RES_OK] + n[RES_TIMEOUT] + n[RES_CHECKSUM])
+            fprintf(f, "  %-8s %6llu ok %6llu timeout %6llu checksum\n", callNames[k],
+                    (unsigned long long)n[RES_OK], (unsigned long long)n[RES_TIMEOUT],
+                    (unsigned long long)n[RES_CHECKSUM]);
+    }
+    if (first.lostCalls)
+        fprintf(f, "  %llu calls cross a gap in the trace, their results mean little\n",
+                (unsigned long long)first.lostCalls);
+    fprintf(f, "divergence: %llu written bytes differ from the trace, %llu received bytes unread\n",
+            (unsigned long long)first.txDiff, (unsigned long long)first.rxUnread);
+    if (decodes)
+        fprintf(f, "decode: %.3f us per readLiveData() (%llu)\n", decodeNs / 1e3 / decodes,
+                (unsigned long long)decodes);
+    fprintf(f, "replay: %u x %.3f s of trace in %.6f s (%.0fx)%s\n", rounds, span, wallUs / 1e6,
+            wallUs ? rounds * span * 1e6 / wallUs : 0.0,
+            same ? "" : ", ROUNDS DIFFER");
+    return first.txDiff || !same ? 1 : 0;
+}
@@ -0,0 +1,346 @@
+#include "hobd_log.hpp"
+#include "hobd_crc.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "log files are little endian");
+static_assert(sizeof(LogFileHeader) <= LOG_BLOCK_BYTES, "file header outgrew its slot");
+
+const char *const logSampleChannels[LOG_SAMPLE_CHANNELS] = {
+    "rpm", "vss", "ect", "iat", "map", "tps", "batt", "o2", "maf", "flags", "seq",
+};
+
+static const size_t PAYLOAD_MAX = LOG_BLOCK_BYTES - sizeof(LogBlockHeader);
+
+static uint16_t headerCrc(LogFileHeader h)
+{
+    h.crc = 0;
+    return crc16(reinterpret_cast<const uint8_t *>(&h), sizeof(h));
+}
+
+// header with crc = 0, then the payload
+static uint16_t blockCrc(LogBlockHeader b, const uint8_t *payload)
+{
+    b.crc = 0;
+    const uint16_t c = crc16(reinterpret_cast<const uint8_t *>(&b), sizeof(b));
+    return crc16_update(c, payload, b.bytes);
+}
+
+static uint16_t indexCrc(const std::vector<LogIndexEntry> &index)
+{
+    uint16_t crc = HOBD_CRC16_INIT;
+    for (const LogIndexEntry &e : index)
+        crc = crc16_update(crc, reinterpret_cast<const uint8_t *>(&e), sizeof(e));
+    return crc;
+}
+
+// ==========================
+// LogWriter
+// ==========================
+
+bool LogWriter::open(const char *path, const char *device, const char *const *names,
+                     uint16_t channels)
+{
+    close();
+    if (!channels || channels > LOG_MAX_CHANNELS)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    cols.assign(channels, Column());
+    index.clear();
+    nextSlot = 1;
+    lastSync = 0;
+
+    struct stat st;
+    if (stat(path, &st) == 0 && st.st_size > 0)
+        return resume(path, channels, names);
+
+    f = fopen(path, "wb");
+    if (!f)
+        return false;
+    setvbuf(f, nullptr, _IOFBF, LOG_STDIO_BUF);
+
+    uint8_t slot[LOG_BLOCK_BYTES] = {};
+    LogFileHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = LOG_MAGIC;
+    h.version = LOG_VERSION;
+    h.channels = channels;
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    h.createdUs = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    snprintf(h.device, sizeof(h.device), "%s", device);
+    for (uint16_t i = 0; i < channels; ++i)
+        snprintf(h.names[i], sizeof(h.names[i]), "%s", names[i]);
+    h.blockBytes = LOG_BLOCK_BYTES;
+    h.crc = headerCrc(h);
+    memcpy(slot, &h, sizeof(h));
+    fwrite(slot, sizeof(slot), 1, f);
+    return true;
+}
+
+bool LogWriter::resume(const char *path, uint16_t channels, const char *const *names)
+{
+    // only our own kind of file with the same columns is carried on
+    LogReader rd;
+    bool same = rd.open(path) && rd.channels() == channels;
+    for (uint16_t i = 0; same && i < channels; ++i)
+        same = !strncmp(rd.header().names[i], names[i], sizeof(rd.header().names[i]));
+    if (!same)
+    {
+        errno = EEXIST;
+        return false;
+    }
+
+    // the good blocks stay; the old index and footer, or a torn tail, are
+    // cut off and the next block goes right behind the last good one
+    index = rd.index();
+    nextSlot = 1;
+    for (const LogIndexEntry &e : index)
+        nextSlot = std::max(nextSlot, (uint32_t)(e.offset / LOG_BLOCK_BYTES + 1));
+    rd.close();
+
+    if (truncate(path, (off_t)nextSlot * LOG_BLOCK_BYTES) < 0)
+        return false;
+    f = fopen(path, "r+b");
+    if (!f)
+        return false;
+    setvbuf(f, nullptr, _IOFBF, LOG_STDIO_BUF);
+    if (fseeko(f, (off_t)nextSlot * LOG_BLOCK_BYTES, SEEK_SET) < 0)
+    {
+        fclose(f);
+        f = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void LogWriter::append(uint16_t ch, int64_t tUs, float v)
+{
+    if (!f || ch >= cols.size())
+        return;
+    Column &c = cols[ch];
+    if (c.active && (tUs - c.packer.t0() > LOG_BLOCK_MAX_AGE_US || !c.packer.add(tUs, v)))
+        seal(ch);
+    if (!c.active)
+    {
+        c.packer.begin(c.buf + sizeof(LogBlockHeader), PAYLOAD_MAX, tUs, v);
+        c.active = true;
+        c.min = c.max = v;
+    }
+    c.t1 = tUs;
+    c.min = v < c.min ? v : c.min;
+    c.max = v > c.max ? v : c.max;
+}
+
+void LogWriter::append(const HobdSample &s)
+{
+    const int64_t t = (int64_t)(s.tHost * 1e6 + 0.5);
+    const float v[LOG_SAMPLE_CHANNELS] = {s.rpm, s.vss, s.ect, s.iat, s.map, s.tps,
+                                          s.batt, s.o2, s.maf, (float)s.flags, (float)s.seq};
+    for (uint16_t ch = 0; ch < LOG_SAMPLE_CHANNELS; ++ch)
+        append(ch, t, v[ch]);
+}
+
+void LogWriter::seal(uint16_t ch)
+{
+    Column &c = cols[ch];
+    if (!c.active)
+        return;
+    c.active = false;
+
+    LogBlockHeader b;
+    memset(&b, 0, sizeof(b));
+    b.magic = LOG_BLOCK_MAGIC;
+    b.channel = ch;
+    b.encoding = LOG_ENC_STREAM;
+    b.count = c.packer.count();
+    b.bytes = c.packer.bytes();
+    b.t0 = c.packer.t0();
+    b.t1 = c.t1;
+    b.min = c.min;
+    b.max = c.max;
+    b.slot = nextSlot;
+    uint8_t *payload = c.buf + sizeof(b);
+    memset(payload + b.bytes, 0, PAYLOAD_MAX - b.bytes);
+    b.crc = blockCrc(b, payload);
+    memcpy(c.buf, &b, sizeof(b));
+
+    fwrite(c.buf, LOG_BLOCK_BYTES, 1, f);
+    index.push_back(LogIndexEntry{b.t0, b.t1, (uint64_t)nextSlot * LOG_BLOCK_BYTES, ch,
+                                  b.encoding, b.count, b.min, b.max});
+    nextSlot++;
+    blocksWritten++;
+}
+
+void LogWriter::flush(uint64_t nowMs)
+{
+    if (!f)
+        return;
+    fflush(f);
+    if (nowMs - lastSync >= LOG_SYNC_MS)
+    {
+        fdatasync(fileno(f));
+        lastSync = nowMs;
+    }
+}
+
+void LogWriter::close()
+{
+    if (!f)
+        return;
+    for (uint16_t ch = 0; ch < cols.size(); ++ch)
+        seal(ch);
+
+    LogFooter ft;
+    memset(&ft, 0, sizeof(ft));
+    ft.indexOffset = (uint64_t)nextSlot * LOG_BLOCK_BYTES;
+    ft.entries = (uint32_t)index.size();
+    ft.crc = indexCrc(index);
+    ft.magic = LOG_FOOTER_MAGIC;
+    if (!index.empty())
+        fwrite(index.data(), sizeof(LogIndexEntry), index.size(), f);
+    fwrite(&ft, sizeof(ft), 1, f);
+    fflush(f);
+    fdatasync(fileno(f));
+    fclose(f);
+    f = nullptr;
+    cols.clear();
+    index.clear();
+}
+
+// ==========================
+// LogReader
+// ==========================
+
+bool LogReader::open(const char *path)
+{
+    close();
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= LOG_BLOCK_BYTES)
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+    base = static_cast<const uint8_t *>(p);
+    len = st.st_size;
+
+    hdr = reinterpret_cast<const LogFileHeader *>(base);
+    if (hdr->magic != LOG_MAGIC || hdr->version != LOG_VERSION || !hdr->channels ||
+        hdr->channels > LOG_MAX_CHANNELS || hdr->blockBytes != LOG_BLOCK_BYTES ||
+        hdr->crc != headerCrc(*hdr))
+    {
+        close();
+        return false;
+    }
+
+    // the footer is trusted only as a whole: in the right place, its CRC
+    // matching, every entry pointing at a slot before the index
+    LogFooter ft;
+    memset(&ft, 0, sizeof(ft));
+    if (len >= LOG_BLOCK_BYTES + sizeof(ft))
+        memcpy(&ft, base + len - sizeof(ft), sizeof(ft));
+    hasFooter = ft.magic == LOG_FOOTER_MAGIC && ft.indexOffset % LOG_BLOCK_BYTES == 0 &&
+                ft.indexOffset >= LOG_BLOCK_BYTES &&
+                ft.indexOffset + (uint64_t)ft.entries * sizeof(LogIndexEntry) + sizeof(ft) == len;
+    if (hasFooter)
+    {
+        all.resize(ft.entries);
+        if (ft.entries)
+            memcpy(all.data(), base + ft.indexOffset, ft.entries * sizeof(LogIndexEntry));
+        for (const LogIndexEntry &e : all)
+            hasFooter = hasFooter && e.channel < hdr->channels && e.offset % LOG_BLOCK_BYTES == 0 &&
+                        e.offset >= LOG_BLOCK_BYTES && e.offset < ft.indexOffset &&
+                        e.count <= LOG_MAX_BLOCK_SAMPLES;
+        hasFooter = hasFooter && indexCrc(all) == ft.crc;
+    }
+    if (!hasFooter)
+        scan();
+
+    byChannel.assign(hdr->channels, std::vector<LogIndexEntry>());
+    for (const LogIndexEntry &e : all)
+        byChannel[e.channel].push_back(e);
+    return true;
+}
+
+bool LogReader::blockOk(uint64_t off, LogBlockHeader &b) const
+{
+    if (off + LOG_BLOCK_BYTES > len)
+        return false;
+    memcpy(&b, base + off, sizeof(b));
+    return b.magic == LOG_BLOCK_MAGIC && b.channel < hdr->channels &&
+           b.encoding == LOG_ENC_STREAM && b.count && b.count <= LOG_MAX_BLOCK_SAMPLES &&
+           b.bytes <= PAYLOAD_MAX && (uint64_t)b.slot * LOG_BLOCK_BYTES == off &&
+           b.crc == blockCrc(b, base + off + sizeof(b));
+}
+
+void LogReader::scan()
+{
+    // every whole slot; a bad one is skipped, not the end
+    all.clear();
+    bad = 0;
+    for (uint64_t off = LOG_BLOCK_BYTES; off + LOG_BLOCK_BYTES <= len; off += LOG_BLOCK_BYTES)
+    {
+        LogBlockHeader b;
+        if (blockOk(off, b))
+            all.push_back(
+                LogIndexEntry{b.t0, b.t1, off, b.channel, b.encoding, b.count, b.min, b.max});
+        else
+            bad++;
+    }
+}
+
+void LogReader::close()
+{
+    if (base)
+        munmap(const_cast<uint8_t *>(base), len);
+    base = nullptr;
+    hdr = nullptr;
+    len = 0;
+    hasFooter = false;
+    bad = 0;
+    all.clear();
+    byChannel.clear();
+}
+
+int LogReader::channel(const char *name) const
+{
+    for (uint16_t i = 0; i < channels(); ++i)
+    {
+        if (!strncmp(hdr->names[i], name, sizeof(hdr->names[i])))
+            return i;
+    }
+    return -1;
+}
+
+size_t LogReader::seek(uint16_t ch, int64_t tUs) const
+{
+    const std::vector<LogIndexEntry> &v = byChannel[ch];
+    return std::lower_bound(v.begin(), v.end(), tUs,
+                            [](const LogIndexEntry &e, int64_t t) { return e.t1 < t; }) -
+           v.begin();
+}
+
+uint32_t LogReader::read(uint16_t ch, size_t b, int64_t *t, float *v) const
+{
+    const LogIndexEntry &e = byChannel[ch][b];
+    // a good footer says where the blocks are, not that they are intact
+    LogBlockHeader h;
+    if (!blockOk(e.offset, h) || h.channel != ch || h.count != e.count || h.t0 != e.t0 ||
+        !unpack_samples(base + e.offset + sizeof(h), h.bytes, e.t0, e.count, t, v))
+        return 0;
+    return e.count;
+}
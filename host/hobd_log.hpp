@@ -0,0 +1,195 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "hobd_pack.hpp"
+#include "hobd_shm.hpp" // HobdSample
+
+// ==========================
+// Columnar sample log
+// ==========================
+// Append only binary log, one column per channel, for long sessions the
+// CSV is too slow to scan. The file is a run of LOG_BLOCK_BYTES slots:
+//
+//   slot 0        LogFileHeader, zero padded
+//   slot 1..n     LogBlockHeader + packed samples of one channel, zero
+//                 padded, in the order they were sealed
+//   index         LogIndexEntry per block
+//   LogFooter     last bytes of the file
+//
+// A block packs as many samples of one channel as fit (hobd_pack.hpp,
+// SamplePacker) or LOG_BLOCK_MAX_AGE_US of them, whichever ends first.
+// Its header carries the time span and min / max, so a reader can skip
+// whole blocks, and a CRC-16 over header and payload.
+//
+// Crash safety: blocks are only ever written whole and never rewritten.
+// The reader bisects the footer's index when the footer checks out;
+// otherwise (the writer died) it walks the slots and keeps every block
+// whose CRC matches, so a torn block costs only itself. The writer
+// resumes such a file the same way: the good blocks stay, the torn tail
+// is cut, logging carries on behind it. Writes go through a stdio buffer
+// and reach the disk with flush(); nothing syncs per sample.
+//
+// Host byte order; these files are made and read on the same machine.
+#define LOG_MAGIC 0x4C444248        // "HBDL"
+#define LOG_BLOCK_MAGIC 0x42444248  // "HBDB"
+#define LOG_FOOTER_MAGIC 0x46444248 // "HBDF"
+#define LOG_VERSION 3 // 1, 2: variable size blocks, no CRC, not read
+#define LOG_MAX_CHANNELS 16
+#define LOG_BLOCK_BYTES 1024
+// bound on the samples of one block: 32 bits for the first, at least 2
+// for each one after it
+#define LOG_MAX_BLOCK_SAMPLES ((LOG_BLOCK_BYTES * 8 - 32) / 2 + 1)
+// a slow channel still seals a block this often, bounding what a crash
+// can lose
+#define LOG_BLOCK_MAX_AGE_US (60 * 1000000LL)
+// a flush() at least this long after the last one also fdatasync()s
+#define LOG_SYNC_MS 30000
+#define LOG_STDIO_BUF (64 * 1024)
+
+enum LogEncoding : uint16_t
+{
+    LOG_ENC_STREAM = 2, // SamplePacker, times and values interleaved
+};
+
+struct LogFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t channels;
+    int64_t createdUs; // wall clock
+    char device[64];
+    char names[LOG_MAX_CHANNELS][16];
+    uint32_t blockBytes;
+    uint16_t crc; // CRC-16 of this header with crc = 0
+    uint16_t reserved;
+};
+
+struct LogBlockHeader
+{
+    uint32_t magic;
+    uint16_t channel;
+    uint16_t encoding;
+    uint32_t count;
+    uint32_t bytes; // packed payload after this header, the rest is padding
+    int64_t t0, t1; // first and last timestamp, µs wall clock
+    float min, max;
+    uint32_t slot; // where it belongs, offset / blockBytes
+    uint16_t crc;  // CRC-16 of header (crc = 0) and payload
+    uint16_t reserved;
+};
+
+struct LogIndexEntry
+{
+    int64_t t0, t1;
+    uint64_t offset; // of the LogBlockHeader
+    uint16_t channel;
+    uint16_t encoding;
+    uint32_t count;
+    float min, max;
+};
+
+struct LogFooter
+{
+    uint64_t indexOffset;
+    uint32_t entries;
+    uint16_t crc; // CRC-16 of the index entries
+    uint16_t reserved;
+    uint32_t magic;
+    uint32_t reserved2;
+};
+
+// The HobdSample channels, in file order
+enum LogChannel
+{
+    LOG_CH_RPM, LOG_CH_VSS, LOG_CH_ECT, LOG_CH_IAT, LOG_CH_MAP, LOG_CH_TPS,
+    LOG_CH_BATT, LOG_CH_O2, LOG_CH_MAF, LOG_CH_FLAGS, LOG_CH_SEQ,
+    LOG_SAMPLE_CHANNELS
+};
+extern const char *const logSampleChannels[LOG_SAMPLE_CHANNELS];
+
+class LogWriter
+{
+public:
+    ~LogWriter() { close(); }
+
+    // Resume path if it is a log with the same channels, else create it.
+    // Fails with errno EEXIST for any other existing file. Channel names
+    // are at most 15 chars.
+    bool open(const char *path, const char *device, const char *const *names,
+              uint16_t channels);
+    // Seal the open blocks, write index and footer, sync
+    void close();
+    bool isOpen() const { return f != nullptr; }
+
+    // Timestamps should not go backwards within a channel
+    void append(uint16_t ch, int64_t tUs, float v);
+    // All LOG_SAMPLE_CHANNELS of one sample
+    void append(const HobdSample &s);
+    // Hand buffered blocks to the OS, every LOG_SYNC_MS also to the disk
+    void flush(uint64_t nowMs);
+
+    uint64_t blocksWritten = 0;
+
+private:
+    struct Column
+    {
+        bool active = false;
+        SamplePacker packer;
+        int64_t t1;
+        float min, max;
+        uint8_t buf[LOG_BLOCK_BYTES]; // header + payload of the open block
+    };
+
+    bool resume(const char *path, uint16_t channels, const char *const *names);
+    void seal(uint16_t ch);
+
+    FILE *f = nullptr;
+    uint32_t nextSlot = 1;
+    uint64_t lastSync = 0;
+    std::vector<Column> cols;
+    std::vector<LogIndexEntry> index;
+};
+
+class LogReader
+{
+public:
+    ~LogReader() { close(); }
+
+    bool open(const char *path);
+    void close();
+
+    const LogFileHeader &header() const { return *hdr; }
+    uint16_t channels() const { return hdr ? hdr->channels : 0; }
+    // -1 if there is no such channel
+    int channel(const char *name) const;
+    // false if the index had to be rebuilt from the blocks
+    bool complete() const { return hasFooter; }
+    // slots that were not good blocks while rebuilding (torn or damaged)
+    uint32_t badBlocks() const { return bad; }
+
+    // Every good block, in file order
+    const std::vector<LogIndexEntry> &index() const { return all; }
+    // Blocks of one channel, in time order
+    const std::vector<LogIndexEntry> &blocks(uint16_t ch) const { return byChannel[ch]; }
+    // First block of ch ending at or after tUs (blocks(ch).size() if none)
+    size_t seek(uint16_t ch, int64_t tUs) const;
+    // Decode block b of ch, t and v hold LOG_MAX_BLOCK_SAMPLES; returns
+    // count, 0 if the block is corrupt (its CRC is checked on every read)
+    uint32_t read(uint16_t ch, size_t b, int64_t *t, float *v) const;
+
+private:
+    bool blockOk(uint64_t off, LogBlockHeader &b) const;
+    void scan();
+
+    const uint8_t *base = nullptr;
+    size_t len = 0;
+    const LogFileHeader *hdr = nullptr;
+    bool hasFooter = false;
+    uint32_t bad = 0;
+    std::vector<LogIndexEntry> all;
+    std::vector<std::vector<LogIndexEntry>> byChannel;
+};
@@ -0,0 +1,187 @@
+// hobd_logcat: read the columnar logs hobd_logd -l writes.
+//
+//   hobd_logcat [-i] [-c channel[,channel...]] [-f from_s] [-t to_s] [-n points] file
+//     -i  print the header and a per channel block summary
+//     -c  channels to print, default all
+//     -f  start, seconds after the first sample
+//     -t  end, seconds after the first sample
+//     -n  at most this many points per channel, for plotting
+//
+// Prints t,channel,value lines; the time range is found by bisecting the
+// block index, only the blocks inside it are decoded. With -n the points
+// are an LTTB downsample (hobd_view.hpp) from the file's min / max
+// pyramid, file.hbp, made on the first -n and whenever the log changed;
+// how each channel was answered goes to stderr.
+
+#include "hobd_log.hpp"
+#include "hobd_time.hpp"
+#include "hobd_view.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [-i] [-c channel[,channel...]] [-f from_s] [-t to_s] [-n points] file\n",
+            prog);
+}
+
+static void summary(const LogReader &rd)
+{
+    const LogFileHeader &h = rd.header();
+    printf("device %s, created %.3f, %u channels, %zu blocks\n", h.device, h.createdUs / 1e6,
+           h.channels, rd.index().size());
+    if (!rd.complete())
+        printf("no index (writer did not close), rebuilt, %u bad slots skipped\n", rd.badBlocks());
+    for (uint16_t ch = 0; ch < rd.channels(); ++ch)
+    {
+        const std::vector<LogIndexEntry> &bl = rd.blocks(ch);
+        uint64_t n = 0;
+        float lo = 0, hi = 0;
+        for (size_t i = 0; i < bl.size(); ++i)
+        {
+            n += bl[i].count;
+            lo = !i || bl[i].min < lo ? bl[i].min : lo;
+            hi = !i || bl[i].max > hi ? bl[i].max : hi;
+        }
+        if (bl.empty())
+            printf("  %-6s empty\n", h.names[ch]);
+        else
+            printf("  %-6s %5zu blocks %9llu samples  %.3f..%.3f  min %g max %g\n", h.names[ch],
+                   bl.size(), (unsigned long long)n, bl.front().t0 / 1e6, bl.back().t1 / 1e6, lo,
+                   hi);
+    }
+}
+
+static int plot(const char *path, const std::vector<uint16_t> &chans, int64_t t0, int64_t t1,
+                size_t points)
+{
+    LogView view;
+    const uint64_t start = monoUs();
+    if (!view.open(path))
+    {
+        fprintf(stderr, "%s: not a hobd log\n", path);
+        return 1;
+    }
+    if (view.built())
+        fprintf(stderr, "pyramid built in %.1f ms%s\n", (monoUs() - start) / 1e3,
+                view.saved() ? "" : ", could not be saved");
+
+    std::vector<ViewPoint> out;
+    printf("t,channel,value\n");
+    for (uint16_t ch : chans)
+    {
+        ViewQuery q;
+        const uint64_t qStart = monoUs();
+        view.downsample(ch, t0, t1, points, out, &q);
+        const double ms = (monoUs() - qStart) / 1e3;
+        const char *name = view.log().header().names[ch];
+        for (const ViewPoint &p : out)
+            printf("%.6f,%s,%g\n", p.t / 1e6, name, p.v);
+        if (q.level < 0)
+            fprintf(stderr, "%s: %zu points of %llu samples, from the blocks, %.2f ms\n", name,
+                    out.size(), (unsigned long long)q.samples, ms);
+        else
+            fprintf(stderr, "%s: %zu points of %llu samples, level %d, %zu candidates, %.2f ms\n",
+                    name, out.size(), (unsigned long long)q.samples, q.level, q.candidates, ms);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    bool info = false;
+    const char *sel = nullptr;
+    double from = -1, to = -1;
+    size_t points = 0;
+    int c;
+    while ((c = getopt(argc, argv, "ic:f:t:n:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'i': info = true; break;
+        case 'c': sel = optarg; break;
+        case 'f': from = strtod(optarg, nullptr); break;
+        case 't': to = strtod(optarg, nullptr); break;
+        case 'n': points = strtoul(optarg, nullptr, 0); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    LogReader rd;
+    if (!rd.open(argv[optind]))
+    {
+        fprintf(stderr, "%s: not a hobd log\n", argv[optind]);
+        return 1;
+    }
+    if (info)
+    {
+        summary(rd);
+        return 0;
+    }
+
+    std::vector<uint16_t> chans;
+    if (sel)
+    {
+        std::vector<char> tmp(sel, sel + strlen(sel) + 1);
+        char *save = nullptr;
+        for (char *tok = strtok_r(tmp.data(), ",", &save); tok; tok = strtok_r(nullptr, ",", &save))
+        {
+            const int ch = rd.channel(tok);
+            if (ch < 0)
+            {
+                fprintf(stderr, "no channel %s\n", tok);
+                return 1;
+            }
+            chans.push_back(ch);
+        }
+    }
+    else
+    {
+        for (uint16_t ch = 0; ch < rd.channels(); ++ch)
+            chans.push_back(ch);
+    }
+
+    // -f / -t count from the first sample of any channel
+    int64_t start = INT64_MAX;
+    for (uint16_t ch = 0; ch < rd.channels(); ++ch)
+    {
+        if (!rd.blocks(ch).empty() && rd.blocks(ch).front().t0 < start)
+            start = rd.blocks(ch).front().t0;
+    }
+    const int64_t t0 = from >= 0 ? start + (int64_t)(from * 1e6) : INT64_MIN;
+    const int64_t t1 = to >= 0 ? start + (int64_t)(to * 1e6) : INT64_MAX;
+
+    if (points)
+        return plot(argv[optind], chans, t0, t1, points);
+
+    static int64_t t[LOG_MAX_BLOCK_SAMPLES];
+    static float v[LOG_MAX_BLOCK_SAMPLES];
+    printf("t,channel,value\n");
+    for (uint16_t ch : chans)
+    {
+        const std::vector<LogIndexEntry> &bl = rd.blocks(ch);
+        for (size_t b = rd.seek(ch, t0); b < bl.size() && bl[b].t0 <= t1; ++b)
+        {
+            const uint32_t n = rd.read(ch, b, t, v);
+            if (!n)
+                fprintf(stderr, "%s: block at %llu is damaged, skipped\n", rd.header().names[ch],
+                        (unsigned long long)bl[b].offset);
+            for (uint32_t i = 0; i < n; ++i)
+            {
+                if (t[i] >= t0 && t[i] <= t1)
+                    printf("%.6f,%s,%g\n", t[i] / 1e6, rd.header().names[ch], v[i]);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,304 @@
+// hobd_logd: headless logger for the firmware's host link.
+//
+// Polls CMD_GET_LIVE at a fixed interval (and CMD_GET_DTC now and then) on
+// every device given, writes each sample with its host and device
+// timestamps to that device's CSV file, and keeps going across unplugs,
+// resets and reconnects. All devices share one epoll loop, so a bench of
+// loggers is one process; nothing waits on a UI.
+//
+//   hobd_logd [-b baud] [-i poll_ms] [-d dtc_s] [-r] [-m] [-t port] [-o file]
+//             [-l file] [-k file] [-s stats_s] device...
+//
+// With more than one device, -o, -l and -k must contain %s, replaced by
+// the device name (e.g. -o /var/log/hobd/%s.csv). -l also writes the
+// columnar log of hobd_log.hpp, -t serves the samples to local
+// dashboards over TCP, see hobd_fanout.hpp. -k records the K-line bytes
+// of an env:uno_ktrace firmware for hobd_ktreplay.
+
+#include "hobd_device.hpp"
+#include "hobd_fanout.hpp"
+#include "hobd_time.hpp"
+
+#include <errno.h>
+#include <libgen.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+static volatile sig_atomic_t stopping = 0;
+static volatile sig_atomic_t wantReport = 0;
+static void onSignal(int) { stopping = 1; }
+static void onReport(int) { wantReport = 1; }
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-b baud] [-i poll_ms] [-d dtc_s] [-r] [-m] [-t port] [-o file] [-l file]\n"
+            "          [-k file] [-s stats_s] device...\n"
+            "  -b  link rate (115200)\n"
+            "  -i  CMD_GET_LIVE interval in ms (200)\n"
+            "  -d  CMD_GET_DTC interval in s, 0 = only at connect (60)\n"
+            "  -r  CMD_RESET the ECU at connect\n"
+            "  -m  publish samples in /dev/shm/hobd-<device> (hobd_shmcat reads them)\n"
+            "  -t  serve samples on 127.0.0.1:port, clients send \"sub [json|bin] [hz=N]\"\n"
+            "  -o  output file, appended to, %%s = device name (stdout)\n"
+            "  -l  also write a columnar log (hobd_logcat reads it), %%s = device name\n"
+            "  -k  record the K-line (env:uno_ktrace firmware) for hobd_ktreplay, overwritten,\n"
+            "      %%s = device name\n"
+            "  -s  print per device stats every stats_s seconds, 0 = off (0)\n"
+            "      SIGUSR1 prints them at any time\n",
+            prog);
+}
+
+// "-o log/%s.csv" + "/dev/ttyUSB0" -> "log/ttyUSB0.csv"
+static std::string outPath(const char *pattern, const char *device)
+{
+    std::string dev = device;
+    std::string name = basename(&dev[0]);
+    std::string out = pattern;
+    const size_t at = out.find("%s");
+    if (at != std::string::npos)
+        out.replace(at, 2, name);
+    return out;
+}
+
+class Daemon
+{
+public:
+    explicit Daemon(uint32_t statsS) : statsS(statsS) {}
+    ~Daemon()
+    {
+        if (ep >= 0)
+            close(ep);
+    }
+
+    bool add(const DeviceConfig &cfg);
+    // start the TCP fan-out, before add() so devices feed it
+    bool serve(uint16_t port);
+    int run();
+
+private:
+    void watch(Device &d);
+    void unwatch(Device &d);
+    void report();
+
+    int ep = -1;
+    uint32_t statsS;
+    std::vector<std::unique_ptr<Device>> devices;
+    std::unique_ptr<FanoutServer> fanout;
+    std::vector<std::string> names; // device basenames, for the fan-out
+    uint64_t lastReport = 0;
+};
+
+bool Daemon::serve(uint16_t port)
+{
+    fanout.reset(new FanoutServer);
+    if (!fanout->listen(port))
+    {
+        perror("fanout");
+        return false;
+    }
+    return true;
+}
+
+bool Daemon::add(const DeviceConfig &dc)
+{
+    DeviceConfig cfg = dc;
+    if (fanout)
+    {
+        std::string dev = cfg.path;
+        names.push_back(basename(&dev[0]));
+        fanout->setDevices(names);
+        cfg.sink = fanout.get();
+        cfg.index = (uint8_t)(devices.size());
+    }
+    devices.emplace_back(new Device(cfg));
+    if (!devices.back()->ok())
+    {
+        perror(cfg.out);
+        return false;
+    }
+    return true;
+}
+
+void Daemon::watch(Device &d)
+{
+    epoll_event ev = {};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.ptr = &d;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, d.fd(), &ev) < 0)
+        perror("epoll_ctl");
+}
+
+void Daemon::unwatch(Device &d)
+{
+    epoll_ctl(ep, EPOLL_CTL_DEL, d.fd(), nullptr);
+    d.close();
+}
+
+void Daemon::report()
+{
+    const uint64_t now = monoMs();
+    const double dt = lastReport ? (now - lastReport) / 1000.0 : 1.0;
+    for (auto &d : devices)
+        d->report(stderr, dt > 0 ? dt : 1.0);
+    if (fanout)
+        fprintf(stderr, "fanout: %zu clients, %llu dropped\n", fanout->clientCount(),
+                (unsigned long long)fanout->dropped);
+    lastReport = now;
+}
+
+int Daemon::run()
+{
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0)
+    {
+        perror("epoll_create1");
+        return 1;
+    }
+    lastReport = monoMs();
+    if (fanout)
+    {
+        // the server's own epoll fd, readable whenever one of its sockets is
+        epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.ptr = fanout.get();
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, fanout->fd(), &ev) < 0)
+            perror("epoll_ctl");
+    }
+
+    epoll_event evs[16];
+    while (!stopping)
+    {
+        // open / poll / time out whatever is due, then sleep until the
+        // earliest deadline of any device
+        uint64_t now = monoMs();
+        uint64_t next = statsS ? lastReport + statsS * 1000ULL : UINT64_MAX;
+        for (auto &d : devices)
+        {
+            const bool wasOpen = d->fd() >= 0;
+            d->onTimer(now);
+            if (!wasOpen && d->fd() >= 0)
+                watch(*d);
+            const uint64_t dl = d->deadline();
+            next = dl < next ? dl : next;
+        }
+
+        now = monoMs();
+        const int tmo = next > now ? (int)(next - now) : 0;
+        const int n = epoll_wait(ep, evs, 16, tmo);
+        if (n < 0 && errno != EINTR)
+        {
+            perror("epoll_wait");
+            return 1;
+        }
+        for (int i = 0; i < n; ++i)
+        {
+            if (fanout && evs[i].data.ptr == fanout.get())
+            {
+                fanout->poll();
+                continue;
+            }
+            Device &d = *static_cast<Device *>(evs[i].data.ptr);
+            if (d.fd() < 0)
+                continue;
+            const bool alive = d.onReadable();
+            if (!alive || (evs[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)))
+                unwatch(d);
+        }
+
+        if (wantReport || (statsS && monoMs() >= lastReport + statsS * 1000ULL))
+        {
+            wantReport = 0;
+            report();
+        }
+    }
+
+    for (auto &d : devices)
+    {
+        if (d->fd() >= 0)
+            unwatch(*d);
+    }
+    report();
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    DeviceConfig cfg;
+    const char *out = nullptr;
+    const char *logOut = nullptr;
+    const char *ktOut = nullptr;
+    uint32_t statsS = 0;
+    uint16_t port = 0;
+    int c;
+    while ((c = getopt(argc, argv, "b:i:d:rmt:o:l:k:s:h")) != -1)
+    {
+        switch (c)
+        {
+        case 'b': cfg.baud = strtoul(optarg, nullptr, 0); break;
+        case 'i': cfg.pollMs = strtoul(optarg, nullptr, 0); break;
+        case 'd': cfg.dtcS = strtoul(optarg, nullptr, 0); break;
+        case 'r': cfg.reset = true; break;
+        case 'm': cfg.shm = true; break;
+        case 't': port = strtoul(optarg, nullptr, 0); break;
+        case 'o': out = optarg; break;
+        case 'l': logOut = optarg; break;
+        case 'k': ktOut = optarg; break;
+        case 's': statsS = strtoul(optarg, nullptr, 0); break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    const int ndev = argc - optind;
+    if (ndev < 1 || (ndev > 1 && (!out || !strstr(out, "%s") || (logOut && !strstr(logOut, "%s")) ||
+                                  (ktOut && !strstr(ktOut, "%s")))))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    sa.sa_handler = onReport;
+    sigaction(SIGUSR1, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    Daemon daemon(statsS);
+    if (port && !daemon.serve(port))
+        return 1;
+    std::vector<std::string> paths; // DeviceConfig keeps pointers
+    paths.reserve(3 * ndev);
+    for (int i = optind; i < argc; ++i)
+    {
+        DeviceConfig dc = cfg;
+        dc.path = argv[i];
+        if (out)
+        {
+            paths.push_back(outPath(out, argv[i]));
+            dc.out = paths.back().c_str();
+        }
+        if (logOut)
+        {
+            paths.push_back(outPath(logOut, argv[i]));
+            dc.log = paths.back().c_str();
+        }
+        if (ktOut)
+        {
+            paths.push_back(outPath(ktOut, argv[i]));
+            dc.ktrace = paths.back().c_str();
+        }
+        if (!daemon.add(dc))
+            return 1;
+    }
+    return daemon.run();
+}
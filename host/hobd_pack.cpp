@@ -0,0 +1,243 @@
+#include "hobd_pack.hpp"
+
+static inline bool fits(int64_t v, unsigned bits)
+{
+    return v >= -(1LL << (bits - 1)) && v < (1LL << (bits - 1));
+}
+
+static inline int64_t signExtend(uint32_t v, unsigned bits)
+{
+    return (int64_t)((uint64_t)v << (64 - bits)) >> (64 - bits);
+}
+
+static inline uint32_t floatBits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static inline float bitsFloat(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+// ==========================
+// TimeCoder / FloatCoder
+// ==========================
+
+void TimeCoder::put(BitWriter &w, int64_t t)
+{
+    const int64_t d = t - prev;
+    const int64_t dod = d - delta;
+    prev = t;
+    delta = d;
+    if (dod == 0)
+        w.put(0, 1);
+    else if (fits(dod, 7))
+    {
+        w.put(0x2, 2);
+        w.put((uint32_t)dod, 7);
+    }
+    else if (fits(dod, 12))
+    {
+        w.put(0x6, 3);
+        w.put((uint32_t)dod, 12);
+    }
+    else if (fits(dod, 20))
+    {
+        w.put(0xE, 4);
+        w.put((uint32_t)dod, 20);
+    }
+    else
+    {
+        w.put(0xF, 4);
+        w.put64((uint64_t)dod);
+    }
+}
+
+int64_t TimeCoder::get(BitReader &r)
+{
+    int64_t dod = 0;
+    if (r.bit())
+    {
+        if (!r.bit())
+            dod = signExtend(r.get(7), 7);
+        else if (!r.bit())
+            dod = signExtend(r.get(12), 12);
+        else if (!r.bit())
+            dod = signExtend(r.get(20), 20);
+        else
+            dod = (int64_t)r.get64();
+    }
+    delta += dod;
+    prev += delta;
+    return prev;
+}
+
+void FloatCoder::start(BitWriter &w, float v0)
+{
+    prev = floatBits(v0);
+    lead = 33;
+    trail = 0;
+    w.put(prev, 32);
+}
+
+float FloatCoder::start(BitReader &r)
+{
+    prev = r.get(32);
+    lead = 33;
+    trail = 0;
+    return bitsFloat(prev);
+}
+
+void FloatCoder::put(BitWriter &w, float v)
+{
+    const uint32_t cur = floatBits(v);
+    const uint32_t x = cur ^ prev;
+    prev = cur;
+    if (!x)
+    {
+        w.put(0, 1);
+        return;
+    }
+    unsigned l = __builtin_clz(x);
+    const unsigned tz = __builtin_ctz(x);
+    if (l > 31)
+        l = 31;
+    if (lead <= 32 && l >= lead && tz >= trail)
+    {
+        w.put(0x2, 2);
+        w.put(x >> trail, 32 - lead - trail);
+        return;
+    }
+    lead = l;
+    trail = tz;
+    const unsigned bits = 32 - lead - trail;
+    w.put(0x3, 2);
+    w.put(lead, 5);
+    w.put(bits - 1, 5);
+    w.put(x >> trail, bits);
+}
+
+float FloatCoder::get(BitReader &r)
+{
+    if (r.bit())
+    {
+        if (r.bit())
+        {
+            lead = r.get(5);
+            const unsigned bits = r.get(5) + 1;
+            if (lead + bits > 32)
+            {
+                // corrupt, make the caller see it
+                r.overrun = true;
+                return bitsFloat(prev);
+            }
+            trail = 32 - lead - bits;
+        }
+        else if (lead > 32)
+        {
+            r.overrun = true;
+            return bitsFloat(prev);
+        }
+        prev ^= r.get(32 - lead - trail) << trail;
+    }
+    return bitsFloat(prev);
+}
+
+// ==========================
+// Whole columns
+// ==========================
+
+size_t pack_times(const int64_t *t, uint32_t n, uint8_t *out)
+{
+    BitWriter w(out);
+    TimeCoder tc;
+    if (n)
+        tc.start(t[0]);
+    for (uint32_t i = 1; i < n; ++i)
+        tc.put(w, t[i]);
+    return w.finish();
+}
+
+bool unpack_times(const uint8_t *p, size_t len, int64_t t0, uint32_t n, int64_t *t)
+{
+    if (!n)
+        return true;
+    BitReader r(p, len);
+    TimeCoder tc;
+    tc.start(t0);
+    t[0] = t0;
+    for (uint32_t i = 1; i < n; ++i)
+        t[i] = tc.get(r);
+    return !r.overrun;
+}
+
+size_t pack_floats(const float *v, uint32_t n, uint8_t *out)
+{
+    BitWriter w(out);
+    if (!n)
+        return 0;
+    FloatCoder fc;
+    fc.start(w, v[0]);
+    for (uint32_t i = 1; i < n; ++i)
+        fc.put(w, v[i]);
+    return w.finish();
+}
+
+bool unpack_floats(const uint8_t *p, size_t len, uint32_t n, float *v)
+{
+    if (!n)
+        return true;
+    BitReader r(p, len);
+    FloatCoder fc;
+    v[0] = fc.start(r);
+    for (uint32_t i = 1; i < n; ++i)
+        v[i] = fc.get(r);
+    return !r.overrun;
+}
+
+// ==========================
+// SamplePacker
+// ==========================
+
+void SamplePacker::begin(uint8_t *buf, size_t cap, int64_t t0, float v0)
+{
+    w = BitWriter(buf);
+    capBits = cap * 8;
+    first = t0;
+    tc.start(t0);
+    fc.start(w, v0);
+    n = 1;
+}
+
+bool SamplePacker::add(int64_t t, float v)
+{
+    if (w.bits() + PACK_SAMPLE_MAX_BITS > capBits)
+        return false;
+    tc.put(w, t);
+    fc.put(w, v);
+    n++;
+    return true;
+}
+
+bool unpack_samples(const uint8_t *p, size_t len, int64_t t0, uint32_t n, int64_t *t, float *v)
+{
+    if (!n)
+        return true;
+    BitReader r(p, len);
+    TimeCoder tc;
+    FloatCoder fc;
+    tc.start(t0);
+    t[0] = t0;
+    v[0] = fc.start(r);
+    for (uint32_t i = 1; i < n; ++i)
+    {
+        t[i] = tc.get(r);
+        v[i] = fc.get(r);
+    }
+    return !r.overrun;
+}
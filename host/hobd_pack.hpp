@@ -0,0 +1,176 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ==========================
+// Block compression
+// ==========================
+// Bit packed encodings for the columns of a log block, after the Gorilla
+// scheme: the samples come at a near fixed rate and most channels move
+// slowly, so most of each timestamp and value is the same as the last.
+//
+// Timestamps (µs): the first is the block t0 and isn't stored; after that
+// each delta-of-delta (this gap minus the previous one) as
+//   '0'                      same gap
+//   '10'   + 7 bit signed    within ±64 µs
+//   '110'  + 12 bit signed   within ±2 ms
+//   '1110' + 20 bit signed   within ±0.5 s
+//   '1111' + 64 bit          anything else, clock steps included
+//
+// Values (float): the first raw, then each XORed with the previous one as
+//   '0'                      unchanged
+//   '10'  + meaningful bits  fits the previous value's leading / trailing
+//                            zero window
+//   '11'  + 5 bit leading zeros + 5 bit (length - 1) + meaningful bits
+//
+// Bits are written most significant first. Both unpackers return false on
+// input that runs out before n samples are decoded.
+
+// worst case output size in bytes for n samples
+#define PACK_TIMES_MAX(n) ((size_t)(n) * 9 + 8)
+#define PACK_FLOATS_MAX(n) ((size_t)(n) * 6 + 8)
+// worst case bits of one time + value pair
+#define PACK_SAMPLE_MAX_BITS (4 + 64 + 2 + 10 + 32)
+
+class BitWriter
+{
+public:
+    explicit BitWriter(uint8_t *out = nullptr) : p(out) {}
+
+    // up to 32 bits
+    void put(uint32_t v, unsigned bits)
+    {
+        acc = (acc << bits) | (bits < 32 ? v & ((1u << bits) - 1) : v);
+        n += bits;
+        while (n >= 8)
+        {
+            n -= 8;
+            p[len++] = (uint8_t)(acc >> n);
+        }
+    }
+    void put64(uint64_t v)
+    {
+        put((uint32_t)(v >> 32), 32);
+        put((uint32_t)v, 32);
+    }
+    size_t bits() const { return len * 8 + n; }
+    // bytes so far with the pending bits zero padded, writing can go on
+    size_t peek()
+    {
+        if (n)
+            p[len] = (uint8_t)(acc << (8 - n));
+        return len + (n != 0);
+    }
+    // pad the last byte with zeros, returns the bytes written
+    size_t finish()
+    {
+        if (n)
+            p[len++] = (uint8_t)(acc << (8 - n));
+        n = 0;
+        return len;
+    }
+
+private:
+    uint8_t *p;
+    size_t len = 0;
+    uint64_t acc = 0;
+    unsigned n = 0;
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t *in, size_t len) : p(in), len(len) {}
+
+    // up to 32 bits; past the end reads zeros and sets overrun
+    uint32_t get(unsigned bits)
+    {
+        while (n < bits)
+        {
+            if (pos < len)
+                acc = (acc << 8) | p[pos++];
+            else
+            {
+                acc <<= 8;
+                overrun = true;
+            }
+            n += 8;
+        }
+        n -= bits;
+        const uint64_t v = acc >> n;
+        return bits < 32 ? (uint32_t)(v & ((1u << bits) - 1)) : (uint32_t)v;
+    }
+    uint64_t get64()
+    {
+        const uint64_t hi = get(32);
+        return hi << 32 | get(32);
+    }
+    bool bit() { return get(1) != 0; }
+
+    bool overrun = false;
+
+private:
+    const uint8_t *p;
+    size_t len;
+    size_t pos = 0;
+    uint64_t acc = 0;
+    unsigned n = 0;
+};
+
+// Delta-of-delta timestamps, one instance per stream
+struct TimeCoder
+{
+    int64_t prev = 0;
+    int64_t delta = 0;
+
+    void start(int64_t t0)
+    {
+        prev = t0;
+        delta = 0;
+    }
+    void put(BitWriter &w, int64_t t);
+    int64_t get(BitReader &r);
+};
+
+// XORed floats, one instance per stream
+struct FloatCoder
+{
+    uint32_t prev = 0;
+    unsigned lead = 33, trail = 0; // 33: no window yet
+
+    void start(BitWriter &w, float v0);
+    float start(BitReader &r);
+    void put(BitWriter &w, float v);
+    float get(BitReader &r);
+};
+
+size_t pack_times(const int64_t *t, uint32_t n, uint8_t *out);
+bool unpack_times(const uint8_t *p, size_t len, int64_t t0, uint32_t n, int64_t *t);
+
+size_t pack_floats(const float *v, uint32_t n, uint8_t *out);
+bool unpack_floats(const uint8_t *p, size_t len, uint32_t n, float *v);
+
+// One time + value stream packed as the samples arrive, for blocks of a
+// fixed size: the first value raw, then time and value codes interleaved
+// per sample. add() refuses a sample that might not fit.
+class SamplePacker
+{
+public:
+    void begin(uint8_t *buf, size_t cap, int64_t t0, float v0);
+    bool add(int64_t t, float v);
+    uint32_t count() const { return n; }
+    int64_t t0() const { return first; }
+    // bytes of the stream so far, zero padded, the packer stays usable
+    size_t bytes() { return w.peek(); }
+
+private:
+    BitWriter w;
+    size_t capBits = 0;
+    uint32_t n = 0;
+    int64_t first = 0;
+    TimeCoder tc;
+    FloatCoder fc;
+};
+
+bool unpack_samples(const uint8_t *p, size_t len, int64_t t0, uint32_t n, int64_t *t, float *v);
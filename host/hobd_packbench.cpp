@@ -0,0 +1,210 @@
+// hobd_packbench: compression ratio and speed of the log block encodings.
+//
+//   hobd_packbench [-n samples] [file.hbl]
+//
+// Without a file, a synthetic session: n samples at ~10 Hz with host
+// scheduling jitter and engine-like channels. With one, every channel of
+// that log. Each channel is packed the way the logger does it, SamplePacker
+// filling LOG_BLOCK_BYTES blocks, and checked to unpack bit exact. Sizes
+// are compared with the in-memory form (int64 time + float, 12 bytes),
+// once for the packed bits alone and once for whole blocks on disk
+// (headers and padding); speeds are MB/s of the in-memory form.
+
+#include "hobd_log.hpp"
+#include "hobd_pack.hpp"
+#include "hobd_time.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+struct Series
+{
+    std::string name;
+    std::vector<int64_t> t;
+    std::vector<float> v;
+};
+
+static std::vector<Series> synthetic(size_t n)
+{
+    std::vector<Series> out(LOG_SAMPLE_CHANNELS);
+    for (uint16_t ch = 0; ch < LOG_SAMPLE_CHANNELS; ++ch)
+        out[ch].name = logSampleChannels[ch];
+
+    srand(1);
+    int64_t t = 1700000000LL * 1000000;
+    double rpm = 800, vss = 0, ect = 20, tps = 0;
+    for (size_t i = 0; i < n; ++i)
+    {
+        // 100 ms poll, a few hundred µs of jitter, now and then a late one
+        t += 100000 + rand() % 600 - 300 + (rand() % 100 == 0 ? 20000 : 0);
+        tps += (rand() % 21 - 10) * 0.5;
+        tps = tps < 0 ? 0 : tps > 100 ? 100 : tps;
+        rpm += (tps * 60 - (rpm - 800)) * 0.05 + rand() % 41 - 20;
+        vss += ((rpm - 800) / 60 - vss) * 0.02;
+        ect += ect < 90 ? 0.05 : 0;
+        const float v[LOG_SAMPLE_CHANNELS] = {
+            (float)floor(rpm), (float)floor(vss), (float)(floor(ect * 10) / 10), 25.1f,
+            (float)(floor((30 + tps * 0.7) * 10) / 10), (float)(floor(tps * 10) / 10),
+            (float)(floor((13.8 + (rand() % 5 - 2) * 0.01) * 100) / 100),
+            (float)((rand() % 90) / 100.0), (float)floor(tps * 2), (float)(tps > 80 ? 5 : 1),
+            (float)(i & 0xffff)};
+        for (uint16_t ch = 0; ch < LOG_SAMPLE_CHANNELS; ++ch)
+        {
+            out[ch].t.push_back(t);
+            out[ch].v.push_back(v[ch]);
+        }
+    }
+    return out;
+}
+
+static bool fromLog(const char *path, std::vector<Series> &out)
+{
+    LogReader rd;
+    if (!rd.open(path))
+        return false;
+    static int64_t t[LOG_MAX_BLOCK_SAMPLES];
+    static float v[LOG_MAX_BLOCK_SAMPLES];
+    for (uint16_t ch = 0; ch < rd.channels(); ++ch)
+    {
+        Series s;
+        s.name = rd.header().names[ch];
+        for (size_t b = 0; b < rd.blocks(ch).size(); ++b)
+        {
+            const uint32_t n = rd.read(ch, b, t, v);
+            s.t.insert(s.t.end(), t, t + n);
+            s.v.insert(s.v.end(), v, v + n);
+        }
+        if (!s.t.empty())
+            out.push_back(s);
+    }
+    return true;
+}
+
+struct Result
+{
+    size_t packed = 0; // payload bytes
+    size_t blocks = 0;
+    double encS = 0, decS = 0;
+    bool exact = true;
+};
+
+// pack s into blocks and unpack them again, enough rounds for a stable time
+static Result bench(const Series &s)
+{
+    const size_t payload = LOG_BLOCK_BYTES - sizeof(LogBlockHeader);
+    const size_t n = s.t.size();
+    Result r;
+    if (!n)
+        return r;
+    // worst case, so the timed loop never allocates
+    std::vector<uint8_t> disk((n * (PACK_SAMPLE_MAX_BITS / 8 + 1) / payload + 2) * payload);
+    struct Block
+    {
+        size_t off, bytes, first;
+        uint32_t count;
+    };
+    std::vector<Block> blocks;
+    blocks.reserve(disk.size() / payload);
+    static int64_t t[LOG_MAX_BLOCK_SAMPLES];
+    static float v[LOG_MAX_BLOCK_SAMPLES];
+
+    int rounds = 0;
+    const uint64_t start = monoUs();
+    do
+    {
+        blocks.clear();
+        SamplePacker pk;
+        size_t first = 0;
+        pk.begin(disk.data(), payload, s.t[0], s.v[0]);
+        for (size_t i = 1; i <= n; ++i)
+        {
+            if (i < n && pk.add(s.t[i], s.v[i]))
+                continue;
+            const size_t off = blocks.size() * payload;
+            blocks.push_back(Block{off, pk.bytes(), first, pk.count()});
+            if (i == n)
+                break;
+            first = i;
+            pk.begin(disk.data() + off + payload, payload, s.t[i], s.v[i]);
+        }
+        ++rounds;
+    } while (monoUs() - start < 300000);
+    r.encS = (monoUs() - start) / 1e6 / rounds;
+    r.blocks = blocks.size();
+    for (const Block &b : blocks)
+        r.packed += b.bytes;
+
+    rounds = 0;
+    const uint64_t start2 = monoUs();
+    do
+    {
+        for (const Block &b : blocks)
+        {
+            const bool ok = unpack_samples(disk.data() + b.off, b.bytes, s.t[b.first], b.count, t, v);
+            if (!rounds)
+                r.exact = r.exact && ok && !memcmp(t, &s.t[b.first], b.count * sizeof(int64_t)) &&
+                          !memcmp(v, &s.v[b.first], b.count * sizeof(float));
+        }
+        ++rounds;
+    } while (monoUs() - start2 < 300000);
+    r.decS = (monoUs() - start2) / 1e6 / rounds;
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = 1000000;
+    int c;
+    while ((c = getopt(argc, argv, "n:h")) != -1)
+    {
+        if (c != 'n')
+        {
+            fprintf(stderr, "usage: %s [-n samples] [file.hbl]\n", argv[0]);
+            return 2;
+        }
+        n = strtoul(optarg, nullptr, 0);
+    }
+
+    std::vector<Series> series;
+    if (optind < argc)
+    {
+        if (!fromLog(argv[optind], series))
+        {
+            fprintf(stderr, "%s: not a hobd log\n", argv[optind]);
+            return 1;
+        }
+    }
+    else
+        series = synthetic(n);
+
+    printf("%-6s %9s %8s %7s %8s %9s %9s\n", "chan", "samples", "bits/smp", "vs 12B", "on disk",
+           "enc MB/s", "dec MB/s");
+    size_t allN = 0, allPacked = 0, allBlocks = 0;
+    double allEnc = 0, allDec = 0;
+    bool exact = true;
+    for (const Series &s : series)
+    {
+        const Result r = bench(s);
+        const size_t sn = s.t.size();
+        const double mem = sn * 12.0;
+        printf("%-6s %9zu %8.2f %6.1fx %7.1fx %9.0f %9.0f%s\n", s.name.c_str(), sn,
+               r.packed * 8.0 / sn, mem / r.packed, mem / (r.blocks * LOG_BLOCK_BYTES),
+               mem / r.encS / 1e6, mem / r.decS / 1e6, r.exact ? "" : "  MISMATCH");
+        allN += sn;
+        allPacked += r.packed;
+        allBlocks += r.blocks;
+        allEnc += r.encS;
+        allDec += r.decS;
+        exact = exact && r.exact;
+    }
+    printf("%-6s %9zu %8.2f %6.1fx %7.1fx %9.0f %9.0f\n", "all", allN, allPacked * 8.0 / allN,
+           allN * 12.0 / allPacked, allN * 12.0 / (allBlocks * LOG_BLOCK_BYTES), allN * 12.0 / allEnc / 1e6,
+           allN * 12.0 / allDec / 1e6);
+    return exact ? 0 : 1;
+}
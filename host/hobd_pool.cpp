@@ -0,0 +1,76 @@
+#include "hobd_pool.hpp"
+
+#include <thread>
+
+TaskPool::TaskPool(unsigned workers)
+{
+    if (!workers)
+        workers = std::thread::hardware_concurrency();
+    if (!workers)
+        workers = 1;
+    for (unsigned i = 0; i < workers; ++i)
+        queues.emplace_back(new Queue);
+}
+
+void TaskPool::push(unsigned worker, Task t)
+{
+    Queue &qu = *queues[worker % queues.size()];
+    pending++;
+    std::lock_guard<std::mutex> lk(qu.m);
+    qu.q.push_back(std::move(t));
+}
+
+bool TaskPool::take(unsigned w, Task &t)
+{
+    {
+        Queue &own = *queues[w];
+        std::lock_guard<std::mutex> lk(own.m);
+        if (!own.q.empty())
+        {
+            t = std::move(own.q.back());
+            own.q.pop_back();
+            return true;
+        }
+    }
+    for (size_t i = 1; i < queues.size(); ++i)
+    {
+        Queue &victim = *queues[(w + i) % queues.size()];
+        std::lock_guard<std::mutex> lk(victim.m);
+        if (!victim.q.empty())
+        {
+            t = std::move(victim.q.front());
+            victim.q.pop_front();
+            stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::work(unsigned w)
+{
+    Task t;
+    // a task still running may push more, so an empty pass is not the end
+    while (pending.load())
+    {
+        if (!take(w, t))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        t(*this, w);
+        t = nullptr;
+        done++;
+        pending--;
+    }
+}
+
+void TaskPool::run()
+{
+    std::vector<std::thread> threads;
+    for (unsigned w = 1; w < queues.size(); ++w)
+        threads.emplace_back(&TaskPool::work, this, w);
+    work(0);
+    for (std::thread &th : threads)
+        th.join();
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// ==========================
+// Work stealing pool
+// ==========================
+// One deque of tasks per worker thread. A worker runs its own newest task
+// first (what it just split off is still in its cache) and, out of work,
+// steals the oldest task of another worker, usually the biggest piece
+// still unsplit. Tasks may push more tasks, onto their own worker's deque.
+// run() returns once every task and everything they pushed is done.
+class TaskPool
+{
+public:
+    typedef std::function<void(TaskPool &, unsigned worker)> Task;
+
+    // 0 = one per core
+    explicit TaskPool(unsigned workers = 0);
+
+    unsigned workers() const { return (unsigned)queues.size(); }
+    void push(unsigned worker, Task t);
+    // Run on workers() threads, the calling one included
+    void run();
+
+    uint64_t tasks() const { return done.load(); }
+    uint64_t steals() const { return stolen.load(); }
+
+private:
+    struct alignas(64) Queue
+    {
+        std::mutex m;
+        std::deque<Task> q;
+    };
+
+    void work(unsigned w);
+    bool take(unsigned w, Task &t);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<uint64_t> pending{0}, done{0}, stolen{0};
+};
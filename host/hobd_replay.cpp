@@ -0,0 +1,345 @@
+// hobd_replay: push a recorded session through the logger's pipeline.
+//
+//   hobd_replay [-x speed] [-n vehicles] [-r rounds] [-o file] [-l file] [-m]
+//               [-t port] [-p] session
+//     session  a hobd_logd csv (-o) or columnar log (-l)
+//     -x  multiple of real time, 0 = as fast as possible (0)
+//     -n  vehicles, each with its own Device and outputs (1)
+//     -r  play the session this many times over (1)
+//     -o  csv output, %s = vehicle number (/dev/null)
+//     -l  also a columnar log, %s = vehicle number
+//     -m  also publish in /dev/shm/hobd-replay<n>
+//     -t  also serve the samples on 127.0.0.1:port, as hobd_logd -t
+//     -p  time each pipeline stage (a few clock reads per frame)
+//
+// The samples are encoded back into the MSG_LIVE frames the firmware sent
+// and handed to Device::feed() one frame per vehicle in turn, the way
+// hobd_logd's epoll loop hands it port reads. From there everything runs
+// as in the logger: parser, decode, scaling, CSV, shm, columnar log,
+// fan-out. Prints samples/s, what that is in vehicles at the session's
+// own sample rate, and with -p where the time goes.
+
+#include "hobd_device.hpp"
+#include "hobd_fanout.hpp"
+#include "hobd_log.hpp"
+#include "hobd_time.hpp"
+
+#include <math.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// fan-out clients are served every this many frames
+#define SINK_POLL_FRAMES 64
+
+struct Recorded
+{
+    int64_t tUs; // host time
+    TelemHdr hdr;
+    LiveRecord r;
+};
+
+static uint16_t clampU16(double v)
+{
+    return v < 0 ? 0 : v > 65535 ? 65535 : (uint16_t)lround(v);
+}
+
+static int16_t clampI16(double v)
+{
+    return v < -32768 ? -32768 : v > 32767 ? 32767 : (int16_t)lround(v);
+}
+
+// hobd_logd csv: t_host,t_dev_us,seq,rpm,vss,ect,iat,map,tps,batt,o2,flags,maf
+static bool fromCsv(const char *path, std::vector<Recorded> &out)
+{
+    FILE *f = fopen(path, "r");
+    if (!f)
+        return false;
+    char line[256];
+    while (fgets(line, sizeof(line), f))
+    {
+        double t, ect, iat, map, tps, batt, o2;
+        unsigned long dev;
+        unsigned seq, rpm, vss, flags, maf;
+        if (sscanf(line, "%lf,%lu,%u,%u,%u,%lf,%lf,%lf,%lf,%lf,%lf,%u,%u", &t, &dev, &seq, &rpm,
+                   &vss, &ect, &iat, &map, &tps, &batt, &o2, &flags, &maf) != 13)
+            continue; // header and # event lines
+        Recorded s;
+        s.tUs = (int64_t)llround(t * 1e6);
+        s.hdr = TelemHdr{(uint16_t)seq, (uint32_t)dev};
+        s.r = LiveRecord{clampU16(rpm), (uint8_t)vss, clampI16(ect * 10), clampI16(iat * 10),
+                         clampI16(map * 10), clampI16(tps * 10), clampU16(batt * 100),
+                         clampU16(o2 * 100), (uint8_t)flags, clampU16(maf)};
+        out.push_back(s);
+    }
+    fclose(f);
+    return true;
+}
+
+// columnar log: every channel has a value per sample, rpm's times lead
+static bool fromLog(const char *path, std::vector<Recorded> &out)
+{
+    LogReader rd;
+    if (!rd.open(path) || rd.channels() != LOG_SAMPLE_CHANNELS)
+        return false;
+    std::vector<std::vector<int64_t>> t(LOG_SAMPLE_CHANNELS);
+    std::vector<std::vector<float>> v(LOG_SAMPLE_CHANNELS);
+    static int64_t bt[LOG_MAX_BLOCK_SAMPLES];
+    static float bv[LOG_MAX_BLOCK_SAMPLES];
+    for (uint16_t ch = 0; ch < LOG_SAMPLE_CHANNELS; ++ch)
+    {
+        for (size_t b = 0; b < rd.blocks(ch).size(); ++b)
+        {
+            const uint32_t n = rd.read(ch, b, bt, bv);
+            t[ch].insert(t[ch].end(), bt, bt + n);
+            v[ch].insert(v[ch].end(), bv, bv + n);
+        }
+    }
+    // a damaged block is skipped in its channel only: join on rpm's time
+    // rather than on the index, and drop what some channel lacks
+    if (t[LOG_CH_RPM].empty())
+        return true;
+    const int64_t t0 = t[LOG_CH_RPM][0];
+    size_t at[LOG_SAMPLE_CHANNELS] = {};
+    size_t dropped = 0;
+    for (size_t i = 0; i < t[LOG_CH_RPM].size(); ++i)
+    {
+        const int64_t ts = t[LOG_CH_RPM][i];
+        size_t j[LOG_SAMPLE_CHANNELS];
+        bool whole = true;
+        for (uint16_t ch = 0; ch < LOG_SAMPLE_CHANNELS; ++ch)
+        {
+            while (at[ch] < t[ch].size() && t[ch][at[ch]] < ts)
+                ++at[ch];
+            j[ch] = at[ch];
+            whole = whole && j[ch] < t[ch].size() && t[ch][j[ch]] == ts;
+        }
+        if (!whole)
+        {
+            ++dropped;
+            continue;
+        }
+        Recorded s;
+        s.tUs = ts;
+        // the device clock isn't logged, host time stands in
+        s.hdr = TelemHdr{(uint16_t)v[LOG_CH_SEQ][j[LOG_CH_SEQ]], (uint32_t)(s.tUs - t0)};
+        s.r = LiveRecord{clampU16(v[LOG_CH_RPM][i]), (uint8_t)v[LOG_CH_VSS][j[LOG_CH_VSS]],
+                         clampI16(v[LOG_CH_ECT][j[LOG_CH_ECT]] * 10),
+                         clampI16(v[LOG_CH_IAT][j[LOG_CH_IAT]] * 10),
+                         clampI16(v[LOG_CH_MAP][j[LOG_CH_MAP]] * 10),
+                         clampI16(v[LOG_CH_TPS][j[LOG_CH_TPS]] * 10),
+                         clampU16(v[LOG_CH_BATT][j[LOG_CH_BATT]] * 100),
+                         clampU16(v[LOG_CH_O2][j[LOG_CH_O2]] * 100),
+                         (uint8_t)v[LOG_CH_FLAGS][j[LOG_CH_FLAGS]],
+                         clampU16(v[LOG_CH_MAF][j[LOG_CH_MAF]])};
+        out.push_back(s);
+    }
+    if (dropped)
+        fprintf(stderr, "%s: %zu samples dropped, missing from damaged blocks\n", path, dropped);
+    return true;
+}
+
+// The session as the firmware put it on the wire
+struct Wire
+{
+    std::vector<uint8_t> bytes;
+    std::vector<size_t> at; // frame i is bytes[at[i] .. at[i + 1])
+};
+
+static Wire encode(const std::vector<Recorded> &rec)
+{
+    Wire w;
+    for (const Recorded &s : rec)
+    {
+        uint8_t payload[TELEM_HDR_LEN + LIVE_LEN];
+        telem_encode(payload, s.hdr);
+        live_encode(payload + TELEM_HDR_LEN, s.r);
+        uint8_t frame[FRAME_MAX];
+        const uint8_t n = frame_encode(FRAMING_SOF, frame, MSG_LIVE, payload, sizeof(payload));
+        w.at.push_back(w.bytes.size());
+        w.bytes.insert(w.bytes.end(), frame, frame + n);
+    }
+    w.at.push_back(w.bytes.size());
+    return w;
+}
+
+static std::string pathFor(const char *pattern, unsigned i)
+{
+    std::string out = pattern;
+    const size_t at = out.find("%s");
+    if (at != std::string::npos)
+        out.replace(at, 2, std::to_string(i));
+    return out;
+}
+
+static void sleepUntil(uint64_t us)
+{
+    const uint64_t now = monoUs();
+    if (us <= now)
+        return;
+    const timespec ts = {(time_t)((us - now) / 1000000), (long)((us - now) % 1000000) * 1000};
+    nanosleep(&ts, nullptr);
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "usage: %s [-x speed] [-n vehicles] [-r rounds] [-o file] [-l file] [-m] [-t port] [-p]\n"
+            "          session.csv|session.hbl\n",
+            prog);
+}
+
+int main(int argc, char **argv)
+{
+    double speed = 0;
+    unsigned vehicles = 1, rounds = 1;
+    const char *out = "/dev/null";
+    const char *logOut = nullptr;
+    bool shm = false, prof = false;
+    uint16_t port = 0;
+    int c;
+    while ((c = getopt(argc, argv, "x:n:r:o:l:mt:ph")) != -1)
+    {
+        switch (c)
+        {
+        case 'x': speed = strtod(optarg, nullptr); break;
+        case 'n': vehicles = strtoul(optarg, nullptr, 0); break;
+        case 'r': rounds = strtoul(optarg, nullptr, 0); break;
+        case 'o': out = optarg; break;
+        case 'l': logOut = optarg; break;
+        case 'm': shm = true; break;
+        case 't': port = strtoul(optarg, nullptr, 0); break;
+        case 'p': prof = true; break;
+        default: usage(argv[0]); return 2;
+        }
+    }
+    if (optind != argc - 1 || !vehicles || !rounds ||
+        (vehicles > 1 && (!strstr(out, "%s") && strcmp(out, "/dev/null"))) ||
+        (vehicles > 1 && logOut && !strstr(logOut, "%s")))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    const char *path = argv[optind];
+    std::vector<Recorded> rec;
+    if (!fromLog(path, rec) && (!fromCsv(path, rec) || rec.empty()))
+    {
+        fprintf(stderr, "%s: no samples (not a hobd_logd csv or log)\n", path);
+        return 1;
+    }
+    if (rec.empty())
+    {
+        fprintf(stderr, "%s: no samples\n", path);
+        return 1;
+    }
+    const Wire wire = encode(rec);
+    const double span = (rec.back().tUs - rec.front().tUs) / 1e6;
+    const double rate = span > 0 ? (rec.size() - 1) / span : 0;
+
+    std::unique_ptr<FanoutServer> fanout;
+    if (port)
+    {
+        fanout.reset(new FanoutServer);
+        if (!fanout->listen(port))
+        {
+            perror("fanout");
+            return 1;
+        }
+    }
+
+    PipeProfile profile;
+    std::vector<std::string> paths; // DeviceConfig keeps pointers
+    paths.reserve(3 * vehicles);
+    std::vector<std::unique_ptr<Device>> devs;
+    std::vector<std::string> names;
+    for (unsigned i = 0; i < vehicles; ++i)
+    {
+        DeviceConfig dc;
+        paths.push_back("replay" + std::to_string(i));
+        dc.path = paths.back().c_str();
+        names.push_back(paths.back());
+        paths.push_back(pathFor(out, i));
+        dc.out = paths.back().c_str();
+        if (logOut)
+        {
+            paths.push_back(pathFor(logOut, i));
+            dc.log = paths.back().c_str();
+        }
+        dc.shm = shm;
+        dc.sink = fanout.get();
+        dc.index = (uint8_t)i;
+        dc.prof = prof ? &profile : nullptr;
+        devs.emplace_back(new Device(dc));
+        if (!devs.back()->ok())
+        {
+            perror(dc.out);
+            return 1;
+        }
+    }
+    if (fanout)
+        fanout->setDevices(names);
+
+    // each vehicle gets every frame in turn, a session's worth per round
+    const uint64_t w0 = monoUs();
+    const size_t frames = rec.size();
+    uint64_t fed = 0;
+    for (unsigned r = 0; r < rounds; ++r)
+    {
+        for (size_t i = 0; i < frames; ++i)
+        {
+            if (speed > 0)
+                sleepUntil(w0 + (uint64_t)((r * span * 1e6 + (rec[i].tUs - rec[0].tUs)) / speed));
+            const uint8_t *p = wire.bytes.data() + wire.at[i];
+            const size_t n = wire.at[i + 1] - wire.at[i];
+            for (auto &d : devs)
+                d->feed(p, n);
+            if (fanout && ++fed % SINK_POLL_FRAMES == 0)
+                fanout->poll();
+        }
+    }
+    const double wall = (monoUs() - w0) / 1e6;
+
+    uint64_t samples = 0, crc = 0;
+    for (auto &d : devs)
+    {
+        samples += d->stats.samples;
+        crc += d->rxStats().crcErrors;
+    }
+    printf("session: %zu samples, %.1f s, %.2f Hz, %zu bytes on the wire\n", frames, span, rate,
+           wire.bytes.size());
+    printf("replay: %llu samples in %.3f s, %.0f samples/s, %.1f MB/s of link traffic",
+           (unsigned long long)samples, wall, samples / wall,
+           wire.bytes.size() * (double)rounds * vehicles / wall / 1e6);
+    // paced, the rate says nothing about capacity
+    if (rate > 0 && speed <= 0)
+        printf(", %.0f vehicles at %.2f Hz", samples / wall / rate, rate);
+    putchar('\n');
+    if (crc || samples != (uint64_t)frames * rounds * vehicles)
+        printf("  %llu frames failed their checksum, %llu samples missing\n",
+               (unsigned long long)crc,
+               (unsigned long long)((uint64_t)frames * rounds * vehicles - samples));
+    if (prof && samples)
+    {
+        uint64_t total = 0;
+        for (uint64_t ns : profile.ns)
+            total += ns;
+        printf("%-8s %10s %6s\n", "stage", "ns/sample", "share");
+        for (int s = 0; s < PIPE_STAGES; ++s)
+        {
+            if (profile.ns[s])
+                printf("%-8s %10.1f %5.1f%%\n", pipeStageNames[s], (double)profile.ns[s] / samples,
+                       100.0 * profile.ns[s] / total);
+        }
+        printf("%-8s %10.1f\n", "total", (double)total / samples);
+    }
+    return 0;
+}
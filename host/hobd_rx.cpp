@@ -0,0 +1,159 @@
+#include "hobd_rx.hpp"
+#include "hobd_proto.hpp"
+
+// type + payload + crc16, plus the COBS code byte
+#define COBS_MAX_ENC (1 + 1 + RX_MAX_PAYLOAD + 2)
+
+static_assert((RX_RING_SIZE & (RX_RING_SIZE - 1)) == 0, "RX_RING_SIZE must be a power of two");
+
+uint8_t *RxRing::writePtr(size_t &room)
+{
+    const size_t t = tail & (RX_RING_SIZE - 1);
+    const size_t free = RX_RING_SIZE - used();
+    room = free < RX_RING_SIZE - t ? free : RX_RING_SIZE - t;
+    return buf + t;
+}
+
+void RxRing::commit(size_t n)
+{
+    tail += n;
+    stats.bytes += n;
+}
+
+void RxRing::feed(const uint8_t *p, size_t n)
+{
+    while (n)
+    {
+        size_t room;
+        uint8_t *w = writePtr(room);
+        if (!room)
+        {
+            // parser fell behind, keep the newest bytes
+            const size_t lose = n < RX_RING_SIZE ? n : RX_RING_SIZE;
+            drop(lose);
+            stats.overruns += lose;
+            continue;
+        }
+        const size_t k = n < room ? n : room;
+        memcpy(w, p, k);
+        commit(k);
+        p += k;
+        n -= k;
+    }
+}
+
+void RxRing::setFraming(Framing f)
+{
+    // bytes already queued were sent in the old framing
+    framing = f;
+}
+
+bool RxRing::next(RxFrame &f)
+{
+    return framing == COBS ? nextCobs(f) : nextSof(f);
+}
+
+bool RxRing::nextSof(RxFrame &f)
+{
+    for (;;)
+    {
+        // skip to the next SOF1
+        size_t i = 0;
+        while (i < used() && at(i) != SOF1)
+            ++i;
+        drop(i);
+        stats.skipped += i;
+
+        if (used() < 4)
+            return false;
+        if (at(1) != SOF2)
+        {
+            drop(1);
+            stats.skipped++;
+            continue;
+        }
+
+        const uint8_t len = at(3);
+        const size_t need = 4 + (size_t)len + 1;
+        if (used() < need)
+            return false;
+
+        f.type = at(2);
+        f.len = len;
+        for (uint8_t k = 0; k < len; ++k)
+            f.payload[k] = at(4 + k);
+
+        if (sof_crc(f.type, f.payload, len) != at(4 + len))
+        {
+            // drop the SOF and look again, the real frame may start inside
+            stats.crcErrors++;
+            drop(2);
+            stats.skipped += 2;
+            continue;
+        }
+        drop(need);
+        stats.frames++;
+        return true;
+    }
+}
+
+bool RxRing::nextCobs(RxFrame &f)
+{
+    for (;;)
+    {
+        size_t end = 0;
+        while (end < used() && at(end) != COBS_DELIM)
+            ++end;
+        if (end == used())
+        {
+            // no delimiter yet; anything longer than a frame is garbage
+            if (used() > COBS_MAX_ENC)
+            {
+                stats.skipped += used();
+                drop(used());
+            }
+            return false;
+        }
+        if (end == 0)
+        {
+            drop(1); // back to back delimiters
+            continue;
+        }
+
+        uint8_t dec[COBS_MAX_ENC];
+        size_t n = 0;
+        bool ok = end <= COBS_MAX_ENC;
+        size_t i = 0;
+        while (ok && i < end)
+        {
+            const uint8_t code = at(i);
+            if (code == 0 || i + code > end + 1)
+            {
+                ok = false;
+                break;
+            }
+            for (uint8_t k = 1; k < code; ++k)
+                dec[n++] = at(i + k);
+            i += code;
+            if (code < 0xFF && i < end)
+                dec[n++] = 0;
+        }
+
+        drop(end + 1);
+        if (!ok || n < 3)
+        {
+            stats.skipped += end + 1;
+            continue;
+        }
+        if (crc16(dec, n - 2) != get_u16(dec + n - 2))
+        {
+            stats.crcErrors++;
+            continue;
+        }
+        f.type = dec[0];
+        f.len = (uint8_t)(n - 3);
+        memcpy(f.payload, dec + 1, f.len);
+        stats.frames++;
+        return true;
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// ==========================
+// Host side frame parser
+// ==========================
+// Bytes are read straight into a fixed ring and frames are copied out into
+// a caller owned RxFrame, so nothing is allocated per frame however long
+// the session runs. Handles both link framings:
+//   SOF   AA 55 type len payload crc8
+//   COBS  cobs(type payload crc16) 00
+// A bad checksum or a runt frame costs one byte (SOF) or one frame (COBS)
+// and the parser resyncs on the next start of frame.
+#define RX_RING_SIZE 4096 // power of two
+#define RX_MAX_PAYLOAD 255
+
+struct RxFrame
+{
+    uint8_t type;
+    uint8_t len;
+    uint8_t payload[RX_MAX_PAYLOAD];
+};
+
+struct RxStats
+{
+    uint64_t bytes = 0;
+    uint64_t frames = 0;
+    uint64_t crcErrors = 0;
+    uint64_t skipped = 0; // bytes thrown away looking for a frame
+    uint64_t overruns = 0; // bytes lost to a full ring
+};
+
+class RxRing
+{
+public:
+    enum Framing : uint8_t
+    {
+        SOF = 0,
+        COBS = 1
+    };
+
+    explicit RxRing(Framing f = SOF) : framing(f) {}
+
+    // Contiguous free space to read() into, then commit() what arrived
+    uint8_t *writePtr(size_t &room);
+    void commit(size_t n);
+    // Copy bytes in, for data that did not come from read()
+    void feed(const uint8_t *p, size_t n);
+
+    // Next complete, checksummed frame, false once the ring runs dry
+    bool next(RxFrame &f);
+
+    void setFraming(Framing f);
+    Framing getFraming() const { return framing; }
+    void clear() { head = tail = 0; }
+
+    RxStats stats;
+
+private:
+    size_t used() const { return tail - head; }
+    uint8_t at(size_t i) const { return buf[(head + i) & (RX_RING_SIZE - 1)]; }
+    void drop(size_t n) { head += n; }
+
+    bool nextSof(RxFrame &f);
+    bool nextCobs(RxFrame &f);
+
+    uint8_t buf[RX_RING_SIZE];
+    size_t head = 0; // free running, masked on access
+    size_t tail = 0;
+    Framing framing;
+};
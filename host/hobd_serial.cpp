@@ -0,0 +1,72 @@
+#include "hobd_serial.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+static speed_t baudConst(uint32_t baud)
+{
+    switch (baud)
+    {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B250000
+    case 250000: return B250000;
+#endif
+#ifdef B500000
+    case 500000: return B500000;
+#endif
+#ifdef B1000000
+    case 1000000: return B1000000;
+#endif
+    default: return 0;
+    }
+}
+
+bool hobd_set_baud(int fd, uint32_t baud)
+{
+    const speed_t sp = baudConst(baud);
+    if (!sp)
+        return hobd_set_baud_any(fd, baud);
+    termios tio;
+    if (tcgetattr(fd, &tio) < 0)
+        return false;
+    cfsetispeed(&tio, sp);
+    cfsetospeed(&tio, sp);
+    return tcsetattr(fd, TCSANOW, &tio) == 0;
+}
+
+int hobd_open_serial(const char *path, uint32_t baud)
+{
+    const int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+
+    termios tio;
+    if (tcgetattr(fd, &tio) < 0)
+    {
+        const int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    cfmakeraw(&tio);
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &tio) < 0 || !hobd_set_baud(fd, baud))
+    {
+        const int e = errno;
+        close(fd);
+        errno = e;
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    return fd;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+// ==========================
+// Serial device
+// ==========================
+// Opens a tty (USB serial, rfcomm, or the pty from tools/bt_pty_sim.py)
+// raw, 8N1, non blocking. Returns the fd, or -1 with errno set.
+int hobd_open_serial(const char *path, uint32_t baud);
+
+// Change the rate of an open port, false if the rate is not supported
+bool hobd_set_baud(int fd, uint32_t baud);
+// Any rate the driver takes, for those without a Bxxx constant (Linux
+// only, elsewhere false with EINVAL); hobd_set_baud() falls back on it
+bool hobd_set_baud_any(int fd, uint32_t baud);
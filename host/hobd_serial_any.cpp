@@ -0,0 +1,33 @@
+// Rates without a Bxxx constant, 250000 among them (the one a 16 MHz
+// AVR hits exactly), through termios2 / BOTHER. <asm/termbits.h> clashes
+// with <termios.h>, so it has this file to itself.
+
+#include "hobd_serial.hpp"
+
+#include <errno.h>
+
+#ifdef __linux__
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+bool hobd_set_baud_any(int fd, uint32_t baud)
+{
+    termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) < 0)
+        return false;
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+    return ioctl(fd, TCSETS2, &tio) == 0;
+}
+
+#else
+
+bool hobd_set_baud_any(int, uint32_t)
+{
+    errno = EINVAL;
+    return false;
+}
+
+#endif
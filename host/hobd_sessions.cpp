@@ -0,0 +1,563 @@
+// hobd_sessions: per session summaries of a log archive, on every core.
+//
+//   hobd_sessions [-j threads] [-c] dir|file...
+//     -j  worker threads, default one per core
+//     -c  one csv line per session instead of the report
+//
+// A session is what one logger run left behind: name.hbl (hobd_logd -l)
+// and / or name.csv (-o), paired by name. Samples come from the .hbl when
+// there is one, from the csv otherwise; DTC scans (#dtc lines) are only
+// in the csv. Directories are read one level deep.
+//
+// Each session starts as one task that opens its files and splits them:
+// the .hbl into a task per block of every summarised channel, the csv
+// into CSV_CHUNK pieces cut at line ends. TaskPool spreads the pieces by
+// work stealing, so one long session keeps every core as busy as a pile
+// of short ones. Pieces are summarised on their own (hobd_summary.hpp)
+// and appended in time order at the end: the numbers do not depend on -j.
+//
+// Per session: peaks, time at rpm / vss / map (load) / tps, o2 and the
+// DTCs seen. The logs have no fuel trim channels, MSG_LIVE carries none;
+// o2 (mean, time rich, switches per second) is what there is to judge
+// the mixture by.
+
+#include "hobd_log.hpp"
+#include "hobd_pool.hpp"
+#include "hobd_summary.hpp"
+#include "hobd_time.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define CSV_CHUNK (1 << 20)
+
+// what gets summarised; flags and seq are not measurements
+static const uint16_t chans[] = {
+    LOG_CH_RPM, LOG_CH_VSS, LOG_CH_ECT, LOG_CH_IAT, LOG_CH_MAP,
+    LOG_CH_TPS, LOG_CH_BATT, LOG_CH_O2, LOG_CH_MAF,
+};
+
+// csv column -> LogChannel, -1 for the ones not summarised
+static const int csvColumn[] = {
+    -1, -1, -1, LOG_CH_RPM, LOG_CH_VSS, LOG_CH_ECT, LOG_CH_IAT, LOG_CH_MAP,
+    LOG_CH_TPS, LOG_CH_BATT, LOG_CH_O2, -1, LOG_CH_MAF,
+};
+static const int CSV_COLUMNS = sizeof(csvColumn) / sizeof(csvColumn[0]);
+
+struct DtcScan
+{
+    int64_t t;
+    uint8_t count;
+    std::vector<uint8_t> codes;
+};
+
+// one csv chunk
+struct Piece
+{
+    ChannelSummary ch[LOG_SAMPLE_CHANNELS];
+    std::vector<DtcScan> dtc;
+};
+
+struct Session
+{
+    std::string name, hbl, csv;
+    std::string err;
+
+    LogReader log;
+    std::vector<std::vector<ChannelSummary>> blocks; // [LogChannel][block]
+    uint32_t badBlocks = 0;
+    const char *csvBase = nullptr;
+    size_t csvLen = 0;
+    std::vector<Piece> pieces;
+
+    // merged
+    ChannelSummary ch[LOG_SAMPLE_CHANNELS];
+    std::vector<DtcScan> dtc;
+
+    ~Session()
+    {
+        if (csvBase)
+            munmap((void *)csvBase, csvLen);
+    }
+};
+
+// ==========================
+// Reading
+// ==========================
+
+static void readBlock(Session &s, uint16_t ch, int logCh, size_t b)
+{
+    static thread_local int64_t t[LOG_MAX_BLOCK_SAMPLES];
+    static thread_local float v[LOG_MAX_BLOCK_SAMPLES];
+    const uint32_t n = s.log.read(logCh, b, t, v);
+    // a damaged block leaves its summary empty, the gap is not counted
+    s.blocks[ch][b].add(t, v, n, summarySpecs[ch]);
+}
+
+static bool parseDtc(const char *p, const char *end, DtcScan &d)
+{
+    // #dtc,t,count,XX,XX...
+    char *e;
+    p += 5;
+    d.t = llround(strtod(p, &e) * 1e6);
+    if (e == p || *e != ',')
+        return false;
+    d.count = (uint8_t)strtoul(e + 1, &e, 10);
+    while (e < end && *e == ',')
+    {
+        p = e + 1;
+        d.codes.push_back((uint8_t)strtoul(p, &e, 16));
+        if (e == p)
+            return false;
+    }
+    return true;
+}
+
+// csv lines [p, end), samples only if there is no .hbl
+static void readChunk(Session &s, size_t piece, const char *p, const char *end)
+{
+    Piece &out = s.pieces[piece];
+    const bool samples = s.hbl.empty();
+    std::vector<int64_t> t;
+    std::vector<float> v[LOG_SAMPLE_CHANNELS];
+    while (p < end)
+    {
+        const char *nl = (const char *)memchr(p, '\n', end - p);
+        const char *eol = nl ? nl : end;
+        if (*p == '#')
+        {
+            DtcScan d;
+            if (eol - p > 5 && !memcmp(p, "#dtc,", 5) && parseDtc(p, eol, d))
+                out.dtc.push_back(d);
+        }
+        else if (samples && *p >= '0' && *p <= '9')
+        {
+            // strtod stops at the comma; a short or torn line is dropped whole
+            float row[CSV_COLUMNS];
+            char *e;
+            const double th = strtod(p, &e);
+            int col = 1;
+            for (; col < CSV_COLUMNS && e < eol && *e == ','; ++col)
+            {
+                const char *f = e + 1;
+                row[col] = strtof(f, &e);
+                // strtof takes "nan" and "inf", no logger writes them
+                if (e == f || !isfinite(row[col]))
+                    break;
+            }
+            if (col == CSV_COLUMNS && e == eol)
+            {
+                t.push_back(llround(th * 1e6));
+                for (int c = 0; c < CSV_COLUMNS; ++c)
+                {
+                    if (csvColumn[c] >= 0)
+                        v[csvColumn[c]].push_back(row[c]);
+                }
+            }
+        }
+        p = nl ? nl + 1 : end;
+    }
+    for (uint16_t ch : chans)
+        out.ch[ch].add(t.data(), v[ch].data(), t.size(), summarySpecs[ch]);
+}
+
+static bool mapFile(const char *path, const char **base, size_t *len)
+{
+    const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *m = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size == 0)
+    {
+        // nothing logged yet, nothing to map
+        ::close(fd);
+        *base = nullptr;
+        *len = 0;
+        return true;
+    }
+    if (st.st_size > 0)
+        m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED)
+        return false;
+    madvise(m, st.st_size, MADV_SEQUENTIAL);
+    *base = (const char *)m;
+    *len = st.st_size;
+    return true;
+}
+
+// the session task: open, split into tasks on this worker's deque
+static void openSession(TaskPool &pool, unsigned w, Session &s)
+{
+    if (!s.hbl.empty())
+    {
+        if (!s.log.open(s.hbl.c_str()))
+        {
+            s.err = s.hbl + ": not a hobd log";
+            return;
+        }
+        s.blocks.resize(LOG_SAMPLE_CHANNELS);
+        for (uint16_t ch : chans)
+        {
+            const int logCh = s.log.channel(logSampleChannels[ch]);
+            if (logCh < 0)
+                continue;
+            s.blocks[ch].resize(s.log.blocks(logCh).size());
+            for (size_t b = 0; b < s.blocks[ch].size(); ++b)
+            {
+                pool.push(w, [&s, ch, logCh, b](TaskPool &, unsigned)
+                          { readBlock(s, ch, logCh, b); });
+            }
+        }
+    }
+    if (!s.csv.empty())
+    {
+        if (!mapFile(s.csv.c_str(), &s.csvBase, &s.csvLen))
+        {
+            s.err = s.csv + ": " + strerror(errno);
+            return;
+        }
+        std::vector<const char *> cuts(1, s.csvBase);
+        const char *end = s.csvBase + s.csvLen;
+        while (end - cuts.back() > CSV_CHUNK)
+        {
+            const char *p = cuts.back() + CSV_CHUNK;
+            const char *nl = (const char *)memchr(p, '\n', end - p);
+            if (!nl)
+                break;
+            cuts.push_back(nl + 1);
+        }
+        cuts.push_back(end);
+        s.pieces.resize(cuts.size() - 1);
+        for (size_t i = 0; i + 1 < cuts.size(); ++i)
+        {
+            const char *a = cuts[i], *b = cuts[i + 1];
+            pool.push(w, [&s, i, a, b](TaskPool &, unsigned) { readChunk(s, i, a, b); });
+        }
+    }
+}
+
+static void merge(Session &s)
+{
+    for (uint16_t ch : chans)
+    {
+        if (!s.blocks.empty())
+        {
+            for (const ChannelSummary &b : s.blocks[ch])
+            {
+                s.badBlocks += b.n == 0;
+                s.ch[ch].append(b, summarySpecs[ch]);
+            }
+        }
+        else
+        {
+            for (const Piece &p : s.pieces)
+                s.ch[ch].append(p.ch[ch], summarySpecs[ch]);
+        }
+    }
+    for (const Piece &p : s.pieces)
+        s.dtc.insert(s.dtc.end(), p.dtc.begin(), p.dtc.end());
+    s.blocks.clear();
+    s.pieces.clear();
+}
+
+// ==========================
+// Finding sessions
+// ==========================
+
+static bool endsWith(const std::string &s, const char *ext)
+{
+    const size_t n = strlen(ext);
+    return s.size() > n && !s.compare(s.size() - n, n, ext);
+}
+
+static void addFile(std::map<std::string, std::unique_ptr<Session>> &out, const std::string &path)
+{
+    const bool hbl = endsWith(path, ".hbl");
+    if (!hbl && !endsWith(path, ".csv"))
+        return;
+    const std::string name = path.substr(0, path.size() - 4);
+    std::unique_ptr<Session> &s = out[name];
+    if (!s)
+    {
+        s.reset(new Session);
+        s->name = name;
+    }
+    (hbl ? s->hbl : s->csv) = path;
+}
+
+static bool scan(const char *arg, std::map<std::string, std::unique_ptr<Session>> &out)
+{
+    struct stat st;
+    if (stat(arg, &st) != 0)
+        return false;
+    if (!S_ISDIR(st.st_mode))
+    {
+        addFile(out, arg);
+        return true;
+    }
+    DIR *d = opendir(arg);
+    if (!d)
+        return false;
+    std::string dir = arg;
+    if (dir.back() != '/')
+        dir += '/';
+    while (struct dirent *e = readdir(d))
+    {
+        if (e->d_name[0] != '.')
+            addFile(out, dir + e->d_name);
+    }
+    closedir(d);
+    return true;
+}
+
+// ==========================
+// Output
+// ==========================
+
+static std::string startTime(int64_t us)
+{
+    const time_t sec = us / 1000000;
+    struct tm tm;
+    char buf[32];
+    localtime_r(&sec, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return buf;
+}
+
+static std::string span(double s)
+{
+    char buf[32];
+    const long n = lround(s);
+    if (n >= 3600)
+        snprintf(buf, sizeof(buf), "%ldh%02ldm%02lds", n / 3600, n / 60 % 60, n % 60);
+    else
+        snprintf(buf, sizeof(buf), "%ldm%02lds", n / 60, n % 60);
+    return buf;
+}
+
+// code -> scans it was in
+static std::map<uint8_t, uint32_t> dtcCounts(const Session &s, uint32_t *withCodes)
+{
+    std::map<uint8_t, uint32_t> out;
+    *withCodes = 0;
+    for (const DtcScan &d : s.dtc)
+    {
+        *withCodes += !d.codes.empty();
+        for (uint8_t c : d.codes)
+            out[c]++;
+    }
+    return out;
+}
+
+static void histLine(const Session &s, uint16_t ch, const char *unit)
+{
+    const ChannelSummary &c = s.ch[ch];
+    const SummarySpec &sp = summarySpecs[ch];
+    if (!c.seconds)
+        return;
+    printf("  %-5s %% time at %s:", logSampleChannels[ch], unit);
+    for (int i = 0; i < SUMMARY_BINS; ++i)
+    {
+        if (c.binS[i] < c.seconds * 0.0005)
+            continue;
+        const float lo = sp.binLo + i * sp.binWidth;
+        if (i == SUMMARY_BINS - 1)
+            printf("  %g+ %.1f", lo, 100 * c.binS[i] / c.seconds);
+        else
+            printf("  %g-%g %.1f", lo, lo + sp.binWidth, 100 * c.binS[i] / c.seconds);
+    }
+    putchar('\n');
+}
+
+static void report(const Session &s)
+{
+    const ChannelSummary &rpm = s.ch[LOG_CH_RPM];
+    printf("%s (%s%s%s)\n", s.name.c_str(), s.hbl.empty() ? "" : "hbl",
+           !s.hbl.empty() && !s.csv.empty() ? ", " : "", s.csv.empty() ? "" : "csv");
+    if (!s.err.empty())
+    {
+        printf("  %s\n\n", s.err.c_str());
+        return;
+    }
+    if (!rpm.n)
+        printf("  no samples\n");
+    else
+    {
+        printf("  %s, span %s, logged %s, %llu samples, %.1f Hz", startTime(rpm.t0).c_str(),
+               span((rpm.t1 - rpm.t0) / 1e6).c_str(), span(rpm.seconds).c_str(),
+               (unsigned long long)rpm.n, rpm.seconds ? rpm.n / rpm.seconds : 0.0);
+        if (s.badBlocks)
+            printf(", %u bad blocks", s.badBlocks);
+        putchar('\n');
+        printf("  peak  rpm %.0f at +%s, vss %.0f km/h, map %.1f kPa, tps %.1f %%, maf %.0f\n",
+               rpm.max, span((rpm.maxAt - rpm.t0) / 1e6).c_str(), s.ch[LOG_CH_VSS].max,
+               s.ch[LOG_CH_MAP].max, s.ch[LOG_CH_TPS].max, s.ch[LOG_CH_MAF].max);
+        printf("  temp  ect %.1f..%.1f C, iat %.1f..%.1f C; batt %.2f..%.2f V, mean %.2f\n",
+               s.ch[LOG_CH_ECT].min, s.ch[LOG_CH_ECT].max, s.ch[LOG_CH_IAT].min,
+               s.ch[LOG_CH_IAT].max, s.ch[LOG_CH_BATT].min, s.ch[LOG_CH_BATT].max,
+               s.ch[LOG_CH_BATT].mean());
+        histLine(s, LOG_CH_RPM, "rpm");
+        histLine(s, LOG_CH_MAP, "kPa");
+        histLine(s, LOG_CH_TPS, "%");
+        histLine(s, LOG_CH_VSS, "km/h");
+        const ChannelSummary &o2 = s.ch[LOG_CH_O2];
+        if (o2.seconds)
+            printf("  o2    mean %.2f V, rich %.1f %% of the time, %.2f switches/s\n", o2.mean(),
+                   100 * o2.aboveS / o2.seconds, o2.crossings / o2.seconds);
+    }
+    if (s.csv.empty())
+        printf("  dtc   no csv, not known\n");
+    else if (s.dtc.empty())
+        printf("  dtc   never read\n");
+    else
+    {
+        uint32_t withCodes;
+        const std::map<uint8_t, uint32_t> codes = dtcCounts(s, &withCodes);
+        printf("  dtc   %zu scans, %u with codes", s.dtc.size(), withCodes);
+        for (const auto &c : codes)
+            printf("%s %02X x%u", &c == &*codes.begin() ? ":" : ",", c.first, c.second);
+        putchar('\n');
+    }
+    putchar('\n');
+}
+
+static void csvHeader()
+{
+    printf("session,start,span_s,logged_s,samples");
+    for (uint16_t ch : chans)
+        printf(",%s_min,%s_max,%s_mean", logSampleChannels[ch], logSampleChannels[ch],
+               logSampleChannels[ch]);
+    for (uint16_t ch : chans)
+    {
+        const SummarySpec &sp = summarySpecs[ch];
+        for (int i = 0; sp.binWidth > 0 && i < SUMMARY_BINS; ++i)
+            printf(",%s_%g_s", logSampleChannels[ch], sp.binLo + i * sp.binWidth);
+    }
+    printf(",o2_rich_s,o2_switches,dtc_scans,dtc_codes\n");
+}
+
+static void csvLine(const Session &s)
+{
+    const ChannelSummary &rpm = s.ch[LOG_CH_RPM];
+    printf("%s,%.6f,%.3f,%.3f,%llu", s.name.c_str(), rpm.t0 / 1e6, (rpm.t1 - rpm.t0) / 1e6,
+           rpm.seconds, (unsigned long long)rpm.n);
+    for (uint16_t ch : chans)
+        printf(",%g,%g,%g", s.ch[ch].min, s.ch[ch].max, s.ch[ch].mean());
+    for (uint16_t ch : chans)
+    {
+        for (int i = 0; summarySpecs[ch].binWidth > 0 && i < SUMMARY_BINS; ++i)
+            printf(",%.3f", s.ch[ch].binS[i]);
+    }
+    uint32_t withCodes;
+    const std::map<uint8_t, uint32_t> codes = dtcCounts(s, &withCodes);
+    printf(",%.3f,%u,%zu,", s.ch[LOG_CH_O2].aboveS, s.ch[LOG_CH_O2].crossings, s.dtc.size());
+    for (const auto &c : codes)
+        printf("%s%02X:%u", &c == &*codes.begin() ? "" : " ", c.first, c.second);
+    putchar('\n');
+}
+
+int main(int argc, char **argv)
+{
+    unsigned threads = 0;
+    bool csv = false;
+    int c;
+    while ((c = getopt(argc, argv, "j:ch")) != -1)
+    {
+        switch (c)
+        {
+        case 'j': threads = strtoul(optarg, nullptr, 0); break;
+        case 'c': csv = true; break;
+        default:
+            fprintf(stderr, "usage: %s [-j threads] [-c] dir|file...\n", argv[0]);
+            return 2;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-j threads] [-c] dir|file...\n", argv[0]);
+        return 2;
+    }
+
+    std::map<std::string, std::unique_ptr<Session>> byName;
+    for (int i = optind; i < argc; ++i)
+    {
+        if (!scan(argv[i], byName))
+        {
+            fprintf(stderr, "%s: %s\n", argv[i], strerror(errno));
+            return 1;
+        }
+    }
+    std::vector<Session *> sessions;
+    for (auto &kv : byName)
+        sessions.push_back(kv.second.get());
+
+    const uint64_t start = monoUs();
+    TaskPool pool(threads);
+    // the biggest first, so they split while the rest still queue
+    std::vector<std::pair<off_t, Session *>> bySize;
+    for (Session *s : sessions)
+    {
+        struct stat st;
+        off_t sz = 0;
+        if (!s->hbl.empty() && stat(s->hbl.c_str(), &st) == 0)
+            sz += st.st_size;
+        if (!s->csv.empty() && stat(s->csv.c_str(), &st) == 0)
+            sz += st.st_size;
+        bySize.push_back(std::make_pair(sz, s));
+    }
+    std::sort(bySize.begin(), bySize.end(),
+              [](const std::pair<off_t, Session *> &a, const std::pair<off_t, Session *> &b)
+              { return a.first > b.first; });
+    uint64_t bytes = 0;
+    for (size_t i = bySize.size(); i--;)
+    {
+        Session *s = bySize[i].second;
+        bytes += bySize[i].first;
+        // smallest first, a worker runs its newest: worker i starts on session i
+        pool.push(i, [s](TaskPool &p, unsigned w) { openSession(p, w, *s); });
+    }
+    pool.run();
+    for (Session *s : sessions)
+        merge(*s);
+    const double sec = (monoUs() - start) / 1e6;
+
+    uint64_t samples = 0;
+    if (csv)
+        csvHeader();
+    for (Session *s : sessions)
+    {
+        samples += s->ch[LOG_CH_RPM].n;
+        if (csv)
+        {
+            if (s->err.empty())
+                csvLine(*s);
+            else
+                fprintf(stderr, "%s\n", s->err.c_str());
+        }
+        else
+            report(*s);
+    }
+    fprintf(stderr, "%zu sessions, %.1f MB, %llu samples in %.3f s on %u threads: %.0f samples/s, "
+                    "%llu tasks, %llu stolen\n",
+            sessions.size(), bytes / 1e6, (unsigned long long)samples, sec, pool.workers(),
+            sec > 0 ? samples / sec : 0.0, (unsigned long long)pool.tasks(),
+            (unsigned long long)pool.steals());
+    return 0;
+}
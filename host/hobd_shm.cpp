@@ -0,0 +1,192 @@
+#include "hobd_shm.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <libgen.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void hobd_shm_name(char *out, size_t n, const char *device)
+{
+    char dev[64];
+    snprintf(dev, sizeof(dev), "%s", device);
+    snprintf(out, n, "/hobd-%s", basename(dev));
+}
+
+static size_t segmentLen(uint32_t slots)
+{
+    return sizeof(ShmHeader) + (size_t)slots * sizeof(ShmSlot);
+}
+
+bool ShmWriter::create(const char *name, const char *device, uint32_t n)
+{
+    close();
+    if (!n || (n & (n - 1)))
+        return false;
+
+    // a new inode, so readers of a previous run see alive == 0 and
+    // reattach instead of reading a segment that is being reset
+    shm_unlink(name);
+    const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+    const size_t len = segmentLen(n);
+    void *p = MAP_FAILED;
+    if (ftruncate(fd, len) == 0)
+        p = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        shm_unlink(name);
+        return false;
+    }
+
+    // ftruncate zero fills: every slot seq is 0, i.e. never written
+    hdr = static_cast<ShmHeader *>(p);
+    slots = reinterpret_cast<ShmSlot *>(static_cast<uint8_t *>(p) + sizeof(ShmHeader));
+    mapLen = len;
+    next = 0;
+
+    hdr->version = SHM_VERSION;
+    hdr->sampleSize = sizeof(HobdSample);
+    hdr->slots = n;
+    hdr->writerPid = (uint32_t)getpid();
+    snprintf(hdr->device, sizeof(hdr->device), "%s", device);
+    hdr->published.store(0, std::memory_order_relaxed);
+    hdr->alive.store(1, std::memory_order_relaxed);
+    // readers check the magic last
+    std::atomic_thread_fence(std::memory_order_release);
+    hdr->magic = SHM_MAGIC;
+    return true;
+}
+
+void ShmWriter::close()
+{
+    if (!hdr)
+        return;
+    hdr->alive.store(0, std::memory_order_release);
+    munmap(hdr, mapLen);
+    // the name stays so late readers still find the last samples
+    hdr = nullptr;
+    slots = nullptr;
+}
+
+void ShmWriter::publish(const HobdSample &s)
+{
+    if (!hdr)
+        return;
+    ShmSlot &slot = slots[next & (hdr->slots - 1)];
+    slot.seq.store(2 * next + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.s = s;
+    slot.seq.store(2 * next + 2, std::memory_order_release);
+    hdr->published.store(++next, std::memory_order_release);
+}
+
+bool ShmReader::attach(const char *name)
+{
+    detach();
+    const int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    void *p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ShmHeader))
+        p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+        return false;
+
+    const ShmHeader *h = static_cast<const ShmHeader *>(p);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (h->magic != SHM_MAGIC || h->version != SHM_VERSION ||
+        h->sampleSize != sizeof(HobdSample) || segmentLen(h->slots) > (size_t)st.st_size)
+    {
+        munmap(p, st.st_size);
+        return false;
+    }
+    hdr = h;
+    slots = reinterpret_cast<const ShmSlot *>(static_cast<const uint8_t *>(p) + sizeof(ShmHeader));
+    mapLen = st.st_size;
+    pid = h->writerPid;
+    ino = st.st_ino;
+    shmName = name;
+    // start at the newest sample, not the whole history
+    const uint64_t pub = h->published.load(std::memory_order_acquire);
+    cursor = pub ? pub - 1 : 0;
+    lost = 0;
+    return true;
+}
+
+void ShmReader::detach()
+{
+    if (!hdr)
+        return;
+    munmap(const_cast<ShmHeader *>(hdr), mapLen);
+    hdr = nullptr;
+    slots = nullptr;
+}
+
+bool ShmReader::stale() const
+{
+    if (!hdr)
+        return true;
+    // a killed writer never clears alive
+    if (hdr->alive.load(std::memory_order_acquire) && !(kill(pid, 0) < 0 && errno == ESRCH))
+        return false;
+    // a restarted one makes a new inode under the same name
+    const int fd = shm_open(shmName.c_str(), O_RDONLY | O_CLOEXEC, 0);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    const bool moved = fstat(fd, &st) == 0 && (uint64_t)st.st_ino != ino;
+    ::close(fd);
+    return moved;
+}
+
+bool ShmReader::copySlot(uint64_t index, HobdSample &out) const
+{
+    const ShmSlot &slot = slots[index & (hdr->slots - 1)];
+    const uint64_t want = 2 * index + 2;
+    if (slot.seq.load(std::memory_order_acquire) != want)
+        return false;
+    out = slot.s;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == want;
+}
+
+size_t ShmReader::read(HobdSample *out, size_t max)
+{
+    if (!hdr)
+        return 0;
+    const uint64_t pub = hdr->published.load(std::memory_order_acquire);
+    if (pub - cursor > hdr->slots)
+    {
+        // lapped while we were away
+        lost += pub - hdr->slots - cursor;
+        cursor = pub - hdr->slots;
+    }
+
+    size_t n = 0;
+    while (n < max && cursor < pub)
+    {
+        if (copySlot(cursor, out[n]))
+            ++n;
+        else
+            ++lost; // overwritten mid copy
+        ++cursor;
+    }
+    return n;
+}
+
+bool ShmReader::latest(HobdSample &out) const
+{
+    if (!hdr)
+        return false;
+    const uint64_t pub = hdr->published.load(std::memory_order_acquire);
+    return pub && copySlot(pub - 1, out);
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+// ==========================
+// Shared memory sample ring
+// ==========================
+// The logger publishes every decoded sample into /dev/shm/hobd-<device>,
+// any number of local processes map it read only and follow along without
+// a syscall per sample and without touching the serial port.
+//
+// One writer, many readers, no locks. Each slot carries a sequence word:
+// odd while the writer is filling it, 2 * (index + 1) once sample `index`
+// is complete. A reader copies the slot and checks the word before and
+// after; a mismatch means it was lapped and the sample is counted lost.
+#define SHM_MAGIC 0x48424453 // "HBDS"
+#define SHM_VERSION 1
+#define SHM_DEFAULT_SLOTS 4096 // power of two, ~7 min at 10 Hz
+
+// One decoded MSG_LIVE sample, physical units
+struct HobdSample
+{
+    double tHost;   // wall clock seconds
+    uint32_t devUs; // device micros() at the sample
+    uint16_t seq;   // telemetry sequence
+    uint16_t flags; // LIVE_FLG_
+    float rpm, vss, ect, iat, map, tps, batt, o2, maf;
+};
+
+struct alignas(64) ShmHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t sampleSize;
+    uint32_t slots;
+    uint32_t writerPid;
+    std::atomic<uint32_t> alive; // cleared when the writer closes
+    char device[64];
+    alignas(64) std::atomic<uint64_t> published; // samples written so far
+};
+
+struct alignas(64) ShmSlot
+{
+    std::atomic<uint64_t> seq;
+    HobdSample s;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "needs lock free 64 bit atomics");
+
+// "/dev/ttyUSB0" -> "/hobd-ttyUSB0", the shm_open name
+void hobd_shm_name(char *out, size_t n, const char *device);
+
+class ShmWriter
+{
+public:
+    ~ShmWriter() { close(); }
+
+    // Create (or replace) the segment, slots must be a power of two
+    bool create(const char *name, const char *device, uint32_t slots = SHM_DEFAULT_SLOTS);
+    void close();
+    bool isOpen() const { return hdr != nullptr; }
+
+    void publish(const HobdSample &s);
+
+private:
+    ShmHeader *hdr = nullptr;
+    ShmSlot *slots = nullptr;
+    size_t mapLen = 0;
+    uint64_t next = 0;
+};
+
+class ShmReader
+{
+public:
+    ~ShmReader() { detach(); }
+
+    bool attach(const char *name);
+    void detach();
+    bool isAttached() const { return hdr != nullptr; }
+    // The writer is gone (closed, killed, crashed) and the name now holds
+    // another segment: detach and attach again. Until a new writer comes
+    // the old segment stays attached with its last samples.
+    bool stale() const;
+
+    // Copy up to max samples newer than the last call. Starts at the
+    // newest sample; anything overwritten before it was read is lost.
+    size_t read(HobdSample *out, size_t max);
+    // Newest complete sample, false if there is none yet
+    bool latest(HobdSample &out) const;
+
+    const char *device() const { return hdr ? hdr->device : ""; }
+    uint64_t lost = 0;
+
+private:
+    bool copySlot(uint64_t index, HobdSample &out) const;
+
+    const ShmHeader *hdr = nullptr;
+    const ShmSlot *slots = nullptr;
+    size_t mapLen = 0;
+    uint32_t pid = 0;
+    uint64_t ino = 0; // of the segment, to tell a new one under the same name
+    std::string shmName;
+    uint64_t cursor = 0;
+};
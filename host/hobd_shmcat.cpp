@@ -0,0 +1,90 @@
+// hobd_shmcat: follow the samples hobd_logd -m publishes in /dev/shm.
+//
+// A minimal ShmReader client, and a quick way to watch a running logger
+// without a second process opening the serial port.
+//
+//   hobd_shmcat [-l] device
+//     -l  only print the newest sample, once a second
+
+#include "hobd_shm.hpp"
+
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stopping = 0;
+static void onSignal(int) { stopping = 1; }
+
+static void print(const HobdSample &s)
+{
+    printf("%.6f,%lu,%u,%.0f,%.0f,%.1f,%.1f,%.1f,%.1f,%.2f,%.2f,%u,%.0f\n",
+           s.tHost, (unsigned long)s.devUs, s.seq, s.rpm, s.vss, s.ect, s.iat, s.map,
+           s.tps, s.batt, s.o2, s.flags, s.maf);
+}
+
+int main(int argc, char **argv)
+{
+    bool latestOnly = false;
+    int c;
+    while ((c = getopt(argc, argv, "lh")) != -1)
+    {
+        if (c != 'l')
+        {
+            fprintf(stderr, "usage: %s [-l] device\n", argv[0]);
+            return 2;
+        }
+        latestOnly = true;
+    }
+    if (optind != argc - 1)
+    {
+        fprintf(stderr, "usage: %s [-l] device\n", argv[0]);
+        return 2;
+    }
+
+    char name[80];
+    hobd_shm_name(name, sizeof(name), argv[optind]);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    ShmReader rd;
+    HobdSample buf[64];
+    bool waiting = false;
+    while (!stopping)
+    {
+        if (rd.stale())
+        {
+            if (!rd.attach(name))
+            {
+                if (!waiting)
+                    fprintf(stderr, "waiting for %s\n", name);
+                waiting = true;
+                sleep(1);
+                continue;
+            }
+            waiting = false;
+            fprintf(stderr, "attached to %s (%s)\n", name, rd.device());
+        }
+
+        if (latestOnly)
+        {
+            if (rd.latest(buf[0]))
+                print(buf[0]);
+            fflush(stdout);
+            sleep(1);
+            continue;
+        }
+
+        // samples come at ECU pace (tens of Hz), a short nap is plenty
+        const size_t n = rd.read(buf, 64);
+        for (size_t i = 0; i < n; ++i)
+            print(buf[i]);
+        if (n)
+            fflush(stdout);
+        else
+            usleep(20000);
+    }
+    if (rd.lost)
+        fprintf(stderr, "lost %llu samples\n", (unsigned long long)rd.lost);
+    return 0;
+}
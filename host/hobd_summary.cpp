@@ -0,0 +1,105 @@
+#include "hobd_summary.hpp"
+#include "hobd_column.hpp"
+
+#include <math.h>
+
+const SummarySpec summarySpecs[LOG_SAMPLE_CHANNELS] = {
+    {0, 500, NAN},   // rpm
+    {0, 10, NAN},    // vss, km/h
+    {0, 0, NAN},     // ect
+    {0, 0, NAN},     // iat
+    {0, 10, NAN},    // map, kPa: load
+    {0, 10, NAN},    // tps, %
+    {0, 0, NAN},     // batt
+    {0, 0, 0.45f},   // o2: rich above 0.45 V, crossings are switches
+    {0, 0, NAN},     // maf
+    {0, 0, NAN},     // flags
+    {0, 0, NAN},     // seq
+};
+
+// v held for dt µs, weighed the way col_weights() and col_hist() do
+static void credit(ChannelSummary &s, float v, int64_t dt, const SummarySpec &spec)
+{
+    if (dt <= 0 || dt > SUMMARY_GAP_US)
+        return;
+    const float sec = (float)(int32_t)dt * 1e-6f;
+    s.seconds += sec;
+    if (spec.binWidth > 0)
+        s.binS[col_bin(v, spec.binLo, 1 / spec.binWidth, SUMMARY_BINS)] += sec;
+    if (v > spec.threshold)
+        s.aboveS += sec;
+}
+
+static bool crossed(float a, float b, const SummarySpec &spec)
+{
+    // never for a NAN threshold, both sides compare false
+    return (a > spec.threshold) != (b > spec.threshold);
+}
+
+void ChannelSummary::add(const int64_t *t, const float *v, size_t cnt, const SummarySpec &spec)
+{
+    // the weights live on the stack, a csv chunk goes in block sized runs
+    static const size_t RUN = LOG_MAX_BLOCK_SAMPLES;
+    for (; cnt > RUN; t += RUN, v += RUN, cnt -= RUN)
+        add(t, v, RUN, spec);
+    if (!cnt)
+        return;
+    if (n)
+    {
+        credit(*this, v1, t[0] - t1, spec);
+        crossings += crossed(v1, v[0], spec);
+    }
+    else
+    {
+        t0 = t[0];
+        v0 = min = max = v[0];
+        maxAt = t[0];
+    }
+
+    float w[RUN];
+    col_weights(t, cnt, SUMMARY_GAP_US, w);
+    seconds += col_sum(w, cnt);
+    if (spec.binWidth > 0)
+        col_hist(v, w, cnt, spec.binLo, spec.binWidth, SUMMARY_BINS, binS);
+    if (!isnan(spec.threshold))
+        crossings += col_above(v, w, cnt, spec.threshold, &aboveS);
+    float lo, hi;
+    col_minmax(v, cnt, &lo, &hi);
+    sum += col_sum(v, cnt);
+    min = lo < min ? lo : min;
+    if (hi > max)
+    {
+        max = hi;
+        const size_t at = col_find_ge(v, cnt, hi);
+        maxAt = t[at < cnt ? at : cnt - 1];
+    }
+    n += cnt;
+    t1 = t[cnt - 1];
+    v1 = v[cnt - 1];
+}
+void ChannelSummary::append(const ChannelSummary &next, const SummarySpec &spec)
+{
+    if (!next.n)
+        return;
+    if (!n)
+    {
+        *this = next;
+        return;
+    }
+    credit(*this, v1, next.t0 - t1, spec);
+    crossings += crossed(v1, next.v0, spec) + next.crossings;
+    n += next.n;
+    sum += next.sum;
+    min = next.min < min ? next.min : min;
+    if (next.max > max)
+    {
+        max = next.max;
+        maxAt = next.maxAt;
+    }
+    seconds += next.seconds;
+    for (int i = 0; i < SUMMARY_BINS; ++i)
+        binS[i] += next.binS[i];
+    aboveS += next.aboveS;
+    t1 = next.t1;
+    v1 = next.v1;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hobd_log.hpp" // LOG_SAMPLE_CHANNELS
+
+// ==========================
+// Channel summaries
+// ==========================
+// Running statistics of one channel over a stretch of samples in time
+// order. Stretches (a log block, a piece of a csv) are summarised on
+// their own and appended in time order afterwards, the gap between two of
+// them counted then, so one session can be spread over any number of
+// threads and still add up to the numbers of a single pass.
+//
+// Time weighs each sample by the gap to the next one. A gap longer than
+// SUMMARY_GAP_US (logger stopped, device unplugged) counts as no time.
+// The per sample work is done by the column kernels, hobd_column.hpp.
+#define SUMMARY_GAP_US 2000000
+#define SUMMARY_BINS 16
+
+struct SummarySpec
+{
+    float binLo, binWidth; // time-at histogram, last bin open ended; width 0 = none
+    float threshold;       // time above and crossings; NAN = none
+};
+// Per LogChannel
+extern const SummarySpec summarySpecs[LOG_SAMPLE_CHANNELS];
+
+struct ChannelSummary
+{
+    uint64_t n = 0;
+    double sum = 0;
+    float min = 0, max = 0;
+    int64_t maxAt = 0;      // first sample at max, µs
+    int64_t t0 = 0, t1 = 0; // first and last sample, µs
+    float v0 = 0, v1 = 0;
+    double seconds = 0; // weighted time, up to t1
+    double binS[SUMMARY_BINS] = {};
+    double aboveS = 0;
+    uint32_t crossings = 0;
+
+    // n samples following the ones already in
+    void add(const int64_t *t, const float *v, size_t n, const SummarySpec &spec);
+    // next follows this summary in time
+    void append(const ChannelSummary &next, const SummarySpec &spec);
+
+    double mean() const { return n ? sum / n : 0; }
+};
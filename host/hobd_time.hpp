@@ -0,0 +1,29 @@
+#pragma once
+#include <stdint.h>
+#include <time.h>
+
+// Monotonic clock for deadlines and latencies
+static inline uint64_t monoUs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline uint64_t monoMs() { return monoUs() / 1000; }
+
+// for timing code that runs in well under a µs
+static inline uint64_t monoNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Wall clock seconds, what goes in the logs
+static inline double wallTime()
+{
+    timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
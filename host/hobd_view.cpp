@@ -0,0 +1,347 @@
+#include "hobd_view.hpp"
+#include "hobd_column.hpp"
+#include "hobd_crc.hpp"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+static_assert(sizeof(ViewBucket) == 48, "pyramid files depend on the bucket layout");
+
+// ==========================
+// LTTB
+// ==========================
+
+void lttb(const int64_t *t, const float *v, size_t len, size_t n, std::vector<ViewPoint> &out)
+{
+    out.clear();
+    n = n < 3 ? 3 : n;
+    if (len <= n)
+    {
+        for (size_t i = 0; i < len; ++i)
+            out.push_back(ViewPoint{t[i], v[i]});
+        return;
+    }
+    out.reserve(n);
+    out.push_back(ViewPoint{t[0], v[0]});
+    // x in µs from the first point, doubles: hours of µs do not fit a float
+    const double every = (double)(len - 2) / (n - 2);
+    size_t a = 0;
+    for (size_t i = 0; i < n - 2; ++i)
+    {
+        const size_t lo = (size_t)(i * every) + 1;
+        const size_t hi = (size_t)((i + 1) * every) + 1;
+        // the next bucket, for the last one the last point
+        const size_t nlo = hi;
+        const size_t nhi = std::min((size_t)((i + 2) * every) + 1, len);
+        double mx = 0;
+        for (size_t j = nlo; j < nhi; ++j)
+            mx += t[j] - t[0];
+        mx /= nhi - nlo;
+        const double my = col_sum(v + nlo, nhi - nlo) / (nhi - nlo);
+
+        const double ax = t[a] - t[0], ay = v[a];
+        double best = -1;
+        size_t pick = lo;
+        for (size_t j = lo; j < hi; ++j)
+        {
+            // twice the triangle's area
+            const double area = fabs((ax - mx) * (v[j] - ay) - (ax - (t[j] - t[0])) * (my - ay));
+            if (area > best)
+            {
+                best = area;
+                pick = j;
+            }
+        }
+        out.push_back(ViewPoint{t[pick], v[pick]});
+        a = pick;
+    }
+    out.push_back(ViewPoint{t[len - 1], v[len - 1]});
+}
+
+// ==========================
+// Pyramid
+// ==========================
+
+// the run (t, v) follows what b holds
+static void fold(ViewBucket &b, const int64_t *t, const float *v, size_t n)
+{
+    float lo, hi;
+    col_minmax(v, n, &lo, &hi);
+    if (!b.count)
+        b.t0 = t[0];
+    if (!b.count || lo < b.min)
+    {
+        b.min = lo;
+        const size_t at = col_find_le(v, n, lo);
+        b.tMin = t[at < n ? at : n - 1];
+    }
+    if (!b.count || hi > b.max)
+    {
+        b.max = hi;
+        const size_t at = col_find_ge(v, n, hi);
+        b.tMax = t[at < n ? at : n - 1];
+    }
+    b.t1 = t[n - 1];
+    b.count += n;
+}
+
+// next follows b
+static void merge(ViewBucket &b, const ViewBucket &next)
+{
+    if (next.min < b.min)
+    {
+        b.min = next.min;
+        b.tMin = next.tMin;
+    }
+    if (next.max > b.max)
+    {
+        b.max = next.max;
+        b.tMax = next.tMax;
+    }
+    b.t1 = next.t1;
+    b.count += next.count;
+}
+
+void LogView::build()
+{
+    pyr.assign(rd.channels(), std::vector<std::vector<ViewBucket>>());
+    std::vector<int64_t> t(LOG_MAX_BLOCK_SAMPLES);
+    std::vector<float> v(LOG_MAX_BLOCK_SAMPLES);
+    for (uint16_t ch = 0; ch < rd.channels(); ++ch)
+    {
+        std::vector<ViewBucket> level;
+        ViewBucket cur = ViewBucket();
+        for (size_t b = 0; b < rd.blocks(ch).size(); ++b)
+        {
+            const uint32_t n = rd.read(ch, b, t.data(), v.data());
+            for (uint32_t i = 0; i < n;)
+            {
+                const uint32_t m = std::min(n - i, (uint32_t)VIEW_BASE - cur.count);
+                fold(cur, &t[i], &v[i], m);
+                i += m;
+                if (cur.count == VIEW_BASE)
+                {
+                    level.push_back(cur);
+                    cur = ViewBucket();
+                }
+            }
+        }
+        if (cur.count)
+            level.push_back(cur);
+        if (level.empty())
+            continue;
+
+        std::vector<std::vector<ViewBucket>> &p = pyr[ch];
+        p.push_back(std::move(level));
+        while (p.back().size() > 1 && p.size() < VIEW_MAX_LEVELS)
+        {
+            const std::vector<ViewBucket> &below = p.back();
+            std::vector<ViewBucket> up;
+            up.reserve(below.size() / VIEW_FANOUT + 1);
+            for (size_t i = 0; i < below.size(); i += VIEW_FANOUT)
+            {
+                ViewBucket u = below[i];
+                for (size_t j = i + 1; j < below.size() && j < i + VIEW_FANOUT; ++j)
+                    merge(u, below[j]);
+                up.push_back(u);
+            }
+            p.push_back(std::move(up));
+        }
+    }
+}
+
+static uint16_t bucketsCrc(uint16_t crc, const std::vector<ViewBucket> &v)
+{
+    for (const ViewBucket &b : v)
+        crc = crc16_update(crc, reinterpret_cast<const uint8_t *>(&b), sizeof(b));
+    return crc;
+}
+
+static uint16_t viewHeaderCrc(ViewFileHeader h)
+{
+    h.crc = 0;
+    return crc16(reinterpret_cast<const uint8_t *>(&h), sizeof(h));
+}
+
+bool LogView::load(const std::string &path, const ViewFileHeader &want)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+    ViewFileHeader h;
+    bool ok = fread(&h, sizeof(h), 1, f) == 1 && h.magic == want.magic &&
+              h.version == want.version && h.channels == want.channels &&
+              h.logCreatedUs == want.logCreatedUs && h.logBytes == want.logBytes &&
+              h.logBlocks == want.logBlocks && h.base == want.base && h.fanout == want.fanout;
+    uint16_t crc = ok ? viewHeaderCrc(h) : 0;
+    pyr.assign(want.channels, std::vector<std::vector<ViewBucket>>());
+    for (uint16_t ch = 0; ok && ch < h.channels; ++ch)
+    {
+        for (int l = 0; ok && l < VIEW_MAX_LEVELS && h.buckets[ch][l]; ++l)
+        {
+            std::vector<ViewBucket> level(h.buckets[ch][l]);
+            ok = fread(level.data(), sizeof(ViewBucket), level.size(), f) == level.size();
+            crc = bucketsCrc(crc, level);
+            pyr[ch].push_back(std::move(level));
+        }
+    }
+    ok = ok && fgetc(f) == EOF && crc == h.crc;
+    fclose(f);
+    if (!ok)
+        pyr.clear();
+    return ok;
+}
+
+bool LogView::save(const std::string &path, ViewFileHeader h) const
+{
+    for (uint16_t ch = 0; ch < h.channels; ++ch)
+    {
+        for (size_t l = 0; l < pyr[ch].size(); ++l)
+            h.buckets[ch][l] = (uint32_t)pyr[ch][l].size();
+    }
+    h.crc = 0;
+    uint16_t crc = viewHeaderCrc(h);
+    for (const auto &levels : pyr)
+    {
+        for (const std::vector<ViewBucket> &level : levels)
+            crc = bucketsCrc(crc, level);
+    }
+    h.crc = crc;
+
+    // whole or not at all: a reader never sees half a pyramid
+    const std::string tmp = path + ".tmp";
+    FILE *f = fopen(tmp.c_str(), "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    for (const auto &levels : pyr)
+    {
+        for (const std::vector<ViewBucket> &level : levels)
+            ok = ok && fwrite(level.data(), sizeof(ViewBucket), level.size(), f) == level.size();
+    }
+    ok = fclose(f) == 0 && ok;
+    if (ok && rename(tmp.c_str(), path.c_str()) == 0)
+        return true;
+    unlink(tmp.c_str());
+    return false;
+}
+
+bool LogView::open(const char *path)
+{
+    rebuilt = wrote = false;
+    pyr.clear();
+    struct stat st;
+    if (!rd.open(path) || stat(path, &st) != 0)
+        return false;
+
+    ViewFileHeader want;
+    memset(&want, 0, sizeof(want));
+    want.magic = VIEW_MAGIC;
+    want.version = VIEW_VERSION;
+    want.channels = rd.channels();
+    want.logCreatedUs = rd.header().createdUs;
+    want.logBytes = st.st_size;
+    want.logBlocks = (uint32_t)rd.index().size();
+    want.base = VIEW_BASE;
+    want.fanout = VIEW_FANOUT;
+
+    const std::string side = std::string(path) + ".hbp";
+    if (load(side, want))
+        return true;
+    build();
+    rebuilt = true;
+    wrote = save(side, want);
+    return true;
+}
+
+// ==========================
+// Queries
+// ==========================
+
+void LogView::downsample(uint16_t ch, int64_t from, int64_t to, size_t n,
+                         std::vector<ViewPoint> &out, ViewQuery *q) const
+{
+    ViewQuery dummy;
+    if (!q)
+        q = &dummy;
+    *q = ViewQuery();
+    out.clear();
+    if (ch >= rd.channels() || from > to)
+        return;
+    n = n < 3 ? 3 : n;
+
+    const std::vector<LogIndexEntry> &bl = rd.blocks(ch);
+    const size_t b0 = rd.seek(ch, from);
+    size_t b1 = b0;
+    for (; b1 < bl.size() && bl[b1].t0 <= to; ++b1)
+        q->samples += bl[b1].count;
+    if (!q->samples)
+        return;
+
+    std::vector<int64_t> t;
+    std::vector<float> v;
+    // as many as the pyramid would hand LTTB at most are cheaper raw
+    if (q->samples <= VIEW_RAW_MAX || q->samples <= 2 * VIEW_FANOUT * n || pyr[ch].empty())
+    {
+        static thread_local int64_t bt[LOG_MAX_BLOCK_SAMPLES];
+        static thread_local float bv[LOG_MAX_BLOCK_SAMPLES];
+        t.reserve(q->samples);
+        v.reserve(q->samples);
+        for (size_t b = b0; b < b1; ++b)
+        {
+            const uint32_t cnt = rd.read(ch, b, bt, bv);
+            for (uint32_t i = 0; i < cnt; ++i)
+            {
+                if (bt[i] >= from && bt[i] <= to)
+                {
+                    t.push_back(bt[i]);
+                    v.push_back(bv[i]);
+                }
+            }
+        }
+    }
+    else
+    {
+        const std::vector<std::vector<ViewBucket>> &p = pyr[ch];
+        size_t l = p.size(), first = 0, last = 0;
+        while (l--)
+        {
+            const std::vector<ViewBucket> &lv = p[l];
+            first = std::lower_bound(lv.begin(), lv.end(), from,
+                                     [](const ViewBucket &b, int64_t x) { return b.t1 < x; }) -
+                    lv.begin();
+            last = std::upper_bound(lv.begin(), lv.end(), to,
+                                    [](int64_t x, const ViewBucket &b) { return x < b.t0; }) -
+                   lv.begin();
+            if (last - first >= n || !l)
+                break;
+        }
+        q->level = (int)l;
+        t.reserve(2 * (last - first));
+        v.reserve(2 * (last - first));
+        for (size_t i = first; i < last; ++i)
+        {
+            // the buckets at the ends stick out of the range
+            const ViewBucket &b = p[l][i];
+            const bool minFirst = b.tMin <= b.tMax;
+            const int64_t ta = minFirst ? b.tMin : b.tMax, tb = minFirst ? b.tMax : b.tMin;
+            if (ta >= from && ta <= to)
+            {
+                t.push_back(ta);
+                v.push_back(minFirst ? b.min : b.max);
+            }
+            if (tb != ta && tb >= from && tb <= to)
+            {
+                t.push_back(tb);
+                v.push_back(minFirst ? b.max : b.min);
+            }
+        }
+    }
+    q->candidates = t.size();
+    lttb(t.data(), v.data(), t.size(), n, out);
+}
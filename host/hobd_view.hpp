@@ -0,0 +1,110 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "hobd_log.hpp"
+
+// ==========================
+// Plot view of a log
+// ==========================
+// Any channel of a columnar log, any time range, thinned to the n points
+// a plot has room for, in time that does not grow with the log.
+//
+// Next to log.hbl sits log.hbl.hbp: per channel a pyramid of min / max
+// buckets, level 0 VIEW_BASE consecutive samples each, every level above
+// VIEW_FANOUT buckets of the one below. A bucket keeps its span, its min
+// and max and when they were. open() builds the pyramid when the file is
+// missing or was made for an earlier state of the log (a running logger
+// appends), and saves it when the directory allows; else it only lives
+// in memory.
+//
+// downsample() reads ranges of up to VIEW_RAW_MAX samples from the log
+// blocks and thins them with Largest-Triangle-Three-Buckets. Longer ones
+// take the coarsest level with at least n buckets in range, the min and
+// max sample of each (2 to 2 * VIEW_FANOUT per point out), and thin those
+// to n with the same LTTB (MinMaxLTTB): a spike in a bucket is always a
+// candidate, where striding or averaging would lose it, the plot looks
+// like the full resolution one, and the cost is a bisection per level
+// and O(n) whatever the range covers.
+#define VIEW_MAGIC 0x50444248 // "HBDP"
+#define VIEW_VERSION 1
+#define VIEW_BASE 128
+#define VIEW_FANOUT 8
+#define VIEW_MAX_LEVELS 8
+#define VIEW_RAW_MAX 65536
+
+struct ViewBucket
+{
+    int64_t t0, t1;     // first and last sample
+    int64_t tMin, tMax; // first sample at min / max
+    float min, max;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+struct ViewFileHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t channels;
+    // the log it was made for
+    int64_t logCreatedUs;
+    uint64_t logBytes;
+    uint32_t logBlocks;
+    uint16_t base, fanout;
+    // buckets follow channel by channel, level by level
+    uint32_t buckets[LOG_MAX_CHANNELS][VIEW_MAX_LEVELS];
+    uint16_t crc; // CRC-16 of this header with crc = 0, then the buckets
+    uint16_t reserved;
+    uint32_t reserved2;
+};
+
+struct ViewPoint
+{
+    int64_t t; // µs
+    float v;
+};
+
+// How a downsample() was answered
+struct ViewQuery
+{
+    int level = -1;        // pyramid level, -1 = from the log blocks
+    uint64_t samples = 0;  // in range, from the block index
+    size_t candidates = 0; // points LTTB picked from
+};
+
+// Largest-Triangle-Three-Buckets: n of the len points (t, v), first and
+// last always, in between per bucket of (len - 2) / (n - 2) the one with
+// the largest triangle between the point kept before it and the mean of
+// the next bucket. All points if len <= n; n >= 3.
+void lttb(const int64_t *t, const float *v, size_t len, size_t n, std::vector<ViewPoint> &out);
+
+class LogView
+{
+public:
+    // Open path and its pyramid, path + ".hbp"
+    bool open(const char *path);
+    const LogReader &log() const { return rd; }
+    // true if open() had to build the pyramid
+    bool built() const { return rebuilt; }
+    // false if it was built but could not be saved
+    bool saved() const { return wrote; }
+    size_t levels(uint16_t ch) const { return pyr[ch].size(); }
+
+    // At most n (>= 3) points of ch over [from, to], µs; empty if none
+    void downsample(uint16_t ch, int64_t from, int64_t to, size_t n, std::vector<ViewPoint> &out,
+                    ViewQuery *q = nullptr) const;
+
+private:
+    void build();
+    bool load(const std::string &path, const ViewFileHeader &want);
+    bool save(const std::string &path, ViewFileHeader h) const;
+
+    LogReader rd;
+    bool rebuilt = false, wrote = false;
+    // [channel][level]
+    std::vector<std::vector<std::vector<ViewBucket>>> pyr;
+};
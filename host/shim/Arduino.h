@@ -0,0 +1,15 @@
+#pragma once
+// Just enough of the Arduino core to build the shared firmware sources
+// (../src/hobd_crc.cpp, ../src/hobd_cobs.cpp, ../src/hobd_uni2.cpp) into
+// the host tools.
+#include <math.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/pgmspace.h>
+
+// The time functions are the linking program's, hobd_ktreplay runs them
+// on a virtual clock
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
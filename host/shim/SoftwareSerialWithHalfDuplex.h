@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+
+// The K-line port ECUData talks through. The host build has no pins: a
+// tool derives from this and decides where the bytes come from.
+class SoftwareSerialWithHalfDuplex
+{
+public:
+    SoftwareSerialWithHalfDuplex(uint8_t, uint8_t, bool = false, bool = false) {}
+    virtual ~SoftwareSerialWithHalfDuplex() {}
+
+    void begin(long) {}
+    bool listen() { return true; }
+    virtual size_t write(uint8_t b) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+};
@@ -0,0 +1,5 @@
+#pragma once
+// Flash and RAM are the same thing on the host
+#define PROGMEM
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define pgm_read_word(p) (*(const uint16_t *)(p))
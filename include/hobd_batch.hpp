@@ -0,0 +1,43 @@
+#pragma once
+#include <Arduino.h>
+
+// ==========================
+// Batched link
+// ==========================
+// Stream wrapper for UART Bluetooth modules (HC-05/HC-06 SPP). Writes are
+// collected and handed to the module in chunks of its packet size, so a
+// burst of small telemetry frames costs one radio packet instead of one
+// each. A partly filled batch goes out once it is flushMs old. Multi-byte
+// writes start a new batch rather than straddle two, so write whole
+// frames in one call.
+class BatchStream : public Stream
+{
+public:
+    BatchStream(Stream &io_in, uint8_t *buf_in, uint8_t size_in, uint16_t flushMs_in)
+        : io(io_in), buf(buf_in), size(size_in), flushMs(flushMs_in)
+    {
+    }
+
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t *p, size_t n) override;
+    using Print::write;
+    int available() override { return io.available(); }
+    int read() override { return io.read(); }
+    int peek() override { return io.peek(); }
+    int availableForWrite() override { return size; }
+    void flush() override;
+
+    // Send the batch once its deadline has passed, call from loop()
+    void poll();
+
+    uint32_t batches = 0;
+    uint32_t bytes = 0;
+
+private:
+    Stream &io;
+    uint8_t *buf;
+    uint8_t size;
+    uint16_t flushMs;
+    uint8_t len = 0;
+    uint32_t firstMs = 0;
+};
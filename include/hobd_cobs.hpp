@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+// ==========================
+// COBS framing
+// ==========================
+// Consistent Overhead Byte Stuffing: the encoded frame has no 0x00 bytes,
+// so a single 0x00 marks the end of every frame and a receiver can resync
+// on the next delimiter after any corruption.
+#define COBS_DELIM 0x00
+// one code byte per 254 data bytes, frames here are always shorter
+#define COBS_MAX_DATA 253
+
+// Encode in place. buf[1..len] holds the data, buf[0] is scratch for the
+// first code byte. Returns the encoded length (len + 1), delimiter not
+// included. len must be <= COBS_MAX_DATA.
+uint8_t cobs_encode_inplace(uint8_t *buf, uint8_t len);
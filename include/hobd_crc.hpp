@@ -0,0 +1,33 @@
+#pragma once
+#include <Arduino.h>
+#include <stdint.h>
+
+// ==========================
+// Host link checksums
+// ==========================
+// Table driven, MSB first, no reflection / final xor.
+// gui.py builds the same tables from these polynomials, keep them in sync.
+//   CRC-8       poly 0x07,   init 0x00   check("123456789") = 0xF4
+//   CRC-16/CCITT poly 0x1021, init 0xFFFF check("123456789") = 0x29B1
+#define HOBD_CRC8_POLY 0x07
+#define HOBD_CRC8_INIT 0x00
+#define HOBD_CRC16_POLY 0x1021
+#define HOBD_CRC16_INIT 0xFFFF
+
+uint8_t crc8_update(uint8_t crc, const uint8_t *buf, uint8_t len);
+uint16_t crc16_update(uint16_t crc, const uint8_t *buf, uint16_t len);
+
+static inline uint8_t crc8(const uint8_t *buf, uint8_t len)
+{
+    return crc8_update(HOBD_CRC8_INIT, buf, len);
+}
+
+static inline uint16_t crc16(const uint8_t *buf, uint16_t len)
+{
+    return crc16_update(HOBD_CRC16_INIT, buf, len);
+}
+
+#ifdef HOBD_BENCH
+// Print cycles per live frame for each checksum (env:uno_bench)
+void bench_crc(Print &out);
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+#include <Arduino.h>
+#include "hobd_proto.hpp"
+
+// ==========================
+// K-line trace
+// ==========================
+// env:uno_ktrace only. While CMD_KTRACE has it on, ECUData notes every
+// byte it writes to or reads from the K-line with micros(), and loop()
+// ships the entries to the host as MSG_KTRACE frames in the bulk TX class,
+// so tracing never delays a reply or telemetry. loop() only empties the
+// ring between commands, so it holds a whole CMD_GET_LIVE, all four rows
+// (96 bytes); when loop() can't keep up the newest entries are dropped and
+// a KT_LOST entry marks the gap.
+#ifdef HOBD_KTRACE
+
+#ifndef KTRACE_RING
+#define KTRACE_RING 128 // entries of 4 bytes, 512 B of RAM
+#endif
+
+extern bool ktraceOn;
+
+// Turning it on starts from an empty ring, off leaves the rest to drain
+void ktraceStart(bool on);
+void ktraceRecord(uint8_t dir, uint8_t b);
+// Move up to KTRACE_ENTRIES into a MSG_KTRACE payload, returns its length,
+// 0 when there is nothing to send
+uint8_t ktracePack(uint8_t *payload);
+
+#define KTRACE(dir, b)                \
+    do                                \
+    {                                 \
+        if (ktraceOn)                 \
+            ktraceRecord((dir), (b)); \
+    } while (0)
+
+#else
+#define KTRACE(dir, b) \
+    do                 \
+    {                  \
+    } while (0)
+#endif
@@ -0,0 +1,454 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "hobd_crc.hpp"
+#include "hobd_cobs.hpp"
+
+// ==========================
+// Host link protocol
+// ==========================
+// The one definition of the wire format, built into the firmware and the
+// host tools (host/). Everything here is constexpr or inline, works on
+// caller owned buffers and never allocates. Keep gui.py in step by hand.
+
+// Bumped on any incompatible change to framing or payloads
+#define PROTO_VERSION 3 // 3: telemetry header in front of MSG_LIVE, CMD_RESET magic
+
+enum MsgType : uint8_t
+{
+    MSG_LIVE = 0x81,
+    MSG_DTC = 0x82,
+    MSG_ACK = 0x83,
+    MSG_ERR = 0x84,
+    MSG_CAPS = 0x85,
+    MSG_TIME = 0x86,
+    MSG_GROUPS = 0x87,
+    MSG_AGG = 0x88,
+    MSG_ALARM = 0x89, // id, active, value(i16 x10), sent ahead of everything else
+    MSG_STATS = 0x8A, // per TxClass: sent(u16) dropped(u16) peak(u8)
+    MSG_KTRACE = 0x8B, // K-line bytes as captured, bulk class
+    MSG_GROUP = 0x90, // + group index, telemetry
+    MSG_PGROUP = 0xA0 // + group index, telemetry, bit-packed
+};
+
+enum Cmd : uint8_t
+{
+    CMD_GET_LIVE = 0x01,
+    CMD_GET_DTC = 0x02,
+    CMD_RESET = 0x03,       // + RESET_MAGIC
+    CMD_SET_FRAMING = 0x04, // + mode byte, acked in the new framing
+    CMD_HELLO = 0x05,       // -> MSG_CAPS
+    CMD_SET_BAUD = 0x06,    // + baud code, acked at the old rate
+    CMD_BAUD_TEST = 0x07,   // + BAUD_TEST_PATTERN, echoed at the new rate
+    CMD_TIME_SYNC = 0x08,   // + token(u32) -> MSG_TIME
+    CMD_STREAM = 0x09,      // + on/off, push MSG_GROUP frames without polling
+    CMD_GET_GROUPS = 0x0A,  // -> MSG_GROUPS
+    CMD_SET_GROUP = 0x0B,   // + group, period(u16 ms), chans(u32) -> MSG_GROUPS
+    CMD_GET_AGG = 0x0C,     // -> MSG_AGG
+    CMD_SET_AGG = 0x0D,     // + channel, AGG_ mode -> MSG_AGG
+    CMD_SET_PACKED = 0x0E,  // + on/off, MSG_PGROUP instead of MSG_GROUP
+    CMD_GET_STATS = 0x0F,   // -> MSG_STATS
+    CMD_KTRACE = 0x10       // + on/off, capture the K-line into MSG_KTRACE
+};
+
+// MSG_ERR codes
+enum ErrCode : uint8_t
+{
+    ERR_LIVE = 1,      // the ECU did not answer a live read
+    ERR_DTC = 2,       // ... or a DTC scan
+    ERR_BAD_ARG = 3,
+    ERR_UNKNOWN = 0xFF // unknown command
+};
+
+// Host link framings
+enum Framing : uint8_t
+{
+    FRAMING_SOF = 0,  // AA 55 type len payload crc8
+    FRAMING_COBS = 1, // cobs(type payload crc16) 00
+};
+
+static constexpr uint8_t SOF1 = 0xAA;
+static constexpr uint8_t SOF2 = 0x55;
+
+// largest payload the firmware sends
+#define MAX_PAYLOAD 32
+#define CMD_MAX_ARGS 8
+
+// Feature bits in MSG_CAPS
+#define FEAT_DTC (1 << 0)
+#define FEAT_RESET (1 << 1)
+#define FEAT_BAUD (1 << 2)
+#define FEAT_SEQ (1 << 3) // telemetry frames start with TELEM_HDR_LEN
+#define FEAT_TIME (1 << 4)
+#define FEAT_GROUPS (1 << 5)
+#define FEAT_AGG (1 << 6)
+#define FEAT_PACKED (1 << 7)
+#define FEAT_BATCHED (1 << 8) // frames reach the host in BT_BATCH sized bursts
+#define FEAT_QOS (1 << 9)     // prioritised TX, MSG_ALARM and CMD_GET_STATS
+#define FEAT_KTRACE (1 << 10) // CMD_KTRACE, env:uno_ktrace builds only
+
+// CMD_SET_BAUD codes, index = code
+static const uint32_t baudRates[] = {115200UL, 230400UL, 250000UL, 500000UL, 1000000UL};
+#define BAUD_CODES (sizeof(baudRates) / sizeof(baudRates[0]))
+static const uint8_t BAUD_TEST_PATTERN[4] = {0x55, 0xAA, 0x00, 0xFF};
+// CMD_RESET wipes what the ECU has learned: one stray byte must not do it
+static const uint8_t RESET_MAGIC[2] = {0x5A, 0xC3};
+
+// Argument bytes following each command byte
+static constexpr uint8_t cmdArgLen(uint8_t cmd)
+{
+    return cmd == CMD_SET_FRAMING || cmd == CMD_SET_BAUD ? 1
+         : cmd == CMD_BAUD_TEST ? sizeof(BAUD_TEST_PATTERN)
+         : cmd == CMD_RESET ? sizeof(RESET_MAGIC)
+         : cmd == CMD_TIME_SYNC ? 4
+         : cmd == CMD_STREAM || cmd == CMD_SET_PACKED || cmd == CMD_KTRACE ? 1
+         : cmd == CMD_SET_GROUP ? 7
+         : cmd == CMD_SET_AGG ? 2
+         : 0;
+}
+
+static_assert(cmdArgLen(CMD_BAUD_TEST) <= CMD_MAX_ARGS, "CMD_MAX_ARGS");
+static_assert(cmdArgLen(CMD_SET_GROUP) <= CMD_MAX_ARGS, "CMD_MAX_ARGS");
+
+// 32 bit FNV-1a, evaluated at compile time
+static constexpr uint32_t fnv1a(const char *s, uint32_t h = 2166136261UL)
+{
+    return *s ? fnv1a(s + 1, (h ^ (uint8_t)*s) * 16777619UL) : h;
+}
+
+// ---- Big endian fields ----
+static inline void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v & 0xFF;
+}
+
+static inline void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v & 0xFF;
+}
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+    return (uint16_t)p[0] << 8 | p[1];
+}
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)get_u16(p) << 16 | get_u16(p + 2);
+}
+
+// ---- Frames ----
+// Bytes a frame of len payload bytes takes on the wire
+static constexpr uint8_t sofFrameLen(uint8_t len) { return 4 + len + 1; }
+static constexpr uint8_t cobsFrameLen(uint8_t len) { return 1 + 1 + len + 2 + 1; }
+#define FRAME_MAX (cobsFrameLen(MAX_PAYLOAD))
+
+static_assert(sofFrameLen(MAX_PAYLOAD) <= FRAME_MAX, "FRAME_MAX");
+static_assert(1 + MAX_PAYLOAD + 2 <= COBS_MAX_DATA, "one COBS block per frame");
+
+// CRC-8 over type, len and payload (SOF bytes are constant)
+static inline uint8_t sof_crc(uint8_t type, const uint8_t *payload, uint8_t len)
+{
+    const uint8_t hdr[2] = {type, len};
+    return crc8_update(crc8(hdr, 2), payload, len);
+}
+
+// Encode one frame into buf (FRAME_MAX bytes), returns its length
+static inline uint8_t frame_encode(uint8_t framing, uint8_t *buf, uint8_t type,
+                                   const uint8_t *payload, uint8_t len)
+{
+    if (len > MAX_PAYLOAD)
+        len = MAX_PAYLOAD;
+
+    if (framing == FRAMING_COBS)
+    {
+        // [code] type payload crc16, encoded in place
+        buf[1] = type;
+        memcpy(buf + 2, payload, len);
+        put_u16(buf + 2 + len, crc16(buf + 1, len + 1));
+        uint8_t n = cobs_encode_inplace(buf, len + 3);
+        buf[n++] = COBS_DELIM;
+        return n;
+    }
+
+    buf[0] = SOF1;
+    buf[1] = SOF2;
+    buf[2] = type;
+    buf[3] = len;
+    memcpy(buf + 4, payload, len);
+    buf[4 + len] = sof_crc(type, payload, len);
+    return sofFrameLen(len);
+}
+
+// ---- Telemetry header ----
+// Every telemetry frame starts with seq(u16) and the sample time
+// (u32 micros) so the host can tell lost frames from a slow ECU.
+#define TELEM_HDR_LEN 6
+
+struct TelemHdr
+{
+    uint16_t seq;
+    uint32_t sampleUs;
+};
+
+static inline void telem_encode(uint8_t *p, const TelemHdr &h)
+{
+    put_u16(p, h.seq);
+    put_u32(p + 2, h.sampleUs);
+}
+
+static inline void telem_decode(const uint8_t *p, TelemHdr &h)
+{
+    h.seq = get_u16(p);
+    h.sampleUs = get_u32(p + 2);
+}
+
+// ---- MSG_LIVE ----
+// Hosts hash the schema string and compare it with the hash in MSG_CAPS
+// before decoding, as "name:type/scale". The hash covers the telemetry
+// header too, so a host that reads the body from byte 0 refuses it.
+#define TELEM_SCHEMA "seq:u16,us:u32,"
+#define LIVE_SCHEMA "rpm:u16,vss:u8,ect:i16/10,iat:i16/10,map:i16/10,tps:i16/10," \
+                    "batt:u16/100,o2:u16/100,flags:u8,maf:u16"
+static constexpr uint32_t LIVE_SCHEMA_HASH = fnv1a(TELEM_SCHEMA LIVE_SCHEMA);
+
+// byte offsets
+enum LiveField : uint8_t
+{
+    LIVE_RPM = 0,
+    LIVE_VSS = 2,
+    LIVE_ECT = 3,
+    LIVE_IAT = 5,
+    LIVE_MAP = 7,
+    LIVE_TPS = 9,
+    LIVE_BATT = 11,
+    LIVE_O2 = 13,
+    LIVE_FLAGS = 15,
+    LIVE_MAF = 16,
+    LIVE_LEN = 18
+};
+
+// LIVE_FLAGS (and CH_FLAGS) bits
+#define LIVE_FLG_AIRCON (1 << 0)
+#define LIVE_FLG_BRAKE (1 << 1)
+#define LIVE_FLG_VTEC (1 << 2)
+#define LIVE_FLG_CEL (1 << 3)
+
+static_assert(LIVE_MAF + 2 == LIVE_LEN, "live layout");
+static_assert(TELEM_HDR_LEN + LIVE_LEN <= MAX_PAYLOAD, "MSG_LIVE fits a frame");
+
+// Wire units: x10 for temperatures / pressures / TPS, x100 for volts
+struct LiveRecord
+{
+    uint16_t rpm;
+    uint8_t vss;
+    int16_t ect, iat, map, tps;
+    uint16_t batt, o2;
+    uint8_t flags; // LIVE_FLG_
+    uint16_t maf;
+};
+
+static inline void live_encode(uint8_t *p, const LiveRecord &r)
+{
+    put_u16(p + LIVE_RPM, r.rpm);
+    p[LIVE_VSS] = r.vss;
+    put_u16(p + LIVE_ECT, (uint16_t)r.ect);
+    put_u16(p + LIVE_IAT, (uint16_t)r.iat);
+    put_u16(p + LIVE_MAP, (uint16_t)r.map);
+    put_u16(p + LIVE_TPS, (uint16_t)r.tps);
+    put_u16(p + LIVE_BATT, r.batt);
+    put_u16(p + LIVE_O2, r.o2);
+    p[LIVE_FLAGS] = r.flags;
+    put_u16(p + LIVE_MAF, r.maf);
+}
+
+static inline bool live_decode(const uint8_t *p, uint8_t len, LiveRecord &r)
+{
+    if (len < LIVE_LEN)
+        return false;
+    r.rpm = get_u16(p + LIVE_RPM);
+    r.vss = p[LIVE_VSS];
+    r.ect = (int16_t)get_u16(p + LIVE_ECT);
+    r.iat = (int16_t)get_u16(p + LIVE_IAT);
+    r.map = (int16_t)get_u16(p + LIVE_MAP);
+    r.tps = (int16_t)get_u16(p + LIVE_TPS);
+    r.batt = get_u16(p + LIVE_BATT);
+    r.o2 = get_u16(p + LIVE_O2);
+    r.flags = p[LIVE_FLAGS];
+    r.maf = get_u16(p + LIVE_MAF);
+    return true;
+}
+
+// ---- MSG_CAPS ----
+enum CapsField : uint8_t
+{
+    CAPS_VERSION = 0,
+    CAPS_FRAMINGS = 1,   // bitmask of 1 << Framing
+    CAPS_MAX_BAUD = 2,   // u32
+    CAPS_LIVE_HASH = 6,  // u32
+    CAPS_RX_BUF = 10,
+    CAPS_TX_BUF = 11,
+    CAPS_MAX_PAYLOAD = 12,
+    CAPS_LIVE_LEN = 13,
+    CAPS_FEATURES = 14,  // u16
+    CAPS_CHAN_HASH = 16, // u32
+    CAPS_BATCH = 20,     // 0 = unbatched
+    CAPS_BATCH_MS = 21,
+    CAPS_LEN = 22
+};
+
+static_assert(CAPS_LEN <= MAX_PAYLOAD, "MSG_CAPS fits a frame");
+
+struct Caps
+{
+    uint8_t version;
+    uint8_t framings;
+    uint32_t maxBaud;
+    uint32_t liveHash;
+    uint8_t rxBuf, txBuf;
+    uint8_t maxPayload;
+    uint8_t liveLen;
+    uint16_t features;
+    uint32_t chanHash;
+    uint8_t batch, batchMs;
+};
+
+static inline uint8_t caps_encode(uint8_t *p, const Caps &c)
+{
+    p[CAPS_VERSION] = c.version;
+    p[CAPS_FRAMINGS] = c.framings;
+    put_u32(p + CAPS_MAX_BAUD, c.maxBaud);
+    put_u32(p + CAPS_LIVE_HASH, c.liveHash);
+    p[CAPS_RX_BUF] = c.rxBuf;
+    p[CAPS_TX_BUF] = c.txBuf;
+    p[CAPS_MAX_PAYLOAD] = c.maxPayload;
+    p[CAPS_LIVE_LEN] = c.liveLen;
+    put_u16(p + CAPS_FEATURES, c.features);
+    put_u32(p + CAPS_CHAN_HASH, c.chanHash);
+    p[CAPS_BATCH] = c.batch;
+    p[CAPS_BATCH_MS] = c.batchMs;
+    return CAPS_LEN;
+}
+
+// Older firmware sends the first 16 or 20 bytes only
+static inline bool caps_decode(const uint8_t *p, uint8_t len, Caps &c)
+{
+    if (len < CAPS_CHAN_HASH)
+        return false;
+    c.version = p[CAPS_VERSION];
+    c.framings = p[CAPS_FRAMINGS];
+    c.maxBaud = get_u32(p + CAPS_MAX_BAUD);
+    c.liveHash = get_u32(p + CAPS_LIVE_HASH);
+    c.rxBuf = p[CAPS_RX_BUF];
+    c.txBuf = p[CAPS_TX_BUF];
+    c.maxPayload = p[CAPS_MAX_PAYLOAD];
+    c.liveLen = p[CAPS_LIVE_LEN];
+    c.features = get_u16(p + CAPS_FEATURES);
+    c.chanHash = len >= CAPS_BATCH ? get_u32(p + CAPS_CHAN_HASH) : 0;
+    c.batch = len >= CAPS_LEN ? p[CAPS_BATCH] : 0;
+    c.batchMs = len >= CAPS_LEN ? p[CAPS_BATCH_MS] : 0;
+    return true;
+}
+
+// ---- MSG_ALARM ----
+enum AlarmId : uint8_t
+{
+    ALARM_ECT = 1,
+    ALARM_VSS = 2
+};
+
+#define ALARM_LEN 4
+
+struct AlarmRecord
+{
+    uint8_t id;
+    bool active;
+    int16_t value; // x10
+};
+
+static inline void alarm_encode(uint8_t *p, const AlarmRecord &a)
+{
+    p[0] = a.id;
+    p[1] = a.active;
+    put_u16(p + 2, (uint16_t)a.value);
+}
+
+static inline bool alarm_decode(const uint8_t *p, uint8_t len, AlarmRecord &a)
+{
+    if (len < ALARM_LEN)
+        return false;
+    a.id = p[0];
+    a.active = p[1] != 0;
+    a.value = (int16_t)get_u16(p + 2);
+    return true;
+}
+
+// ---- MSG_KTRACE ----
+// Every byte ECUData writes to or reads from the K-line, in order, for
+// replaying a conversation with the ECU off the car (host/hobd_ktreplay).
+// Payload: tUs(u32 micros of the first entry), then up to KTRACE_ENTRIES
+// entries of dir, byte, dt(u16). dt is the time since the entry before,
+// in µs below KTRACE_DT_MS, else KTRACE_DT_MS | ms; the first entry's is
+// relative to the previous frame. Only a first entry has an ms dt, so
+// times within a frame are exact. KT_LOST entries stand where the
+// firmware had no room for `byte` entries (saturating at 255).
+#define KTRACE_HDR_LEN 4
+#define KTRACE_ENTRY_LEN 4
+#define KTRACE_ENTRIES ((MAX_PAYLOAD - KTRACE_HDR_LEN) / KTRACE_ENTRY_LEN)
+#define KTRACE_DT_MS 0x8000
+
+enum KtraceDir : uint8_t
+{
+    KT_TX = 0,
+    KT_RX = 1,
+    KT_LOST = 2
+};
+
+struct KtraceEntry
+{
+    uint8_t dir; // KtraceDir
+    uint8_t byte;
+    uint16_t dt; // as on the wire
+};
+
+static inline uint16_t ktrace_dt(uint32_t us)
+{
+    if (us < KTRACE_DT_MS)
+        return (uint16_t)us;
+    const uint32_t ms = us / 1000;
+    return (uint16_t)(KTRACE_DT_MS | (ms < KTRACE_DT_MS ? ms : KTRACE_DT_MS - 1));
+}
+
+static inline uint32_t ktrace_dt_us(uint16_t dt)
+{
+    return dt & KTRACE_DT_MS ? (uint32_t)(dt & ~KTRACE_DT_MS) * 1000 : dt;
+}
+
+static inline void ktrace_entry_encode(uint8_t *p, const KtraceEntry &e)
+{
+    p[0] = e.dir;
+    p[1] = e.byte;
+    put_u16(p + 2, e.dt);
+}
+
+// Entries in a MSG_KTRACE payload, 0 if it is malformed
+static inline uint8_t ktrace_decode(const uint8_t *p, uint8_t len, uint32_t &tUs,
+                                    KtraceEntry *e)
+{
+    if (len < KTRACE_HDR_LEN + KTRACE_ENTRY_LEN || (len - KTRACE_HDR_LEN) % KTRACE_ENTRY_LEN)
+        return 0;
+    tUs = get_u32(p);
+    const uint8_t n = (len - KTRACE_HDR_LEN) / KTRACE_ENTRY_LEN;
+    for (uint8_t i = 0; i < n; ++i)
+    {
+        const uint8_t *q = p + KTRACE_HDR_LEN + i * KTRACE_ENTRY_LEN;
+        e[i].dir = q[0];
+        e[i].byte = q[1];
+        e[i].dt = get_u16(q + 2);
+    }
+    return n;
+}
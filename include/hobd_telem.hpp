@@ -0,0 +1,106 @@
+#pragma once
+#include "hobd_uni2.hpp"
+
+// ==========================
+// Channel wire encoding
+// ==========================
+// How each channel goes into a group frame: value * scale, rounded,
+// clamped and written big-endian in 1 or 2 bytes. Packed group frames
+// carry (value * scale - min) in exactly `bits` bits instead.
+#define CHAN_U8 0x01
+#define CHAN_I8 0x81
+#define CHAN_U16 0x02
+#define CHAN_I16 0x82
+#define CHAN_BYTES(fmt) ((fmt) & 0x0F)
+#define CHAN_SIGNED(fmt) (((fmt) & 0x80) != 0)
+
+struct ChanDesc
+{
+    uint8_t fmt;
+    uint8_t scale;
+    uint8_t bits;
+    int16_t min;
+};
+
+extern const ChanDesc chanDesc[CH_COUNT];
+
+// chanDesc as "name:type[/scale]@bits[min]" in channel id order. Hosts
+// hash their own copy and compare it with the one in MSG_CAPS, keep both
+// in sync.
+#define CHAN_SCHEMA "rpm:u16@14,vss:u8@8,flags:u8@4,ect:i16/10@11-400,iat:i16/10@11-400," \
+                    "map:i16/10@11-50,baro:i16/10@11-50,tps:i8@7-12,o2:u16/100@9,"        \
+                    "volt:u16/100@12,altf:u16/10@10,eld:i16/10@10-240,sft:i8@8-128,"       \
+                    "lft:i8@8-128,inj:u16@9,ign:i8@7-16,lmt:i8@7-16,iacv:u8@7,knoc:u8@3,"   \
+                    "maf:u16@16"
+
+// ==========================
+// Decimation
+// ==========================
+// While streaming, channels with a mode other than AGG_LAST are sampled
+// on every ECU read and summarised over the group period, so a peak
+// between two frames still shows up. In the group frame they take 1
+// (mean), 2 (min, max) or 3 (min, max, mean) values of the channel format.
+#define AGG_LAST 0
+#define AGG_MEAN 1
+#define AGG_MINMAX 2
+#define AGG_MMM 3
+#define AGG_MODES 4
+
+// channels that can be aggregated at the same time
+#define AGG_SLOTS 6
+
+struct ChanAgg
+{
+    uint8_t ch; // CH_COUNT = free
+    uint8_t n;
+    int32_t min;
+    int32_t max;
+    int32_t sum;
+};
+
+extern uint8_t aggMode[CH_COUNT];
+
+// false when all slots are taken
+bool setAggMode(uint8_t ch, uint8_t mode);
+// channels with a mode other than AGG_LAST
+ChanMask aggChans();
+// Add the current values of chans to their running summaries
+void aggSample(ECUData &e, ChanMask chans);
+
+// ==========================
+// Output groups
+// ==========================
+// Each group goes out as its own telemetry frame (MSG_GROUP + index) at
+// its own period while streaming. Only rows feeding a due group are read.
+#define GROUP_COUNT 3
+#define GROUP_FAST 0
+#define GROUP_MEDIUM 1
+#define GROUP_SLOW 2
+
+// share of the host link the groups may use together
+#define LINK_BUDGET_PCT 70
+// worst case framing + telemetry header bytes per group frame
+#define GROUP_FRAME_OVERHEAD 12
+// shortest period CMD_SET_GROUP takes (0 turns a group off): one K-line
+// row alone takes ~25 ms, anything faster only repeats samples
+#define GROUP_MIN_PERIOD_MS 20
+
+struct TelemGroup
+{
+    ChanMask chans;    // 0 = disabled
+    uint16_t periodMs; // as asked for by the host
+    uint16_t fitMs;    // after fitting into the link budget
+    uint32_t lastMs;
+};
+
+extern TelemGroup groups[GROUP_COUNT];
+// bit-packed group frames (MSG_PGROUP) instead of byte aligned ones
+extern bool groupsPacked;
+
+uint8_t groupPayloadLen(ChanMask chans, bool packed);
+// Pack chans in id order, summaries are reset once packed
+uint8_t packGroup(uint8_t *p, ChanMask chans, ECUData &e);
+// Stretch all periods by the same factor until the groups fit in baud
+void fitGroupsToBudget(uint32_t baud);
+// Groups whose period has elapsed at now
+uint8_t groupsDue(uint32_t now);
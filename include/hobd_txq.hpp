@@ -0,0 +1,46 @@
+#pragma once
+#include <Arduino.h>
+
+// ==========================
+// Prioritised TX queues
+// ==========================
+// Encoded frames wait here instead of going straight to the UART. txPump()
+// always sends the oldest frame of the highest class that has one, so an
+// alarm or command reply never waits behind queued telemetry, and bulk
+// transfers only get the link when everything else is idle. Frames are
+// never interleaved; a full queue drops its own oldest frames.
+enum TxClass : uint8_t
+{
+    TXC_ALARM,
+    TXC_REPLY,
+    TXC_TELEM,
+    TXC_BULK,
+    TXC_COUNT
+};
+
+#define TXQ_ALARM_SIZE 24
+#define TXQ_REPLY_SIZE 64
+#define TXQ_TELEM_SIZE 96
+#define TXQ_BULK_SIZE 64
+// largest encoded frame
+#define TXQ_MAX_FRAME 48
+
+struct TxQueue
+{
+    uint8_t *buf;
+    uint8_t size;
+    uint8_t head; // oldest record: [len][frame bytes]
+    uint8_t used;
+    uint8_t peak;
+    uint16_t sent;
+    uint16_t dropped;
+};
+
+extern TxQueue txq[TXC_COUNT];
+
+// Queue one encoded frame, false if it can never fit
+bool txPush(uint8_t cls, const uint8_t *frame, uint8_t len);
+// Write whole frames while out has room for them
+void txPump(Print &out);
+// Write everything that is queued, blocking
+void txDrain(Print &out);
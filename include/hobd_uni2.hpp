@@ -1,3 +1,4 @@
+#pragma once
 #include <Arduino.h>
 #include <SoftwareSerial.h>
 #include <stdint.h>
@@ -60,6 +61,56 @@
 #define HOBD_FLG_MAIN_RELAY (1 << 0) // @0x0B
 #define HOBD_FLG_CEL (1 << 5)        // @0x0B
 
+// ==========================
+// Live channels
+// ==========================
+// One bit per decoded value in ECUData. readLiveData() only fetches the
+// rows and runs the conversions for channels in subMask; everything else
+// stays as raw bytes in liveRaw until decode() is asked for it.
+enum HobdChannel : uint8_t
+{
+    CH_RPM,
+    CH_VSS,
+    CH_FLAGS, // sw_* / main_relay / cel
+    CH_ECT,
+    CH_IAT,
+    CH_MAP,
+    CH_BARO,
+    CH_TPS,
+    CH_O2,
+    CH_VOLT,
+    CH_ALTF,
+    CH_ELD,
+    CH_SFT,
+    CH_LFT,
+    CH_INJ,
+    CH_IGN,
+    CH_LMT,
+    CH_IACV,
+    CH_KNOC,
+    CH_MAF, // derived from rpm/map/iat, keep last
+    CH_COUNT
+};
+
+typedef uint32_t ChanMask;
+
+#define CH_BIT(ch) ((ChanMask)1 << (ch))
+#define CH_ALL (CH_BIT(CH_COUNT) - 1)
+
+// Rows of 0x10 bytes read with HOBD_CMD, and the channels each one feeds
+#define HOBD_ROWS 4
+#define HOBD_ROW_LEN 0x10
+
+#define HOBD_ROW0_CHANS (CH_BIT(CH_RPM) | CH_BIT(CH_VSS) | CH_BIT(CH_FLAGS))
+#define HOBD_ROW1_CHANS (CH_BIT(CH_ECT) | CH_BIT(CH_IAT) | CH_BIT(CH_MAP) | CH_BIT(CH_BARO) | \
+                         CH_BIT(CH_TPS) | CH_BIT(CH_O2) | CH_BIT(CH_VOLT) | CH_BIT(CH_ALTF) | CH_BIT(CH_ELD))
+#define HOBD_ROW2_CHANS (CH_BIT(CH_SFT) | CH_BIT(CH_LFT) | CH_BIT(CH_INJ) | CH_BIT(CH_IGN) | \
+                         CH_BIT(CH_LMT) | CH_BIT(CH_IACV))
+#define HOBD_ROW3_CHANS (CH_BIT(CH_KNOC))
+
+// inputs of the derived channels
+#define HOBD_MAF_DEPS (CH_BIT(CH_RPM) | CH_BIT(CH_MAP) | CH_BIT(CH_IAT))
+
 struct EcuCmd
 {
     uint8_t cmd;
@@ -78,7 +129,8 @@ enum ErrCodes {
 #define ErrLen 14
 #define DataLen 20
 
-extern const uint8_t startup[];
+#define STARTUP_LEN 11
+extern const uint8_t startup[STARTUP_LEN];
 
 
 class ECUData
@@ -99,6 +151,15 @@ public:
     bool resetEcu();
     static uint8_t mkcrc(const uint8_t *buf, uint8_t len);
     bool readLiveData();
+    void decode(ChanMask mask);
+    float value(uint8_t ch);
+
+private:
+    bool readRow(uint8_t row);
+    void noteErr(ErrCodes e);
+    void decodeChannel(uint8_t ch);
+
+public:
 
     uint8_t dlcData[DataLen] = {0};
     uint8_t dtcErrs[ErrLen] = {0};
@@ -106,6 +167,16 @@ public:
     size_t errLen = 0, dtcLen = 0;
 
     uint16_t dlctmo = 0;
+
+    // channels converted on every readLiveData(), the rest on demand
+    ChanMask subMask = CH_ALL;
+    // channels already converted from the current liveRaw contents
+    ChanMask decoded = 0;
+    // micros() when the last readLiveData() started fetching
+    uint32_t sampleUs = 0;
+    // payload bytes of the last fetch of each row
+    uint8_t liveRaw[HOBD_ROWS][HOBD_ROW_LEN] = {{0}};
+
     // ==============================
     // ECU Sensor Data (Raw Inputs)
     // ==============================
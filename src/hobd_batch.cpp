@@ -0,0 +1,37 @@
+#include "hobd_batch.hpp"
+
+size_t BatchStream::write(uint8_t b)
+{
+    if (!len)
+        firstMs = millis();
+    buf[len++] = b;
+    if (len == size)
+        flush();
+    return 1;
+}
+
+size_t BatchStream::write(const uint8_t *p, size_t n)
+{
+    // only split what is larger than a packet anyway
+    if (len && len + n > size)
+        flush();
+    for (size_t i = 0; i < n; ++i)
+        write(p[i]);
+    return n;
+}
+
+void BatchStream::flush()
+{
+    if (!len)
+        return;
+    io.write(buf, len);
+    batches++;
+    bytes += len;
+    len = 0;
+}
+
+void BatchStream::poll()
+{
+    if (len && millis() - firstMs >= flushMs)
+        flush();
+}
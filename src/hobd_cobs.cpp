@@ -0,0 +1,17 @@
+#include "hobd_cobs.hpp"
+
+uint8_t cobs_encode_inplace(uint8_t *buf, uint8_t len)
+{
+    // every zero becomes the distance to the next zero (or the end)
+    uint8_t code = 0;
+    for (uint8_t i = 1; i <= len; ++i)
+    {
+        if (buf[i] == COBS_DELIM)
+        {
+            buf[code] = i - code;
+            code = i;
+        }
+    }
+    buf[code] = len + 1 - code;
+    return len + 1;
+}
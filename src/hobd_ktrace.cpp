@@ -0,0 +1,83 @@
+#include "hobd_ktrace.hpp"
+#include "hobd_uni2.hpp"
+
+#ifdef HOBD_KTRACE
+
+// a read of every row: 5 bytes out, 0x10 + MSG_OFFSET in
+static_assert(KTRACE_RING >= HOBD_ROWS * (5 + HOBD_ROW_LEN + MSG_OFFSET),
+              "the ring must hold a whole CMD_GET_LIVE");
+static_assert(KTRACE_RING <= 255, "ring positions are uint8_t");
+
+bool ktraceOn = false;
+
+// entries in wire form, dt chained from one to the next
+static KtraceEntry ring[KTRACE_RING];
+static uint8_t head = 0;
+static uint8_t used = 0;
+static uint8_t lost = 0;
+static uint32_t headUs = 0; // micros() of ring[head]
+static uint32_t lastUs = 0; // micros() of the newest entry
+
+void ktraceStart(bool on)
+{
+    if (on && !ktraceOn)
+    {
+        head = used = lost = 0;
+        lastUs = micros();
+    }
+    ktraceOn = on;
+}
+
+static void push(uint8_t dir, uint8_t b, uint32_t now)
+{
+    if (!used)
+        headUs = now;
+    KtraceEntry &e = ring[(uint8_t)(head + used) % KTRACE_RING];
+    e.dir = dir;
+    e.byte = b;
+    e.dt = ktrace_dt(now - lastUs);
+    lastUs = now;
+    used++;
+}
+
+void ktraceRecord(uint8_t dir, uint8_t b)
+{
+    const uint32_t now = micros();
+    // room for the byte, and for the KT_LOST entry in front of it
+    if (used + 1 + (lost != 0) > KTRACE_RING)
+    {
+        if (lost < 0xFF)
+            lost++;
+        return;
+    }
+    if (lost)
+    {
+        push(KT_LOST, lost, now);
+        lost = 0;
+    }
+    push(dir, b, now);
+}
+
+uint8_t ktracePack(uint8_t *p)
+{
+    if (!used)
+        return 0;
+    put_u32(p, headUs);
+    uint8_t n = 0;
+    while (used && n < KTRACE_ENTRIES)
+    {
+        // a gap only known to the ms starts the next frame, whose tUs
+        // has it exact
+        if (n && (ring[head].dt & KTRACE_DT_MS))
+            break;
+        ktrace_entry_encode(p + KTRACE_HDR_LEN + n * KTRACE_ENTRY_LEN, ring[head]);
+        ++n;
+        head = (head + 1) % KTRACE_RING;
+        used--;
+        if (used)
+            headUs += ktrace_dt_us(ring[head].dt);
+    }
+    return KTRACE_HDR_LEN + n * KTRACE_ENTRY_LEN;
+}
+
+#endif
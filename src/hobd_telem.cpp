@@ -0,0 +1,264 @@
+#include "hobd_telem.hpp"
+
+const ChanDesc chanDesc[CH_COUNT] PROGMEM = {
+    // fmt      scale bits min
+    {CHAN_U16, 1, 14, 0},       // CH_RPM    0..16383
+    {CHAN_U8, 1, 8, 0},         // CH_VSS    0..255 km/h
+    {CHAN_U8, 1, 4, 0},         // CH_FLAGS  LIVE_FLG_*
+    {CHAN_I16, 10, 11, -400},   // CH_ECT    -40.0..164.7 C
+    {CHAN_I16, 10, 11, -400},   // CH_IAT
+    {CHAN_I16, 10, 11, -50},    // CH_MAP    -5.0..199.7 kPa
+    {CHAN_I16, 10, 11, -50},    // CH_BARO
+    {CHAN_I8, 1, 7, -12},       // CH_TPS    (raw - 24) / 2
+    {CHAN_U16, 100, 9, 0},      // CH_O2     0..5.11 V
+    {CHAN_U16, 100, 12, 0},     // CH_VOLT   0..40.95 V
+    {CHAN_U16, 10, 10, 0},      // CH_ALTF   0..102.3 %
+    {CHAN_I16, 10, 10, -240},   // CH_ELD    -24.0..78.3 A
+    {CHAN_I8, 1, 8, -128},      // CH_SFT
+    {CHAN_I8, 1, 8, -128},      // CH_LFT
+    {CHAN_U16, 1, 9, 0},        // CH_INJ
+    {CHAN_I8, 1, 7, -16},       // CH_IGN    (raw - 24) / 4
+    {CHAN_I8, 1, 7, -16},       // CH_LMT
+    {CHAN_U8, 1, 7, 0},         // CH_IACV   0..100 %
+    {CHAN_U8, 1, 3, 0},         // CH_KNOC   0..5
+    {CHAN_U16, 1, 16, 0},       // CH_MAF
+};
+
+// CH_RPM (id 0) summarised by default: don't miss the peak between frames
+uint8_t aggMode[CH_COUNT] = {AGG_MMM};
+
+static ChanAgg aggSlots[AGG_SLOTS] = {
+    {CH_RPM, 0, 0, 0, 0},
+    {CH_COUNT, 0, 0, 0, 0},
+    {CH_COUNT, 0, 0, 0, 0},
+    {CH_COUNT, 0, 0, 0, 0},
+    {CH_COUNT, 0, 0, 0, 0},
+    {CH_COUNT, 0, 0, 0, 0},
+};
+
+TelemGroup groups[GROUP_COUNT] = {
+    // fast: what the driver feels
+    {CH_BIT(CH_RPM) | CH_BIT(CH_MAP) | CH_BIT(CH_TPS) | CH_BIT(CH_VSS), 100, 100, 0},
+    // medium: mixture and timing
+    {CH_BIT(CH_O2) | CH_BIT(CH_SFT) | CH_BIT(CH_LFT) | CH_BIT(CH_IGN) | CH_BIT(CH_FLAGS) | CH_BIT(CH_MAF),
+     250, 250, 0},
+    // slow: things that drift
+    {CH_BIT(CH_ECT) | CH_BIT(CH_IAT) | CH_BIT(CH_BARO) | CH_BIT(CH_VOLT), 1000, 1000, 0},
+};
+
+bool groupsPacked = false;
+
+// values per channel in a group frame for each AGG_ mode
+static const uint8_t aggValues[AGG_MODES] = {1, 1, 2, 3};
+
+uint8_t groupPayloadLen(ChanMask chans, bool packed)
+{
+    uint16_t bits = 0;
+    for (uint8_t ch = 0; chans; ++ch, chans >>= 1)
+    {
+        if (!(chans & 1))
+            continue;
+        const uint8_t w = packed ? pgm_read_byte(&chanDesc[ch].bits)
+                                 : CHAN_BYTES(pgm_read_byte(&chanDesc[ch].fmt)) * 8;
+        bits += w * aggValues[aggMode[ch]];
+    }
+    return (bits + 7) / 8;
+}
+
+static ChanAgg *agg_slot(uint8_t ch)
+{
+    for (uint8_t i = 0; i < AGG_SLOTS; ++i)
+    {
+        if (aggSlots[i].ch == ch)
+            return &aggSlots[i];
+    }
+    return 0;
+}
+
+bool setAggMode(uint8_t ch, uint8_t mode)
+{
+    ChanAgg *slot = agg_slot(ch);
+    if (mode == AGG_LAST)
+    {
+        if (slot)
+            slot->ch = CH_COUNT;
+    }
+    else if (!slot)
+    {
+        slot = agg_slot(CH_COUNT);
+        if (!slot)
+            return false;
+        slot->ch = ch;
+        slot->n = 0;
+    }
+    aggMode[ch] = mode;
+    return true;
+}
+
+ChanMask aggChans()
+{
+    ChanMask m = 0;
+    for (uint8_t i = 0; i < AGG_SLOTS; ++i)
+    {
+        if (aggSlots[i].ch < CH_COUNT)
+            m |= CH_BIT(aggSlots[i].ch);
+    }
+    return m;
+}
+
+// value * scale, rounded and clamped to what fmt can hold
+static int32_t chan_raw(uint8_t fmt, uint8_t scale, float v)
+{
+    float f = v * scale;
+    int32_t r = (int32_t)(f < 0 ? f - 0.5f : f + 0.5f);
+    int32_t lo, hi;
+    if (CHAN_BYTES(fmt) == 1)
+    {
+        lo = CHAN_SIGNED(fmt) ? -128 : 0;
+        hi = CHAN_SIGNED(fmt) ? 127 : 255;
+    }
+    else
+    {
+        lo = CHAN_SIGNED(fmt) ? -32768L : 0;
+        hi = CHAN_SIGNED(fmt) ? 32767L : 65535L;
+    }
+    return constrain(r, lo, hi);
+}
+
+void aggSample(ECUData &e, ChanMask chans)
+{
+    for (uint8_t i = 0; i < AGG_SLOTS; ++i)
+    {
+        ChanAgg &a = aggSlots[i];
+        if (a.ch >= CH_COUNT || !(chans & CH_BIT(a.ch)))
+            continue;
+        const int32_t v = chan_raw(pgm_read_byte(&chanDesc[a.ch].fmt),
+                                   pgm_read_byte(&chanDesc[a.ch].scale), e.value(a.ch));
+        if (!a.n || v < a.min)
+            a.min = v;
+        if (!a.n || v > a.max)
+            a.max = v;
+        if (!a.n)
+            a.sum = 0;
+        // past 255 samples keep a running mean instead of growing n
+        if (a.n < 0xFF)
+        {
+            a.sum += v;
+            a.n++;
+        }
+        else
+        {
+            a.sum += v - a.sum / 0xFF;
+        }
+    }
+}
+
+// Writes channel values either whole bytes big-endian, or as
+// (value - min) in exactly the channel's bits, MSB first
+struct ChanWriter
+{
+    uint8_t *p;
+    uint16_t bit;
+    bool packed;
+
+    void put(uint8_t ch, int32_t v)
+    {
+        if (!packed)
+        {
+            const uint16_t raw = (uint16_t)v;
+            if (CHAN_BYTES(pgm_read_byte(&chanDesc[ch].fmt)) == 2)
+            {
+                p[bit / 8] = raw >> 8;
+                bit += 8;
+            }
+            p[bit / 8] = raw & 0xFF;
+            bit += 8;
+            return;
+        }
+
+        const uint8_t w = pgm_read_byte(&chanDesc[ch].bits);
+        const int32_t lo = (int16_t)pgm_read_word(&chanDesc[ch].min);
+        const uint32_t raw = constrain(v - lo, (int32_t)0, (int32_t)((1UL << w) - 1));
+        for (int8_t b = w - 1; b >= 0; --b, ++bit)
+        {
+            const uint8_t mask = 0x80 >> (bit & 7);
+            if (raw & (1UL << b))
+                p[bit >> 3] |= mask;
+            else
+                p[bit >> 3] &= ~mask;
+        }
+    }
+
+    uint8_t len() const
+    {
+        return (bit + 7) / 8;
+    }
+};
+
+uint8_t packGroup(uint8_t *p, ChanMask chans, ECUData &e)
+{
+    ChanWriter out = {p, 0, groupsPacked};
+    for (uint8_t ch = 0; chans; ++ch, chans >>= 1)
+    {
+        if (!(chans & 1))
+            continue;
+        const uint8_t fmt = pgm_read_byte(&chanDesc[ch].fmt);
+        const uint8_t scale = pgm_read_byte(&chanDesc[ch].scale);
+        const int32_t last = chan_raw(fmt, scale, e.value(ch));
+
+        ChanAgg *a = aggMode[ch] != AGG_LAST ? agg_slot(ch) : 0;
+        if (!a)
+        {
+            out.put(ch, last);
+            continue;
+        }
+
+        // nothing sampled this period: the current value stands for all
+        const int32_t lo = a->n ? a->min : last;
+        const int32_t hi = a->n ? a->max : last;
+        const int32_t mean = a->n ? (a->sum + (a->sum < 0 ? -(int32_t)a->n : a->n) / 2) / a->n : last;
+        if (aggMode[ch] == AGG_MINMAX || aggMode[ch] == AGG_MMM)
+        {
+            out.put(ch, lo);
+            out.put(ch, hi);
+        }
+        if (aggMode[ch] == AGG_MEAN || aggMode[ch] == AGG_MMM)
+            out.put(ch, mean);
+        a->n = 0;
+    }
+    return out.len();
+}
+
+void fitGroupsToBudget(uint32_t baud)
+{
+    // bytes/s at 8N1
+    const uint32_t budget = baud / 10 * LINK_BUDGET_PCT / 100;
+    uint32_t load = 0;
+    for (uint8_t g = 0; g < GROUP_COUNT; ++g)
+    {
+        if (!groups[g].chans || !groups[g].periodMs)
+            continue;
+        const uint32_t frame = groupPayloadLen(groups[g].chans, groupsPacked) + GROUP_FRAME_OVERHEAD;
+        load += frame * 1000UL / groups[g].periodMs;
+    }
+
+    for (uint8_t g = 0; g < GROUP_COUNT; ++g)
+    {
+        // up to 65535 ms times a load of any size: 64 bits
+        uint64_t ms = groups[g].periodMs;
+        if (load > budget)
+            ms = (ms * load + budget - 1) / budget;
+        groups[g].fitMs = ms > 0xFFFF ? 0xFFFF : (uint16_t)ms;
+    }
+}
+
+uint8_t groupsDue(uint32_t now)
+{
+    uint8_t due = 0;
+    for (uint8_t g = 0; g < GROUP_COUNT; ++g)
+    {
+        if (groups[g].chans && groups[g].fitMs && now - groups[g].lastMs >= groups[g].fitMs)
+            due |= 1 << g;
+    }
+    return due;
+}
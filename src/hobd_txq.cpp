@@ -0,0 +1,91 @@
+#include "hobd_txq.hpp"
+
+static uint8_t alarmBuf[TXQ_ALARM_SIZE];
+static uint8_t replyBuf[TXQ_REPLY_SIZE];
+static uint8_t telemBuf[TXQ_TELEM_SIZE];
+static uint8_t bulkBuf[TXQ_BULK_SIZE];
+
+TxQueue txq[TXC_COUNT] = {
+    {alarmBuf, TXQ_ALARM_SIZE, 0, 0, 0, 0, 0},
+    {replyBuf, TXQ_REPLY_SIZE, 0, 0, 0, 0, 0},
+    {telemBuf, TXQ_TELEM_SIZE, 0, 0, 0, 0, 0},
+    {bulkBuf, TXQ_BULK_SIZE, 0, 0, 0, 0, 0},
+};
+
+static uint8_t q_at(const TxQueue &q, uint8_t i)
+{
+    return q.buf[(uint8_t)((q.head + i) % q.size)];
+}
+
+static void q_pop(TxQueue &q)
+{
+    const uint8_t rec = 1 + q_at(q, 0);
+    q.head = (q.head + rec) % q.size;
+    q.used -= rec;
+}
+
+bool txPush(uint8_t cls, const uint8_t *frame, uint8_t len)
+{
+    TxQueue &q = txq[cls];
+    if (len > TXQ_MAX_FRAME || 1 + len > q.size)
+    {
+        q.dropped++;
+        return false;
+    }
+
+    while (q.size - q.used < 1 + len)
+    {
+        q_pop(q);
+        q.dropped++;
+    }
+
+    uint8_t tail = (q.head + q.used) % q.size;
+    q.buf[tail] = len;
+    for (uint8_t i = 0; i < len; ++i)
+    {
+        tail = (tail + 1) % q.size;
+        q.buf[tail] = frame[i];
+    }
+    q.used += 1 + len;
+    if (q.used > q.peak)
+        q.peak = q.used;
+    return true;
+}
+
+static void q_send(TxQueue &q, Print &out)
+{
+    // one write per frame, see BatchStream
+    uint8_t frame[TXQ_MAX_FRAME];
+    const uint8_t len = q_at(q, 0);
+    for (uint8_t i = 0; i < len; ++i)
+        frame[i] = q_at(q, 1 + i);
+    out.write(frame, len);
+    q_pop(q);
+    q.sent++;
+}
+
+void txPump(Print &out)
+{
+    for (;;)
+    {
+        uint8_t c = 0;
+        while (c < TXC_COUNT && !txq[c].used)
+            ++c;
+        if (c == TXC_COUNT)
+            return;
+        // the head frame of the best class waits for room rather than
+        // letting a lower class overtake it
+        if (out.availableForWrite() < q_at(txq[c], 0))
+            return;
+        q_send(txq[c], out);
+    }
+}
+
+void txDrain(Print &out)
+{
+    for (uint8_t c = 0; c < TXC_COUNT; ++c)
+    {
+        while (txq[c].used)
+            q_send(txq[c], out);
+    }
+}
@@ -1,11 +1,14 @@
 #include "hobd_uni2.hpp"
+#include "hobd_proto.hpp" // LIVE_FLG_
+#include "hobd_ktrace.hpp"
 
 // specialised startup sequence 
-const uint8_t startup[] = {0x68, 0x6a, 0xf5, 0xaf, 0xbf, 0xb3, 0xb2, 0xc1, 0xdb, 0xb3, 0xe9};
+const uint8_t startup[STARTUP_LEN] = {0x68, 0x6a, 0xf5, 0xaf, 0xbf, 0xb3, 0xb2, 0xc1, 0xdb, 0xb3, 0xe9};
 
 bool ECUData::init(){
     uint8_t n = sizeof(startup)/sizeof(startup[0]);
     for (uint8_t i = 0; i < n; i++){
+        KTRACE(KT_TX, startup[i]);
         dlc.write(startup[i]);
     }
     delay(300);
@@ -20,6 +23,13 @@ uint8_t ECUData::mkcrc(const uint8_t *buf, uint8_t len){
     return (uint8_t) (0xFF - (crc - 1));
 }
 
+// Errs keeps the first ErrLen failures, nothing clears it
+void ECUData::noteErr(ErrCodes e)
+{
+    if (errLen < ErrLen)
+        Errs[errLen++] = e;
+}
+
 bool ECUData::sendcmd(EcuCmd &ecmd){
     // Build TX frame: [cmd, txlen, reg, rxlen, crc]
 
@@ -35,7 +45,11 @@ bool ECUData::sendcmd(EcuCmd &ecmd){
 
     // TX
     dlc.listen();
-    for (uint8_t i = 0; i < cmdlen; ++i) dlc.write(tx[i]);
+    for (uint8_t i = 0; i < cmdlen; ++i)
+    {
+        KTRACE(KT_TX, tx[i]);
+        dlc.write(tx[i]);
+    }
 
     const uint16_t expected = (uint16_t)ecmd.rxlen + (uint16_t)MSG_OFFSET;
 
@@ -47,14 +61,16 @@ bool ECUData::sendcmd(EcuCmd &ecmd){
     {
         if (dlc.available())
         {
-            dlcData[i++] = (uint8_t)dlc.read();
+            dlcData[i] = (uint8_t)dlc.read();
+            KTRACE(KT_RX, dlcData[i]);
+            i++;
         }
     }
 
     if (i < expected)
     {
         dlctmo++;
-        Errs[errLen++] = TimeoutErr;
+        noteErr(TimeoutErr);
         return false;
     }
 
@@ -63,7 +79,7 @@ bool ECUData::sendcmd(EcuCmd &ecmd){
 
     if (calc != rxCrc)
     {
-        Errs[errLen++] = ChecksumErr;
+        noteErr(ChecksumErr);
         return false;
     }
 
@@ -111,7 +127,7 @@ bool ECUData::resetEcu()
     return true;
 }
 
-static uint16_t rx_u16(uint8_t *buffer, uint8_t offset){
+static uint16_t rx_u16(const uint8_t *buffer, uint8_t offset){
     return (uint16_t)(buffer[offset] << 8 | buffer[offset + 1]);
 }
 
@@ -119,22 +135,85 @@ static float cnvt_tmp(float f){
     return 55.04149 - f * 3.0414878 + pow(f, 2) * 0.03952185 - pow(f, 3) * 0.00029383913 + pow(f, 4) * 0.0000010792568 - pow(f, 5) * 0.0000000015618437;
 }
 
+static const ChanMask rowChans[HOBD_ROWS] = {
+    HOBD_ROW0_CHANS, HOBD_ROW1_CHANS, HOBD_ROW2_CHANS, HOBD_ROW3_CHANS};
+
+// Fetch one 0x10 byte row (reg row * 0x10) into liveRaw
+bool ECUData::readRow(uint8_t row)
+{
+    EcuCmd cmd{};
+    cmd.cmd = HOBD_CMD;
+    cmd.txlen = 0x05;
+    cmd.reg = row * HOBD_ROW_LEN;
+    cmd.rxlen = HOBD_ROW_LEN;
+
+    if (!sendcmd(cmd))
+        return false;
+
+    memcpy(liveRaw[row], dlcData + RPL_OFFSET, HOBD_ROW_LEN);
+    return true;
+}
+
 bool ECUData::readLiveData()
 {
-    float f;
-    // -------- Row 1: reg 0x00, len 0x10
+    ChanMask want = subMask;
+    if (want & CH_BIT(CH_MAF))
+        want |= HOBD_MAF_DEPS;
+
+    sampleUs = micros();
+
+    // only talk to the ECU for rows somebody is subscribed to
+    bool first = true;
+    for (uint8_t row = 0; row < HOBD_ROWS; ++row)
     {
-        EcuCmd cmd{};
-        cmd.cmd = HOBD_CMD;
-        cmd.txlen = 0x05;
-        cmd.reg = HOBD_OFF_RPM;
-        cmd.rxlen = 0x10;
+        if (!(want & rowChans[row]))
+            continue;
+        if (!first)
+            delay(1);
+        first = false;
 
-        if (!sendcmd(cmd))
+        if (!readRow(row))
             return false;
+        // raw bytes changed, drop the old conversions for this row
+        decoded &= ~rowChans[row];
+    }
+    decoded &= ~CH_BIT(CH_MAF);
+
+    decode(want);
+    return true;
+}
+
+// Convert the requested channels from liveRaw. Channels already decoded
+// since the last fetch are skipped, rows outside the subscription hold the
+// bytes of their last fetch.
+void ECUData::decode(ChanMask mask)
+{
+    if (mask & CH_BIT(CH_MAF))
+        mask |= HOBD_MAF_DEPS;
+
+    mask &= ~decoded;
+    for (uint8_t ch = 0; mask; ++ch, mask >>= 1)
+    {
+        if (mask & 1)
+            decodeChannel(ch);
+    }
+}
+
+void ECUData::decodeChannel(uint8_t ch)
+{
+    const uint8_t *r0 = liveRaw[0];
+    const uint8_t *r1 = liveRaw[1];
+    const uint8_t *r2 = liveRaw[2];
+    const uint8_t *r3 = liveRaw[3];
+    float f;
 
+    switch (ch)
+    {
+    // -------- Row 1: reg 0x00
+    case CH_RPM:
+    {
         // RPM (WORD at payload offset 0x00)
-        uint16_t rawRpm = rx_u16(dlcData, RPL_OFFSET + HOBD_OFF_RPM);
+        uint16_t rawRpm = rx_u16(r0, HOBD_OFF_RPM);
 
         if (obd_sel == 1)
         {
@@ -144,13 +223,16 @@ bool ECUData::readLiveData()
 
         if (rpm < 0)
             rpm = 0;
-
+        break;
+    }
+    case CH_VSS:
         // VSS (BYTE at offset 0x02)
-        vss = dlcData[RPL_OFFSET + HOBD_OFF_VSS];
-
-        // Flags
-        const uint8_t f08 = dlcData[RPL_OFFSET + HOBD_OFF_FLAG_08];
-        const uint8_t f0B = dlcData[RPL_OFFSET + HOBD_OFF_FLAG_0B];
+        vss = r0[HOBD_OFF_VSS];
+        break;
+    case CH_FLAGS:
+    {
+        const uint8_t f08 = r0[HOBD_OFF_FLAG_08];
+        const uint8_t f0B = r0[HOBD_OFF_FLAG_0B];
 
         sw_aircon = (f08 & HOBD_FLG_AC_SWITCH) != 0;
         sw_brake = (f08 & HOBD_FLG_BRAKE) != 0;
@@ -159,103 +241,118 @@ bool ECUData::readLiveData()
 
         main_relay = (f0B & HOBD_FLG_MAIN_RELAY) != 0;
         cel = (f0B & HOBD_FLG_CEL) != 0;
+        break;
     }
 
-    delay(1);
-
-    // -------- Row 2: reg 0x10, len 0x10
-    {
-        EcuCmd cmd{};
-        cmd.cmd = HOBD_CMD;
-        cmd.txlen = 0x05;
-        cmd.reg = HOBD_OFF_ECT;
-        cmd.rxlen = 0x10;
-
-        if (!sendcmd(cmd))
-            return false;
-
+    // -------- Row 2: reg 0x10
+    case CH_ECT:
         // Temps (BYTE at 0x10 CTS and 0x11 IAT)
-        ect = cnvt_tmp(dlcData[RPL_OFFSET]);
-        iat = cnvt_tmp(dlcData[RPL_OFFSET + HOBD_OFF_IAT - HOBD_OFF_ECT]);
-
-        auto conv_kpa = [](uint8_t v) -> float
-        {
-            return v * 0.716f - 5.0f;
-        };
-        // MAP & BARO
-        maps = conv_kpa(dlcData[RPL_OFFSET + HOBD_OFF_MAP - HOBD_OFF_ECT]);
-        baro = conv_kpa(dlcData[RPL_OFFSET + HOBD_OFF_MAP + 1 - HOBD_OFF_ECT]);
-
-        // TPS
-        tps = (dlcData[RPL_OFFSET + HOBD_OFF_TPS - HOBD_OFF_ECT] - 24) / 2;
-
+        ect = cnvt_tmp(r1[HOBD_OFF_ECT - HOBD_OFF_ECT]);
+        break;
+    case CH_IAT:
+        iat = cnvt_tmp(r1[HOBD_OFF_IAT - HOBD_OFF_ECT]);
+        break;
+    case CH_MAP:
+        maps = r1[HOBD_OFF_MAP - HOBD_OFF_ECT] * 0.716f - 5.0f;
+        break;
+    case CH_BARO:
+        baro = r1[HOBD_OFF_MAP + 1 - HOBD_OFF_ECT] * 0.716f - 5.0f;
+        break;
+    case CH_TPS:
+        tps = (r1[HOBD_OFF_TPS - HOBD_OFF_ECT] - 24) / 2;
+        break;
+    case CH_O2:
         // O2 voltage
-        f = dlcData[RPL_OFFSET + HOBD_OFF_O2 - HOBD_OFF_ECT];
+        f = r1[HOBD_OFF_O2 - HOBD_OFF_ECT];
         o2 = f / 51.3f;
-
+        break;
+    case CH_VOLT:
         // Battery voltage
-        f = dlcData[RPL_OFFSET + HOBD_OFF_VOLT - HOBD_OFF_ECT];
-        volt =  f / 10.45f;
-
+        f = r1[HOBD_OFF_VOLT - HOBD_OFF_ECT];
+        volt = f / 10.45f;
+        break;
+    case CH_ALTF:
         // Alternator raw byte (0x18)
-        f = dlcData[RPL_OFFSET + HOBD_OFF_ALTF - HOBD_OFF_ECT];
+        f = r1[HOBD_OFF_ALTF - HOBD_OFF_ECT];
         alt_fr = f / 2.55;
-
-        f = dlcData[RPL_OFFSET + HOBD_OFF_EL - HOBD_OFF_ECT];
+        break;
+    case CH_ELD:
+        f = r1[HOBD_OFF_EL - HOBD_OFF_ECT];
         eld = 77.06 - f / 2.5371;
-    }
-
-    delay(1);
-
-    // -------- Row 3: reg 0x20, len 0x10
+        break;
+
+    // -------- Row 3: reg 0x20
+    case CH_SFT:
+        sft = ((float)r2[0] / 128.0f - 1.0f) * 100.0f;
+        break;
+    case CH_LFT:
+        lft = ((float)r2[1] / 128.0f - 1.0f) * 100.0f;
+        break;
+    case CH_INJ:
     {
-        EcuCmd cmd{};
-        cmd.cmd = HOBD_CMD;
-        cmd.txlen = 0x05;
-        cmd.reg = 0x20;
-        cmd.rxlen = 0x10;
-
-        if (!sendcmd(cmd))
-            return false;
-
-        const uint8_t sft_raw = dlcData[RPL_OFFSET];
-        const uint8_t lft_raw = dlcData[RPL_OFFSET + 1];
-
-        sft = ((float)sft_raw / 128.0f - 1.0f) * 100.0f;
-        lft = ((float)lft_raw / 128.0f - 1.0f) * 100.0f;
-
         // Inj (WORD)
-        uint16_t injRaw = rx_u16(dlcData, RPL_OFFSET + 4);
+        uint16_t injRaw = rx_u16(r2, 4);
         inj = ((float)injRaw) / 250.0f;
-
-        // Ign and LMT
-        f = dlcData[8];
+        break;
+    }
+    case CH_IGN:
+        f = r2[6];
         ign = (f - 24) / 4; // (degrees)
-        f = dlcData[9];
+        break;
+    case CH_LMT:
+        f = r2[7];
         lmt = (f - 24) / 4;
-
+        break;
+    case CH_IACV:
         // IACV (%)
-        iacv = dlcData[10] / 2.55f;
-    }
+        iacv = r2[8] / 2.55f;
+        break;
 
-    delay(1);
+    // -------- Row 4: reg 0x30
+    case CH_KNOC:
+        knoc = r3[12] / 51; // 0 to 5
+        break;
 
-    // -------- Row 4: reg 0x30, len 0x10
+    case CH_MAF:
     {
-        EcuCmd cmd{};
-        cmd.cmd = HOBD_CMD;
-        cmd.txlen = 0x05;
-        cmd.reg = 0x30;
-        cmd.rxlen = 0x10;
-
-        if (!sendcmd(cmd))
-            return false;
-
-        knoc = dlcData[14] / 51; // 0 to 5
+        int imap = rpm * maps / (iat + 273) / 2;
+        maf = (imap / 60) * (80 / 100) * 1.595 * 28.9644 / 8.314472;
+        break;
+    }
     }
 
-    int imap = rpm * maps / (iat + 273) / 2;
-    maf = (imap / 60) * (80 / 100) * 1.595 * 28.9644 / 8.314472;
+    decoded |= CH_BIT(ch);
+}
 
-    return true;
+// Current value of one channel, decoding it first if nobody has yet
+float ECUData::value(uint8_t ch)
+{
+    decode(CH_BIT(ch));
+
+    switch (ch)
+    {
+    case CH_RPM: return rpm;
+    case CH_VSS: return vss;
+    case CH_FLAGS:
+        return (sw_aircon ? LIVE_FLG_AIRCON : 0) | (sw_brake ? LIVE_FLG_BRAKE : 0) |
+               (sw_vtec ? LIVE_FLG_VTEC : 0) | (cel ? LIVE_FLG_CEL : 0);
+    case CH_ECT: return ect;
+    case CH_IAT: return iat;
+    case CH_MAP: return maps;
+    case CH_BARO: return baro;
+    case CH_TPS: return tps;
+    case CH_O2: return o2;
+    case CH_VOLT: return volt;
+    case CH_ALTF: return alt_fr;
+    case CH_ELD: return eld;
+    case CH_SFT: return sft;
+    case CH_LFT: return lft;
+    case CH_INJ: return inj;
+    case CH_IGN: return ign;
+    case CH_LMT: return lmt;
+    case CH_IACV: return iacv;
+    case CH_KNOC: return knoc;
+    case CH_MAF: return maf;
+    }
+    return 0;
 }
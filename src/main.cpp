@@ -1,95 +1,282 @@
 #include "hobd_uni2.hpp" // your ECUData + offsets + sendcmd + readLiveData + scanDtc
+#include "hobd_proto.hpp"
+#include "hobd_telem.hpp"
+#include "hobd_batch.hpp"
+#include "hobd_txq.hpp"
+#include "hobd_ktrace.hpp"
 
 SoftwareSerialWithHalfDuplex dlcSerial(8, 8, false, false);
 
 // ECU logic wrapper
 ECUData ecu(1 /*obd_sel*/, dlcSerial);
 
-enum MsgType : uint8_t
+// Wire format (message types, commands, payload layouts) is in hobd_proto.hpp
+
+#define CMD_TMO_MS 50
+
+// ---- Capabilities (MSG_CAPS) ----
+// CMD_SET_BAUD switches to baudRates[code]. The link falls back to the old
+// rate unless a valid CMD_BAUD_TEST arrives at the new one within
+// BAUD_CONFIRM_MS.
+// 16 MHz AVR + 16U2/CH340 bridge manage 1M, override per board.
+// A Bluetooth module's UART rate is set with AT commands, leave it be.
+#ifdef HOBD_BT_LINK
+#undef HOST_BAUD_MAX_CODE
+#define HOST_BAUD_MAX_CODE 0
+#endif
+#ifndef HOST_BAUD_MAX_CODE
+#define HOST_BAUD_MAX_CODE 4
+#endif
+#define BAUD_CONFIRM_MS 1000
+static_assert(HOST_BAUD_MAX_CODE < BAUD_CODES, "HOST_BAUD_MAX_CODE");
+
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 64
+#endif
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+
+#ifdef HOBD_KTRACE
+#define KTRACE_FEATURES FEAT_KTRACE
+#else
+#define KTRACE_FEATURES 0
+#endif
+#ifdef HOBD_BT_LINK
+#define FEATURES (FEAT_DTC | FEAT_RESET | FEAT_SEQ | FEAT_TIME | FEAT_GROUPS | \
+                  FEAT_AGG | FEAT_PACKED | FEAT_BATCHED | FEAT_QOS | KTRACE_FEATURES)
+#else
+#define FEATURES (FEAT_DTC | FEAT_RESET | FEAT_BAUD | FEAT_SEQ | FEAT_TIME | FEAT_GROUPS | \
+                  FEAT_AGG | FEAT_PACKED | FEAT_QOS | KTRACE_FEATURES)
+#endif
+#define FRAMINGS ((1 << FRAMING_SOF) | (1 << FRAMING_COBS))
+
+static constexpr uint32_t CHAN_SCHEMA_HASH = fnv1a(CHAN_SCHEMA);
+
+// ---- Host link ----
+#ifdef HOBD_BT_LINK
+// UART Bluetooth module on the hardware serial pins (USB unplugged)
+#ifndef BT_BATCH
+#define BT_BATCH 64 // module packet size
+#endif
+#ifndef BT_FLUSH_MS
+#define BT_FLUSH_MS 20 // max time a frame waits for company
+#endif
+static uint8_t btBuf[BT_BATCH];
+BatchStream btLink(Serial, btBuf, BT_BATCH, BT_FLUSH_MS);
+Stream &link = btLink;
+#else
+#define BT_BATCH 0
+#define BT_FLUSH_MS 0
+Stream &link = Serial;
+#endif
+
+static uint8_t linkFraming = FRAMING_SOF;
+
+static uint8_t frameClass(uint8_t type)
 {
-  MSG_LIVE = 0x81,
-  MSG_DTC = 0x82,
-  MSG_ACK = 0x83,
-  MSG_ERR = 0x84
-};
+  if (type == MSG_ALARM)
+    return TXC_ALARM;
+  if (type == MSG_LIVE || (type & 0xF0) == MSG_GROUP || (type & 0xF0) == MSG_PGROUP)
+    return TXC_TELEM;
+  if (type == MSG_KTRACE)
+    return TXC_BULK;
+  return TXC_REPLY;
+}
+
+// Encode, queue by class and send what the link has room for
+static void sendFrame(Stream &out, uint8_t type, const uint8_t *payload, uint8_t len)
+{
+  uint8_t buf[FRAME_MAX];
+  const uint8_t n = frame_encode(linkFraming, buf, type, payload, len);
+  txPush(frameClass(type), buf, n);
+  txPump(out);
+}
 
-enum Cmd : uint8_t
+// ---- Telemetry streams ----
+enum TelemStream : uint8_t
 {
-  CMD_GET_LIVE = 0x01,
-  CMD_GET_DTC = 0x02,
-  CMD_RESET = 0x03
+  STREAM_LIVE,
+  STREAM_GROUP, // + group index
+  STREAM_COUNT = STREAM_GROUP + GROUP_COUNT
 };
 
-// ---- Protocol ----
-static const uint8_t SOF1 = 0xAA;
-static const uint8_t SOF2 = 0x55;
+static uint16_t txSeq[STREAM_COUNT];
 
-static void sendFrame(Stream &out, uint8_t type, const uint8_t *payload, uint8_t len)
+static void sendTelemetry(Stream &out, uint8_t type, uint8_t stream, uint32_t sampleUs,
+                          const uint8_t *payload, uint8_t len)
 {
-  uint8_t header[4] = {SOF1, SOF2, type, len};
-  uint8_t crc = 0;
-  crc += ECUData::mkcrc(header, 4);
-  crc += ECUData::mkcrc(payload, len);
+  uint8_t buf[MAX_PAYLOAD];
+  if (len > MAX_PAYLOAD - TELEM_HDR_LEN)
+    len = MAX_PAYLOAD - TELEM_HDR_LEN;
 
-  out.write(header, 4);
-  if (len)
-    out.write(payload, len);
-  out.write((uint8_t)(crc & 0xFF));
+  const TelemHdr hdr = {txSeq[stream]++, sampleUs};
+  telem_encode(buf, hdr);
+  memcpy(buf + TELEM_HDR_LEN, payload, len);
+  sendFrame(out, type, buf, TELEM_HDR_LEN + len);
 }
 
-static bool readCmdFrame(Stream &in, uint8_t &cmdOut)
+// A K-line exchange blocks for longer than BT_FLUSH_MS: a partial batch
+// goes out before one instead of waiting through it for poll()
+static void linkBeforeEcu()
 {
-  if (!in.available())
-    return false;
-  cmdOut = (uint8_t)in.read();
-  return true;
+#ifdef HOBD_BT_LINK
+  btLink.flush();
+#endif
+}
+
+// micros() when the last command's final byte was read
+static uint32_t cmdRxUs = 0;
+
+static bool readCmdFrame(Stream &in, uint8_t &cmdOut, uint8_t *args)
+{
+  static uint8_t buf[1 + CMD_MAX_ARGS];
+  static uint8_t have = 0;
+  static uint32_t tLast = 0;
+
+  // a half received command is dropped so one lost byte can't shift
+  // every command after it
+  if (have && millis() - tLast > CMD_TMO_MS)
+    have = 0;
+
+  while (in.available())
+  {
+    buf[have++] = (uint8_t)in.read();
+    tLast = millis();
+    if (have == 1 + cmdArgLen(buf[0]))
+    {
+      cmdRxUs = micros();
+      cmdOut = buf[0];
+      memcpy(args, buf + 1, have - 1);
+      have = 0;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Channels pack_live reads, the only ones decoded on every poll
+static const ChanMask LIVE_CHANS =
+    CH_BIT(CH_RPM) | CH_BIT(CH_VSS) | CH_BIT(CH_FLAGS) | CH_BIT(CH_ECT) |
+    CH_BIT(CH_IAT) | CH_BIT(CH_MAP) | CH_BIT(CH_TPS) | CH_BIT(CH_VOLT) |
+    CH_BIT(CH_O2) | CH_BIT(CH_MAF);
+
+static uint8_t pack_caps(uint8_t *p)
+{
+  const Caps caps = {
+      PROTO_VERSION, FRAMINGS, baudRates[HOST_BAUD_MAX_CODE], LIVE_SCHEMA_HASH,
+      SERIAL_RX_BUFFER_SIZE, SERIAL_TX_BUFFER_SIZE, MAX_PAYLOAD, LIVE_LEN,
+      FEATURES, CHAN_SCHEMA_HASH, BT_BATCH, BT_FLUSH_MS};
+  return caps_encode(p, caps);
+}
+
+// count(u8), then per group: period(u16 ms, after budget fit), chans(u32)
+static uint8_t pack_groups(uint8_t *p)
+{
+  uint8_t n = 0;
+  p[n++] = GROUP_COUNT;
+  for (uint8_t g = 0; g < GROUP_COUNT; ++g)
+  {
+    put_u16(p + n, groups[g].fitMs);
+    put_u32(p + n + 2, groups[g].chans);
+    n += 6;
+  }
+  return n;
 }
 
 // Pack floats as int16/int32 to keep payload small and easy.
 static void pack_live(uint8_t *p, const ECUData &e)
 {
-  // layout:
-  // rpm(u16), vss(u8), ect(i16*10), iat(i16*10), map(i16*10), tps(i16*10),
-  // batt(u16*100), o2(u16*1000), flags(u8)
-  uint16_t rpm = (uint16_t)max(0.0f, e.rpm);
-  p[0] = rpm >> 8;
-  p[1] = rpm & 0xFF;
-  p[2] = e.vss;
-
-  uint16_t ect = (uint16_t)(e.ect * 10.0f);
-  uint16_t iat = (uint16_t)(e.iat * 10.0f);
-  uint16_t map = (uint16_t)(e.maps * 10.0f);
-  uint16_t tps = (uint16_t)(e.tps * 10.0f);
-
-  p[3] = ect >> 8;
-  p[4] = ect & 0xFF;
-  p[5] = iat >> 8;
-  p[6] = iat & 0xFF;
-  p[7] = map >> 8;
-  p[8] = map & 0xFF;
-  p[9] = tps >> 8;
-  p[10] = tps & 0xFF;
-
-  uint16_t batt = (uint16_t)(e.volt * 100.0f);
-  p[11] = batt >> 8;
-  p[12] = batt & 0xFF;
-
-  uint16_t o2mv = (uint16_t)(e.o2 * 100.0f);
-  p[13] = o2mv >> 8;
-  p[14] = o2mv & 0xFF;
-
-  uint8_t flags = 0;
-  flags |= e.sw_aircon ? (1 << 0) : 0;
-  flags |= e.sw_brake ? (1 << 1) : 0;
-  flags |= e.sw_vtec ? (1 << 2) : 0;
-  flags |= e.cel ? (1 << 3) : 0;
-  p[15] = flags;
-
-  p[16] = e.maf >> 8;
-  p[17] = e.maf & 0xFF;
+  LiveRecord r;
+  r.rpm = (uint16_t)max(0.0f, e.rpm);
+  r.vss = e.vss;
+  r.ect = (int16_t)(e.ect * 10.0f);
+  r.iat = (int16_t)(e.iat * 10.0f);
+  r.map = (int16_t)(e.maps * 10.0f);
+  r.tps = (int16_t)(e.tps * 10.0f);
+  r.batt = (uint16_t)(e.volt * 100.0f);
+  r.o2 = (uint16_t)(e.o2 * 100.0f);
+
+  r.flags = 0;
+  r.flags |= e.sw_aircon ? LIVE_FLG_AIRCON : 0;
+  r.flags |= e.sw_brake ? LIVE_FLG_BRAKE : 0;
+  r.flags |= e.sw_vtec ? LIVE_FLG_VTEC : 0;
+  r.flags |= e.cel ? LIVE_FLG_CEL : 0;
+
+  r.maf = e.maf;
+  live_encode(p, r);
 }
 
-Stream &link = Serial;
+// ---- Alarms ----
+// an alarm clears this far below its threshold
+#define ALARM_HYST 2
+
+static bool alarmEct = false;
+static bool alarmVss = false;
+
+static void sendAlarm(Stream &out, uint8_t id, bool active, float value)
+{
+  const AlarmRecord a = {id, active, (int16_t)(value * 10)};
+  uint8_t payload[ALARM_LEN];
+  alarm_encode(payload, a);
+  sendFrame(out, MSG_ALARM, payload, sizeof(payload));
+}
+
+static bool checkAlarm(Stream &out, uint8_t id, bool &state, float value, uint8_t limit)
+{
+  const bool active = state ? value > limit - ALARM_HYST : value > limit;
+  if (active != state)
+    sendAlarm(out, id, active, value);
+  return active;
+}
+
+// Raise or clear the ECU's alarms on the channels just read
+static void checkAlarms(Stream &out, const ChanMask got)
+{
+  if (got & CH_BIT(CH_ECT))
+    alarmEct = checkAlarm(out, ALARM_ECT, alarmEct, ecu.ect, ecu.ect_alarm);
+  if (got & CH_BIT(CH_VSS))
+    alarmVss = checkAlarm(out, ALARM_VSS, alarmVss, ecu.vss, ecu.vss_alarm);
+}
+
+// sent(u16) dropped(u16) peak(u8) for each TxClass
+static uint8_t pack_stats(uint8_t *p)
+{
+  uint8_t n = 0;
+  for (uint8_t c = 0; c < TXC_COUNT; ++c)
+  {
+    const TxQueue &q = txq[c];
+    put_u16(p + n, q.sent);
+    put_u16(p + n + 2, q.dropped);
+    p[n + 4] = q.peak;
+    n += 5;
+  }
+  return n;
+}
+
+// ---- Host baud switching ----
+static uint8_t baudCode = 0;       // confirmed rate
+static uint8_t baudPrevCode = 0;   // rate to fall back to
+static bool baudPending = false;   // switched, waiting for CMD_BAUD_TEST
+static uint32_t baudSwitchMs = 0;
+
+static void setHostBaud(uint8_t code)
+{
+  Serial.flush(); // let the ACK out at the old rate
+  Serial.end();
+  Serial.begin(baudRates[code]);
+  fitGroupsToBudget(baudRates[code]);
+}
+
+static void checkBaudFallback()
+{
+  if (baudPending && millis() - baudSwitchMs > BAUD_CONFIRM_MS)
+  {
+    baudPending = false;
+    baudCode = baudPrevCode;
+    setHostBaud(baudCode);
+  }
+}
 
 bool pollEvery(uint16_t ms){
   static uint32_t msTick = millis();
@@ -100,9 +287,78 @@ bool pollEvery(uint16_t ms){
   return ecu.readLiveData();
 }
 
+// ---- Streaming ----
+static bool streaming = false;
+
+// Read the rows the due groups need and send one frame per due group.
+// Aggregated channels are read on every pass so their summaries see
+// every sample the K-line can deliver.
+static void streamGroups(Stream &out)
+{
+  const uint32_t now = millis();
+  const uint8_t due = groupsDue(now);
+
+  ChanMask active = 0;
+  ChanMask want = 0;
+  for (uint8_t g = 0; g < GROUP_COUNT; ++g)
+  {
+    if (groups[g].fitMs)
+      active |= groups[g].chans;
+    if (due & (1 << g))
+    {
+      want |= groups[g].chans;
+      groups[g].lastMs = now;
+    }
+  }
+  const ChanMask agg = aggChans() & active;
+  want |= agg;
+  if (!want)
+    return;
+
+  ecu.subMask = want;
+  linkBeforeEcu();
+  if (!ecu.readLiveData())
+  {
+    const uint8_t err = ERR_LIVE;
+    sendFrame(out, MSG_ERR, &err, 1);
+    return;
+  }
+  aggSample(ecu, agg);
+  checkAlarms(out, want);
+
+  for (uint8_t g = 0; g < GROUP_COUNT; ++g)
+  {
+    if (!(due & (1 << g)))
+      continue;
+    uint8_t payload[MAX_PAYLOAD - TELEM_HDR_LEN];
+    uint8_t n = packGroup(payload, groups[g].chans, ecu);
+    sendTelemetry(out, (groupsPacked ? MSG_PGROUP : MSG_GROUP) + g, STREAM_GROUP + g,
+                  ecu.sampleUs, payload, n);
+  }
+}
+
+#ifdef HOBD_KTRACE
+// Queue MSG_KTRACE frames while the bulk queue has room for a whole one,
+// never dropping trace frames to make room for more
+static void sendKtrace(Stream &out)
+{
+  const TxQueue &q = txq[TXC_BULK];
+  while (q.size - q.used >= 1 + FRAME_MAX)
+  {
+    uint8_t payload[MAX_PAYLOAD];
+    const uint8_t n = ktracePack(payload);
+    if (!n)
+      return;
+    sendFrame(out, MSG_KTRACE, payload, n);
+  }
+}
+#endif
+
 void loop()
 {
-  // Stream &link = btSerial;
+#ifdef HOBD_BT_LINK
+  btLink.poll();
+#endif
 
   // if (!pollEvery(250)){
   //   const uint8_t err = 1;
@@ -110,26 +366,43 @@ void loop()
   //   return;
   // }
 
+  txPump(link);
+#ifdef HOBD_KTRACE
+  sendKtrace(link);
+#endif
+  checkBaudFallback();
+  if (streaming)
+    streamGroups(link);
+
   uint8_t cmd;
-  if (!readCmdFrame(link, cmd))
+  uint8_t args[CMD_MAX_ARGS];
+  if (!readCmdFrame(link, cmd, args))
+    return;
+  // until the confirm the two ends may run at different rates, and
+  // anything else is likely bytes garbled by the mismatch
+  if (baudPending && cmd != CMD_BAUD_TEST)
     return;
   if (cmd == CMD_GET_LIVE)
   {
+    ecu.subMask = LIVE_CHANS;
+    linkBeforeEcu();
     if (!ecu.readLiveData())
     {
-      const uint8_t err = 1;
+      const uint8_t err = ERR_LIVE;
       sendFrame(link, MSG_ERR, &err, 1);
       return;
     }
-    uint8_t payload[18];
+    checkAlarms(link, LIVE_CHANS);
+    uint8_t payload[LIVE_LEN];
     pack_live(payload, ecu);
-    sendFrame(link, MSG_LIVE, payload, sizeof(payload));
+    sendTelemetry(link, MSG_LIVE, STREAM_LIVE, ecu.sampleUs, payload, sizeof(payload));
   }
   else if (cmd == CMD_GET_DTC)
   {
+    linkBeforeEcu();
     if (!ecu.scanDtc())
     {
-      const uint8_t err = 2;
+      const uint8_t err = ERR_DTC;
       sendFrame(link, MSG_ERR, &err, 1);
       return;
     }
@@ -142,13 +415,165 @@ void loop()
   }
   else if (cmd == CMD_RESET)
   {
+    if (memcmp(args, RESET_MAGIC, sizeof(RESET_MAGIC)) != 0)
+    {
+      const uint8_t err = ERR_BAD_ARG;
+      sendFrame(link, MSG_ERR, &err, 1);
+      return;
+    }
+    linkBeforeEcu();
     bool ok = ecu.resetEcu();
     uint8_t payload[1] = {(uint8_t)(ok ? 1 : 0)};
     sendFrame(link, MSG_ACK, payload, 1);
   }
+  else if (cmd == CMD_SET_FRAMING)
+  {
+    if (args[0] != FRAMING_SOF && args[0] != FRAMING_COBS)
+    {
+      const uint8_t err = ERR_BAD_ARG;
+      sendFrame(link, MSG_ERR, &err, 1);
+      return;
+    }
+    // the host switches its parser when it sends the command, so nothing
+    // queued in the old framing may follow the ACK
+    txDrain(link);
+    linkFraming = args[0];
+    uint8_t payload[2] = {CMD_SET_FRAMING, linkFraming};
+    sendFrame(link, MSG_ACK, payload, 2);
+  }
+  else if (cmd == CMD_HELLO)
+  {
+    uint8_t payload[CAPS_LEN];
+    sendFrame(link, MSG_CAPS, payload, pack_caps(payload));
+  }
+  else if (cmd == CMD_TIME_SYNC)
+  {
+    // token(u32) echoed, rx(u32 micros), tx(u32 micros): one NTP style
+    // exchange, the host does the offset / drift estimation
+    // whatever is queued or in the UART goes out first: sent after the tx
+    // stamp it would be delay the host can't account for
+    txDrain(link);
+    link.flush();
+#ifdef HOBD_BT_LINK
+    Serial.flush(); // the batch went to the UART buffer
+#endif
+    uint8_t payload[12];
+    memcpy(payload, args, 4);
+    put_u32(payload + 4, cmdRxUs);
+    put_u32(payload + 8, micros());
+    // straight to the link, past the queues and the batch
+    uint8_t buf[FRAME_MAX];
+    link.write(buf, frame_encode(linkFraming, buf, MSG_TIME, payload, sizeof(payload)));
+    txq[TXC_REPLY].sent++;
+    link.flush();
+  }
+  else if (cmd == CMD_STREAM)
+  {
+    streaming = args[0] != 0;
+    for (uint8_t g = 0; g < GROUP_COUNT; ++g)
+      groups[g].lastMs = millis() - groups[g].fitMs;
+    uint8_t payload[2] = {CMD_STREAM, (uint8_t)streaming};
+    sendFrame(link, MSG_ACK, payload, 2);
+  }
+  else if (cmd == CMD_SET_PACKED)
+  {
+    groupsPacked = args[0] != 0;
+    fitGroupsToBudget(baudRates[baudCode]);
+    uint8_t payload[2] = {CMD_SET_PACKED, (uint8_t)groupsPacked};
+    sendFrame(link, MSG_ACK, payload, 2);
+  }
+  else if (cmd == CMD_GET_GROUPS || cmd == CMD_SET_GROUP)
+  {
+    if (cmd == CMD_SET_GROUP)
+    {
+      const uint8_t g = args[0];
+      const uint16_t period = (uint16_t)args[1] << 8 | args[2];
+      const ChanMask chans = ((ChanMask)args[3] << 24 | (ChanMask)args[4] << 16 |
+                              (ChanMask)args[5] << 8 | args[6]) & CH_ALL;
+      // byte aligned is never shorter than packed, so check that one
+      if (g >= GROUP_COUNT || (period && period < GROUP_MIN_PERIOD_MS) ||
+          groupPayloadLen(chans, false) > MAX_PAYLOAD - TELEM_HDR_LEN)
+      {
+        const uint8_t err = ERR_BAD_ARG;
+        sendFrame(link, MSG_ERR, &err, 1);
+        return;
+      }
+      groups[g].chans = chans;
+      groups[g].periodMs = period;
+      fitGroupsToBudget(baudRates[baudCode]);
+    }
+    uint8_t payload[1 + GROUP_COUNT * 6];
+    sendFrame(link, MSG_GROUPS, payload, pack_groups(payload));
+  }
+  else if (cmd == CMD_GET_AGG || cmd == CMD_SET_AGG)
+  {
+    if (cmd == CMD_SET_AGG)
+    {
+      const uint8_t ch = args[0];
+      const uint8_t old = ch < CH_COUNT ? aggMode[ch] : AGG_LAST;
+      bool ok = ch < CH_COUNT && args[1] < AGG_MODES && setAggMode(ch, args[1]);
+      // wider summaries must still fit every group frame
+      for (uint8_t g = 0; ok && g < GROUP_COUNT; ++g)
+        ok = groupPayloadLen(groups[g].chans, false) <= MAX_PAYLOAD - TELEM_HDR_LEN;
+      if (!ok)
+      {
+        if (ch < CH_COUNT)
+          setAggMode(ch, old);
+        const uint8_t err = ERR_BAD_ARG;
+        sendFrame(link, MSG_ERR, &err, 1);
+        return;
+      }
+      fitGroupsToBudget(baudRates[baudCode]);
+    }
+    sendFrame(link, MSG_AGG, aggMode, CH_COUNT);
+  }
+  else if (cmd == CMD_GET_STATS)
+  {
+    uint8_t payload[5 * TXC_COUNT];
+    sendFrame(link, MSG_STATS, payload, pack_stats(payload));
+  }
+  else if (cmd == CMD_SET_BAUD)
+  {
+    if (args[0] > HOST_BAUD_MAX_CODE || baudPending)
+    {
+      const uint8_t err = ERR_BAD_ARG;
+      sendFrame(link, MSG_ERR, &err, 1);
+      return;
+    }
+    uint8_t payload[2] = {CMD_SET_BAUD, args[0]};
+    sendFrame(link, MSG_ACK, payload, 2);
+    txDrain(link);
+
+    baudPrevCode = baudCode;
+    baudCode = args[0];
+    baudPending = true;
+    baudSwitchMs = millis();
+    setHostBaud(baudCode);
+  }
+  else if (cmd == CMD_BAUD_TEST)
+  {
+    if (memcmp(args, BAUD_TEST_PATTERN, sizeof(BAUD_TEST_PATTERN)) != 0)
+    {
+      const uint8_t err = ERR_BAD_ARG;
+      sendFrame(link, MSG_ERR, &err, 1);
+      return;
+    }
+    baudPending = false;
+    uint8_t payload[1 + sizeof(BAUD_TEST_PATTERN)] = {CMD_BAUD_TEST};
+    memcpy(payload + 1, BAUD_TEST_PATTERN, sizeof(BAUD_TEST_PATTERN));
+    sendFrame(link, MSG_ACK, payload, sizeof(payload));
+  }
+#ifdef HOBD_KTRACE
+  else if (cmd == CMD_KTRACE)
+  {
+    ktraceStart(args[0] != 0);
+    uint8_t payload[2] = {CMD_KTRACE, (uint8_t)ktraceOn};
+    sendFrame(link, MSG_ACK, payload, 2);
+  }
+#endif
   else
   {
-    const uint8_t err = 0xFF;
+    const uint8_t err = ERR_UNKNOWN;
     sendFrame(link, MSG_ERR, &err, 1);
   }
 }
@@ -156,8 +581,14 @@ void loop()
 void setup()
 {
   // pin 12 for 1 wire
-  Serial.begin(115200);
+  // (HOBD_BT_LINK: configure the module for 115200 with AT+UART)
+  Serial.begin(baudRates[0]);
+#ifdef HOBD_BENCH
+  bench_crc(Serial);
+#endif
   dlcSerial.begin(9600);
+  ecu.subMask = LIVE_CHANS;
+  fitGroupsToBudget(baudRates[0]);
   delay(1000);
   ecu.init();
   delay(1000);
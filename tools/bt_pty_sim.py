@@ -0,0 +1,89 @@
+"""
+Stand-in for a UART Bluetooth module (HC-05 style SPP) between the board
+and the host, for testing the uno_bt build without a radio.
+
+Bytes from the board are cut into radio packets the way the module does
+it: a packet goes out when it reaches --mtu bytes or when no byte arrived
+for --gap-ms. Each packet then costs --slot-ms of air time before the
+host sees it. The host side is a pty; point gui.py at the printed path.
+
+    python tools/bt_pty_sim.py /dev/ttyACM0 --mtu 64
+"""
+import argparse
+import errno
+import os
+import select
+import time
+import tty
+
+import serial
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("port", help="board serial port")
+    ap.add_argument("--baud", type=int, default=115200)
+    ap.add_argument("--mtu", type=int, default=64, help="module packet size")
+    ap.add_argument("--gap-ms", type=float, default=5.0, help="module flushes after this idle time")
+    ap.add_argument("--slot-ms", type=float, default=3.75, help="air time per packet (6 slots of 625 us)")
+    args = ap.parse_args()
+
+    dev = serial.Serial(args.port, args.baud, timeout=0)
+    master, slave = os.openpty()
+    tty.setraw(slave)
+    print(f"host side: {os.ttyname(slave)}")
+
+    pending = bytearray()   # in the module, not sent yet
+    last_rx = 0.0
+    air_free = 0.0          # when the radio can start the next packet
+    in_flight = []          # (deliver_at, bytes)
+    packets = payload = 0
+    next_report = time.time() + 5
+    host_away_until = 0.0   # no client on the pty: its reads fail with EIO
+
+    while True:
+        now = time.time()
+        timeout = 0.001 if pending or in_flight else 0.1
+        fds = [dev.fileno()] + ([master] if now >= host_away_until else [])
+        r, _, _ = select.select(fds, [], [], timeout)
+        now = time.time()
+
+        if master in r:
+            # host -> board, commands are tiny, pass straight through
+            try:
+                dev.write(os.read(master, 256))
+            except OSError as e:
+                if e.errno != errno.EIO:
+                    raise
+                # select keeps calling it readable, look again in a while
+                host_away_until = now + 0.25
+
+        if dev.fileno() in r:
+            data = dev.read(dev.in_waiting or 1)
+            if data:
+                pending += data
+                last_rx = now
+
+        # the module cuts packets on size or on an idle gap
+        while pending and (len(pending) >= args.mtu or now - last_rx >= args.gap_ms / 1000):
+            pkt = bytes(pending[:args.mtu])
+            del pending[:args.mtu]
+            start = max(now, air_free)
+            air_free = start + args.slot_ms / 1000
+            in_flight.append((air_free, pkt))
+            packets += 1
+            payload += len(pkt)
+
+        while in_flight and in_flight[0][0] <= now:
+            os.write(master, in_flight.pop(0)[1])
+
+        if now >= next_report:
+            fill = payload / packets / args.mtu * 100 if packets else 0
+            print(f"{packets} packets, {payload} bytes, {fill:.0f}% mean fill, "
+                  f"air busy {packets * args.slot_ms / 50:.0f}%")
+            packets = payload = 0
+            next_report = now + 5
+
+
+if __name__ == "__main__":
+    main()